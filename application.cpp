@@ -16,201 +16,183 @@
 
 #include <iostream>
 #include <iomanip>  /*setprecision*/
+#include <fstream>
 #include <string>
 #include <vector>
 #include <map>
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
-#include <queue>
+#include <memory>
+#include <span>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include "tinyxml2.h"
 #include "dist.h"
 #include "graph.h"
+#include "compactgraph.h"
+#include "search.h"
+#include "ch.h"
+#include "spatial.h"
+#include "matrix.h"
+#include "mapcache.h"
+#include "meeting.h"
+#include "server.h"
+#include "overlay.h"
+#include "bench.h"
 #include "osm.h"
 
 
 using namespace std;
 using namespace tinyxml2;
 
-// A comparator for use in priority queue for Dijkstra's
-class prioritize
-{
-public:
-  bool operator()(const pair<long long,double>& p1, const pair<long long,double>& p2) const
-  {
-    return p1.second > p2.second; 
-  }
-};
-
 const double INF = numeric_limits<double>::max(); // GLOBAL INFINITY CONSTANT!
 
-// Searches Buildings vector for searchTerm by abbreviations first and then full name and returns the index of matching info in Buildings if found
-int searchBuilding(vector<BuildingInfo>& Buildings, string searchTerm) {
-  for (int i = 0; i < static_cast<int>(Buildings.size()); i++) { // First loop
-    if (Buildings.at(i).Abbrev.find(searchTerm) != string::npos) { // Searches abbreviations
-      return i; // If we found a match, return the BuildingInfo for the match
-    }
-  }
+// Which map nodes become graph vertices: every node, only nodes on some footway, or footway nodes with
+// pass-through chains collapsed into single edges (paths are expanded back when printed)
+enum class graphPruning { ALL_NODES, FOOTWAY_NODES, COLLAPSED_CHAINS };
 
-  for (int i = 0; i < static_cast<int>(Buildings.size()); i++) { // Second loop
-    if (Buildings.at(i).Fullname.find(searchTerm) != string::npos) { // Searches full names
-      return i; // If we found a match, return the BuildingInfo for the match
-    }
+// How dense vertex indices are laid out in memory: by OSM ID as loaded, along a Hilbert curve over the map, or in
+// breadth-first order over the footways. The last two put neighbors near each other for the searches' caches.
+enum class vertexOrdering { OSM_ID, HILBERT, BFS };
+
+// Returns the Coordinates of every building in Buildings, in the same order, for the BuildingCenters spatial index
+vector<Coordinates> getBuildingCenters(vector<BuildingInfo>& Buildings) {
+  vector<Coordinates> centers;
+
+  for (BuildingInfo& building : Buildings) {
+    centers.push_back(building.Coords);
   }
 
-  return -1; // Return -1 (invalid index) if we didn't find a match
+  return centers;
 }
 
-// Given a midpoint, returns index of building in Buildings closest to center
-int getCenterBuildingIndex(vector<BuildingInfo>& Buildings, Coordinates midpoint, set<string>& invalidCenters) {
-  double midLat = midpoint.Lat; // Save midpoint lat and lon for ease of use
-  double midLon = midpoint.Lon;
+// Returns the Coordinates of every node that appears on some footway, each once and in order of first appearance
+vector<Coordinates> getFootwayNodes(NodeTable& Nodes, vector<FootwayInfo>& Footways) {
+  vector<Coordinates> footwayNodes;
+  set<long long> seen; // IDs already added, footways share nodes at intersections
 
-  double distance; // We will store our distance calculations here
-  double min = INF; // min starts as globally defined infinity
-  int minIndex = -1; // Keeps track of current min index in Buildings, set to -1 initially just in case Buildings is empty (it shouldn't be)
-
-  // Here's our little min algorithm at work
-  for (int i = 0; i < static_cast<int>(Buildings.size()); i++) { // Loop through buildings
-    if (invalidCenters.count(Buildings.at(i).Fullname)) { // Count returns 1 if this Building's name is present in the invalidCenters set
-      continue; // Skip this building and move on to the next
+  for (FootwayInfo& footway : Footways) {
+    for (long long id : footway.Nodes) {
+      if (seen.insert(id).second) { // insert() reports whether the ID was new
+        footwayNodes.push_back(Nodes.at(id));
+      }
     }
+  }
 
-    distance = distBetween2Points(midLat, midLon, Buildings.at(i).Coords.Lat, Buildings.at(i).Coords.Lon); // Find distance from midpt and building
+  return footwayNodes;
+}
 
-    if (distance < min) { // If distance is less than min
-      min = distance; // Set min to distance
-      minIndex = i; // Record index of new min
-    }
+// Prints a meeting point result the way the interactive loop always has
+void printMeetingPoint(const MeetingPointResult& result) {
+  if (result.Status == MeetingPointResult::PERSON1_NOT_FOUND) {
+    cout << "Person 1's building not found" << endl; // Error message
+    return;
   }
 
-  return minIndex; // Return index of closest building
-}
+  if (result.Status == MeetingPointResult::PERSON2_NOT_FOUND) {
+    cout << "Person 2's building not found" << endl; // Error message
+    return;
+  }
 
-// Returns the Coordinates struct of the footway node that is closest to the building parameter
-// This is a similar implementation as the above function but instead of returning the index it returns the Coordinates struct of the node
-Coordinates getClosestNode(map<long long, Coordinates>& Nodes, vector<FootwayInfo>& Footways, BuildingInfo building) {
-  double buildLat = building.Coords.Lat;
-  double buildLon = building.Coords.Lon;
-
-  double distance;
-  double min = INF;
-  long long minID; // Stores ID of last minimum
-
-  // Similar min algorithm as above, except we iterate over Footways vector (and proceeding vectors) by range
-  for (auto i : Footways) {
-    for (auto j : i.Nodes) { // !!! We are now in an individual FootwayInfo's Nodes vector !!! Iterate by range where j are IDs of Nodes in vectors!
-      distance = distBetween2Points(buildLat, buildLon, Nodes.at(j).Lat, Nodes.at(j).Lon); // Use Nodes to find coords of footway node at ID
-      
-      if (distance < min) {
-        min = distance;
-        minID = j; // j is the ID of a new min node that we found in the Nodes vector (i.Nodes) of a FootwayInfo struct (i). Store it!
-      }
-    }
+  if (result.Status == MeetingPointResult::NO_DESTINATION) {
+    cout << "Sorry, no destination building is reachable by both people" << endl;
+    return;
   }
 
-  return Nodes.at(minID); // Returns the Coordinates struct at the ID of the minimum node in the map
-}
+  const BuildingInfo& centerBuilding = result.Destinations.front();
+  const Coordinates& centerCoords = result.DestinationNodes.front();
 
-// Runs Dijkstra's algorithm to get shortest weighted path from startV to endV, which is recorded in path vector passed by reference
-// After that, returns the double holding the distance of the path
-double Dijkstra(graph<long long, double>& G, long long startV, long long endV, vector<long long>& path) {
-  priority_queue<pair<long long, double>, vector<pair<long long, double>>, prioritize> unvisitedQ; // Here we have our priority queue
-  vector<long long> graphVertices = G.getVertices(); // Store our vertices from graph in a vector
-  map<long long, double> distances; // Map to distances from start vertex to each vertex (starts at INF for each vertex)
-  map<long long, long long> predecessors; // Map to each vertex's predecessor along the shortest path
-  set<long long> visitedVertices;
+  // PRINT BUILDING 1, 2, AND CENTER INFO ----------------------------------------------------------------------
+  cout << endl;
 
-  for (auto v : graphVertices) { // This loop sets up all of the above containers for Dijkstra's, recall v is an ID (long long)
-    distances.emplace(v, INF);
-    predecessors.emplace(v, -1); // -1 indicates no predecessor yet
-    unvisitedQ.push(make_pair(v, distances.at(v))); // All of these distances will be INF
-  }
+  cout << "Person 1's point:" << endl 
+  << " " << result.Person1.Fullname << endl
+  << " (" << result.Person1.Coords.Lat << ", " << result.Person1.Coords.Lon << ")" << endl;
 
-  // We begin at the start vertex, which has a distance of 0 to itself
-  distances.at(startV) = 0;
-  unvisitedQ.push(make_pair(startV, distances.at(startV))); // Push startV with distance 0 into queue
+  cout << "Person 2's point:" << endl 
+  << " " << result.Person2.Fullname << endl
+  << " (" << result.Person2.Coords.Lat << ", " << result.Person2.Coords.Lon << ")" << endl;
 
-  long long currentV;
-  set<long long> adjacentVertices;
-  double edgeWeight;
-  double altPathDistance;
-  while (!unvisitedQ.empty()) {
-    currentV = unvisitedQ.top().first; // Visit vertex with smallest distance from startV
-    unvisitedQ.pop();
+  cout << "Destination Building:" << endl 
+  << " " << centerBuilding.Fullname << endl
+  << " (" << centerBuilding.Coords.Lat << ", " << centerBuilding.Coords.Lon << ")" << endl;
 
-    if (distances.at(currentV) == INF) { // If we've reached the end of the queue
-      break; // Leave the loop, we're done
-    }
-    else if (visitedVertices.count(currentV)) { // If currentV is in visited set (visited)
-      continue; // Skip over currentV and run the loop again
-    }
-    else { // Mark currentV as visited otherwise
-      visitedVertices.insert(currentV); // Add currentV to visited set
-    }
+  cout << endl;
 
-    adjacentVertices = G.neighbors(currentV); // Get adjacent vertices to currentV
-    for (auto adjV : adjacentVertices) {
-      G.getWeight(currentV, adjV, edgeWeight); // Store weight of currentV-->ajV edge in edgeWeight
-      altPathDistance = distances.at(currentV) + edgeWeight;
+  // PRINT NODE INFO FOR 1, 2, AND CENTER ----------------------------------------------------------------------
+  cout << "Nearest P1 node:" << endl 
+  << " " << result.Person1Node.ID << endl
+  << " (" << result.Person1Node.Lat << ", " << result.Person1Node.Lon << ")" << endl;
 
-      // If a shorter path is found from startV to adjV, update adjV's distance and predecessor
-      if (altPathDistance < distances.at(adjV)) {
-        distances.erase(adjV);
-        distances.emplace(adjV, altPathDistance);
-        predecessors.erase(adjV);
-        predecessors.emplace(adjV, currentV);
+  cout << "Nearest P2 node:" << endl 
+  << " " << result.Person2Node.ID << endl
+  << " (" << result.Person2Node.Lat << ", " << result.Person2Node.Lon << ")" << endl;
 
-        unvisitedQ.push(make_pair(adjV, altPathDistance));
-      }
-    }
+  cout << "Nearest destination node:" << endl 
+  << " " << centerCoords.ID << endl
+  << " (" << centerCoords.Lat << ", " << centerCoords.Lon << ")" << endl;
 
-    if (currentV == endV) { // If we got to the endV, get out of the loop
-      break;
-    }
+  cout << endl;
+
+  // END PRINTING ----------------------------------------------------------------------------------------------
+
+  if (result.Status == MeetingPointResult::UNREACHABLE) {
+    cout << "Sorry, destination unreachable" << endl;
+    return;
   }
 
-  if (currentV != endV) { // If we are out of the loop and aren't on endV, we didn't reach it
-    return -1; // -1 means we found nothing
+  // Every destination after the first is a fallback, tried because the one before it could not be reached by both
+  for (size_t i = 1; i < result.Destinations.size(); i++) {
+    cout << "At least one person was unable to reach the destination building. Finding next closest building..." << endl;
+    cout << endl;
+
+    cout << "New destination building: " << endl << " " << result.Destinations[i].Fullname << endl; // Print new destination building
+    cout << " (" << result.Destinations[i].Coords.Lat << ", " << result.Destinations[i].Coords.Lon << ")" << endl;
+
+    cout << "Nearest destination node: " << endl << " " << result.DestinationNodes[i].ID << endl; // Print new destination node
+    cout << " (" << result.DestinationNodes[i].Lat << ", " << result.DestinationNodes[i].Lon << ")" << endl;
+
+    cout << endl;
   }
 
-  path.push_back(endV); // Now we back trace through the predecessors starting from endV and push path into vector
-  long long backTrace = predecessors.at(endV);
-  while (backTrace != -1) {
-    path.push_back(backTrace);
-    backTrace = predecessors.at(backTrace);
+  if (result.Status == MeetingPointResult::DESTINATIONS_EXHAUSTED) {
+    cout << "At least one person was unable to reach the destination building. Finding next closest building..." << endl;
+    cout << endl;
+    cout << "Sorry, no destination building is reachable by both people" << endl;
+    return;
   }
 
-  return distances.at(endV); // Return the weight
+  cout << "Person 1's distance to dest: " << result.Distance1 << " miles" << endl;
+  cout << "Path: ";
+  for (size_t i = 0; i + 1 < result.Path1.size(); i++) { // Prints up to the last node and the last one after the loop without ->
+    cout << result.Path1.at(i) << "->";
+  }
+  cout << result.Path1.back() << endl;
+  cout << endl;
+
+  cout << "Person 2's distance to dest: " << result.Distance2 << " miles" << endl;
+  cout << "Path: ";
+  for (size_t i = 0; i + 1 < result.Path2.size(); i++) {
+    cout << result.Path2.at(i) << "->";
+  }
+  cout << result.Path2.back() << endl;
 }
 
 //
 // Standard application implemented here
 //
-void application(map<long long, Coordinates>& Nodes, vector<FootwayInfo>& Footways, vector<BuildingInfo>& Buildings, graph<long long, double>& G) {
+void application(const MeetingPointMap& Map) {
+  MeetingPointQuery query(Map); // All search state for the loop below, sized once and reused by every query
+
   // Main application loop!
   while (true) { // Used to be person1Building != "#"
     string person1Building, person2Building;
 
-    int firstIndex; // Index of first and second buildings, we use searchBuilding() to find them
-    int secondIndex;
-  
-    Coordinates midpoint; // Use centerBetween2Points() to get midpoint between first and second buildings
-
-    BuildingInfo p1Building; // We store the actual buildings in these variables
-    BuildingInfo p2Building;
-    BuildingInfo centerBuilding; // Use getCenterBuildingIndex() and store the building at that index as the center
-
-    Coordinates p1Coords;
-    Coordinates p2Coords;
-    Coordinates centerCoords;
-
-    set<string> invalidCenters; // If we ever run into an invalid center building, it gets stored here so we ignore it in getCenterBuildingIndex
-
     cout << endl;
     
-    // FIND BUILDINGS 1 AND 2 -----------------------------------------------------------------------
     cout << "Enter person 1's building (partial name or abbreviation), or #> ";
     getline(cin, person1Building);
 
@@ -218,214 +200,271 @@ void application(map<long long, Coordinates>& Nodes, vector<FootwayInfo>& Footwa
       break; // Goodbye, loop!
     }
 
-    firstIndex = searchBuilding(Buildings, person1Building); // Search for first building index
-
     cout << "Enter person 2's building (partial name or abbreviation)> ";
     getline(cin, person2Building);
 
-    secondIndex = searchBuilding(Buildings, person2Building); // Search for second building index
+    printMeetingPoint(query.find(person1Building, person2Building));
 
-    if (firstIndex == -1) { // If first building not found, output error and start main loop from beginning
-      cout << "Person 1's building not found" << endl; // Error message
-      continue; // Start loop over again and get new input
+    if constexpr (PROFILING) {
+      writeQueryProfile(cout, query.profile());
     }
+  }
+  // --------------------------------------------------------------------------------------------
+}
 
-    // Okay we found the first building...
+// Reads the next tab separated (person 1, person 2) building pair from in into request, skipping blank lines and reporting (to cerr)
+// and skipping lines without a tab. lineNumber counts the lines read so far. Returns false at the end of in.
+bool readRequest(istream& in, int& lineNumber, MeetingPointRequest& request) {
+  string line;
 
-    if (secondIndex == -1) { // If second building not found, output error and start main loop from beginning
-      cout << "Person 2's building not found" << endl; // Error message
-      continue; // Start loop over again and get new input
+  while (getline(in, line)) {
+    lineNumber++;
+
+    if (!line.empty() && line.back() == '\r') { // Request files written on Windows
+      line.pop_back();
     }
-    
-    // Okay we found the second building...
 
-    p1Building = Buildings.at(firstIndex); // Store both buildings as BuildingInfo structs now
-    p2Building = Buildings.at(secondIndex);
+    if (line.empty()) {
+      continue;
+    }
 
-    // -------------------------------------------------------------------------------------------
-    
-    // GET THE MIDPOINT BETWEEN BUILDINGS 1 AND 2 AND FIND CLOSEST BUILDING (CENTER) ----------------
-    midpoint = centerBetween2Points(Buildings.at(firstIndex).Coords.Lat, Buildings.at(firstIndex).Coords.Lon, // Get midpoint coords
-                Buildings.at(secondIndex).Coords.Lat, Buildings.at(secondIndex).Coords.Lon);
-      
-    centerBuilding = Buildings.at(getCenterBuildingIndex(Buildings, midpoint, invalidCenters)); // Find center building (closest to midpoint) index and store it
-    // ^Recall that if Buildings is empty, this will error by trying to access an element at index -1 returned by getCenterBuildingIndex() 
+    size_t tab = line.find('\t');
 
-    // -------------------------------------------------------------------------------------------
+    if (tab == string::npos) {
+      cerr << "Line " << lineNumber << ": expected two buildings separated by a tab, skipped" << endl;
+      continue;
+    }
 
-    // PRINT BUILDING 1, 2, AND CENTER INFO ----------------------------------------------------------------------
-    cout << endl;
+    request = {line.substr(0, tab), line.substr(tab + 1)};
+    return true;
+  }
 
-    cout << "Person 1's point:" << endl 
-    << " " << p1Building.Fullname << endl
-    << " (" << p1Building.Coords.Lat << ", " << p1Building.Coords.Lon << ")" << endl;
+  return false;
+}
 
-    cout << "Person 2's point:" << endl 
-    << " " << p2Building.Fullname << endl
-    << " (" << p2Building.Coords.Lat << ", " << p2Building.Coords.Lon << ")" << endl;
+// Reads tab separated (person 1, person 2) building pairs from in, one per line, and writes one compact result line per pair to out.
+// Pairs are answered in batches on the pool's threads and the results keep the input order; out is only flushed at the end.
+void runBatch(istream& in, ostream& out, MeetingPointPool& pool, resultFormat format) {
+  const size_t BATCH_SIZE = 4096; // Pairs handed to the pool at once
+  vector<MeetingPointRequest> requests;
+  MeetingPointRequest request;
+  int lineNumber = 0;
 
-    cout << "Destination Building:" << endl 
-    << " " << centerBuilding.Fullname << endl
-    << " (" << centerBuilding.Coords.Lat << ", " << centerBuilding.Coords.Lon << ")" << endl;
+  auto answer = [&]() {
+    vector<MeetingPointResult> results = pool.run(requests);
 
-    cout << endl;
+    for (size_t i = 0; i < requests.size(); i++) {
+      writeResult(out, format, requests[i], results[i]);
+    }
 
-    // END PRINTING ----------------------------------------------------------------------------------------------
+    requests.clear();
+  };
 
-    // GET THE NODES CLOSEST TO BUILDINGS 1, 2, AND CENTER ------------------------------------------
-    p1Coords = getClosestNode(Nodes, Footways, p1Building); // Store each Coordinates struct returned by getClosestNode in respective variable
-    p2Coords = getClosestNode(Nodes, Footways, p2Building);
-    centerCoords = getClosestNode(Nodes, Footways, centerBuilding);
-    
-    // -------------------------------------------------------------------------------------------
-    
-    // PRINT NODE INFO FOR 1, 2, AND CENTER ----------------------------------------------------------------------
-    cout << "Nearest P1 node:" << endl 
-    << " " << p1Coords.ID << endl
-    << " (" << p1Coords.Lat << ", " << p1Coords.Lon << ")" << endl;
+  writeResultHeader(out, format);
 
-    cout << "Nearest P2 node:" << endl 
-    << " " << p2Coords.ID << endl
-    << " (" << p2Coords.Lat << ", " << p2Coords.Lon << ")" << endl;
+  while (readRequest(in, lineNumber, request)) {
+    requests.push_back(request);
 
-    cout << "Nearest destination node:" << endl 
-    << " " << centerCoords.ID << endl
-    << " (" << centerCoords.Lat << ", " << centerCoords.Lon << ")" << endl;
+    if (requests.size() == BATCH_SIZE) {
+      answer();
+    }
+  }
 
-    cout << endl;
+  answer();
+  out.flush();
+}
 
-    // END PRINTING ----------------------------------------------------------------------------------------------
+// Reads closure updates from filename, one per line as tab separated fields just like the server's (close, open, penalize,
+// reopen, see overlayEdit). Blank lines and lines starting with # are skipped. Returns false with the reason in error if the
+// file can't be read or a line doesn't parse.
+bool readClosures(const string& filename, vector<overlayEdit>& edits, string& error) {
+  ifstream in(filename);
+  string line;
+  int lineNumber = 0;
+
+  if (!in) {
+    error = "unable to open closures file '" + filename + "'";
+    return false;
+  }
 
-    // DIJKSTRA'S ALGORITHM ------------------------------------------------------------------------
-    vector<long long> path1;
-    vector<long long> path2;
-    vector<long long> validPath; // This one checks if we can path from 1 to 2 directly, not both to center
+  while (getline(in, line)) {
+    lineNumber++;
 
-    double totalDistance1 = Dijkstra(G, p1Coords.ID, centerCoords.ID, path1); // Call Dijkstra from 1 to center
-    double totalDistance2 = Dijkstra(G, p2Coords.ID, centerCoords.ID, path2); // Call Dijkstra from 2 to center
-    double validPathDistance = Dijkstra(G, p1Coords.ID, p2Coords.ID, validPath); // See if there is indeed a path from 1 to 2
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
 
-    if (validPathDistance == -1) { // Checks if there is a valid path from 1 to 2, Dijkstra returns 0 if we could not find a path
-      cout << "Sorry, destination unreachable" << endl;
+    if (line.empty() || line[0] == '#') {
       continue;
     }
-    else if (totalDistance1 == -1 || totalDistance2 == -1) { // If 1 or 2 can't reach center, output error and find new center
 
-      // FIND NEXT CLOSEST BUILDING ------------------------------------------------------------------------
-      while (true) {
-        cout << "At least one person was unable to reach the destination building. Finding next closest building..." << endl;
-        cout << endl;
-        invalidCenters.insert(centerBuilding.Fullname); // Store center building name in invalidCenters set so we don't use it next time
+    vector<string> fields;
+    size_t start = 0;
 
-        centerBuilding = Buildings.at(getCenterBuildingIndex(Buildings, midpoint, invalidCenters)); // Establish new centerBuilding
-        centerCoords = getClosestNode(Nodes, Footways, centerBuilding); // Establish new centerCoords
+    while (true) {
+      size_t tab = line.find('\t', start);
+      fields.push_back(line.substr(start, tab == string::npos ? string::npos : tab - start));
 
-        cout << "New destination building: " << endl << " " << centerBuilding.Fullname << endl; // Print new destination building
-        cout << " (" << centerBuilding.Coords.Lat << ", " << centerBuilding.Coords.Lon << ")" << endl;
+      if (tab == string::npos) {
+        break;
+      }
 
-        cout << "Nearest destination node: " << endl << " " << centerCoords.ID << endl; // Print new destination node
-        cout << " (" << centerCoords.Lat << ", " << centerCoords.Lon << ")" << endl;
+      start = tab + 1;
+    }
 
-        cout << endl;
+    overlayEdit edit;
 
-        path1.clear(); // Clear our path vectors to prepare for another round of Dijkstra's
-        path2.clear();
+    if (!parseOverlayEdit(fields, edit, error)) {
+      error = "closures file line " + to_string(lineNumber) + ": " + error;
+      return false;
+    }
 
-        totalDistance1 = Dijkstra(G, p1Coords.ID, centerCoords.ID, path1); // Run Dijkstra's again and pray for a center building that works
-        totalDistance2 = Dijkstra(G, p2Coords.ID, centerCoords.ID, path2);
-        
-        if (totalDistance1 == -1 || totalDistance2 == -1) { // If we get another bad center, we run the loop again
-          continue;
-        }
+    edits.push_back(edit);
+  }
 
-        break; // Otherwise, we break and move on
-      }
+  return true;
+}
 
-      // ----------------------------------------------------------------------------------------
-    }
+// Parses the --format option (tsv or json) into format, returns false on an unknown value
+bool parseResultFormat(string name, resultFormat& format) {
+  if (name == "tsv") {
+    format = resultFormat::TSV;
+  }
+  else if (name == "json") {
+    format = resultFormat::JSON;
+  }
+  else {
+    return false;
+  }
 
-    cout << "Person 1's distance to dest: " << totalDistance1 << " miles" << endl;
-    cout << "Path: ";
-    for (size_t i = path1.size() - 1; i > 0; i--) { // Goes down to index 1 and prints index 0 after loop without ->
-      cout << path1.at(i) << "->";
-    }
-    cout << path1.at(0) << endl;
-    cout << endl;
+  return true;
+}
 
-    cout << "Person 2's distance to dest: " << totalDistance2 << " miles" << endl;
-    cout << "Path: ";
-    for (size_t i = path2.size() - 1; i > 0; i--) { // Goes down to index 1 and prints index 0 after loop without ->
-      cout << path2.at(i) << "->";
-    }
-    cout << path1.at(0) << endl;
+// Parses the --meeting option (midpoint, minmax or minsum) into objective, returns false on an unknown value
+bool parseMeetingObjective(string name, meetingObjective& objective) {
+  if (name == "midpoint") {
+    objective = meetingObjective::MIDPOINT;
+  }
+  else if (name == "minmax") {
+    objective = meetingObjective::MIN_MAX;
+  }
+  else if (name == "minsum") {
+    objective = meetingObjective::MIN_SUM;
+  }
+  else {
+    return false;
   }
-  // --------------------------------------------------------------------------------------------
-}
 
-int main() {
-  // maps a Node ID to it's coordinates (lat, lon)
-  map<long long, Coordinates>  Nodes;
-  // info about each footway, in no particular order
-  vector<FootwayInfo>          Footways;
-  // info about each building, in no particular order
-  vector<BuildingInfo>         Buildings;
-  XMLDocument                  xmldoc;
+  return true;
+}
 
-  cout << "** Navigating UIC open street map **" << endl;
-  cout << endl;
-  cout << std::setprecision(8);
+// Parses the --engine option (dijkstra, astar, bidir, radix or ch) into mode/useCH, returns false on an unknown value
+bool parseSearchMode(string name, searchMode& mode, bool& useCH) {
+  useCH = false;
 
-  string def_filename = "map.osm";
-  string filename;
+  if (name == "ch") {
+    useCH = true;
+  }
+  else if (name == "dijkstra") {
+    mode = searchMode::DIJKSTRA;
+  }
+  else if (name == "astar") {
+    mode = searchMode::ASTAR;
+  }
+  else if (name == "bidir") {
+    mode = searchMode::BIDIRECTIONAL_ASTAR;
+  }
+  else if (name == "radix") {
+    mode = searchMode::RADIX_DIJKSTRA;
+  }
+  else {
+    return false;
+  }
 
-  cout << "Enter map filename> ";
-  getline(cin, filename);
+  return true;
+}
 
-  if (filename == "") {
-    filename = def_filename;
+// Parses the --prune option (footway or chains) into pruning, returns false on an unknown value
+bool parseGraphPruning(string name, graphPruning& pruning) {
+  if (name == "footway") {
+    pruning = graphPruning::FOOTWAY_NODES;
+  }
+  else if (name == "chains") {
+    pruning = graphPruning::COLLAPSED_CHAINS;
+  }
+  else {
+    return false;
   }
 
-  //
-  // Load XML-based map file
-  //
-  if (!LoadOpenStreetMap(filename, xmldoc)) {
-    cout << "**Error: unable to load open street map." << endl;
-    cout << endl;
-    return 0;
+  return true;
+}
+
+// Parses the --order option (hilbert or bfs) into ordering, returns false on an unknown value
+bool parseVertexOrdering(string name, vertexOrdering& ordering) {
+  if (name == "hilbert") {
+    ordering = vertexOrdering::HILBERT;
+  }
+  else if (name == "bfs") {
+    ordering = vertexOrdering::BFS;
+  }
+  else {
+    return false;
   }
 
-  //
-  // Read the nodes, which are the various known positions on the map:
-  //
-  int nodeCount = ReadMapNodes(xmldoc, Nodes);
+  return true;
+}
 
-  //
-  // Read the footways, which are the walking paths:
-  //
-  int footwayCount = ReadFootways(xmldoc, Footways);
+// loadMap
+//
+// Streams the XML map file (on threadCount threads) and builds everything the queries need from it: the frozen footway graph, the position
+// of each of its vertices, and the footway nodes for snapping. pruning decides which nodes become vertices, ordering how they are
+// numbered. parseSeconds is set to the time spent reading the XML, the rest of the call is building. Returns false if the file could not
+// be loaded.
+bool loadMap(string filename, int threadCount, graphPruning pruning, vertexOrdering ordering, int& nodeCount, int& footwayCount, vector<BuildingInfo>& Buildings,
+  compactGraph<long long, double>& CG, vector<Coordinates>& vertexCoords, vector<Coordinates>& footwayNodes, double& parseSeconds) {
+  // maps a Node ID to it's coordinates (lat, lon), sorted by ID
+  NodeTable                    Nodes;
+  // info about each footway, in no particular order
+  vector<FootwayInfo>          Footways;
 
   //
-  // Read the university buildings:
+  // Stream the XML-based map file, reading the nodes (the various known positions on the map), the
+  // footways (the walking paths) and the university buildings in one pass without building a DOM:
   //
-  int buildingCount = ReadUniversityBuildings(xmldoc, Nodes, Buildings);
+  auto parseStart = chrono::steady_clock::now();
 
-  //
-  // Stats
-  //
-  assert(nodeCount == (int)Nodes.size());
-  assert(footwayCount == (int)Footways.size());
-  assert(buildingCount == (int)Buildings.size());
+  if (!StreamOpenStreetMap(filename, Nodes, Footways, Buildings, threadCount)) {
+    return false;
+  }
 
-  cout << endl;
-  cout << "# of nodes: " << Nodes.size() << endl;
-  cout << "# of footways: " << Footways.size() << endl;
-  cout << "# of buildings: " << Buildings.size() << endl;
+  parseSeconds = chrono::duration<double>(chrono::steady_clock::now() - parseStart).count();
+
+  nodeCount = Nodes.size();
+  footwayCount = static_cast<int>(Footways.size());
 
   // ADD VERTICES TO OUR GRAPH ----------------------------------------------------------------------
   graph<long long, double> G;
-  
-  for (auto i : Nodes) { // For every pair in the Nodes map (long long ID, coordinate structure)
-    G.addVertex(i.first); // RECALL: Map is just a pair structure with (key, value) where key is stored as .first and value is stored as .second
+  G.reserve(Nodes.size());
+
+  vector<bool> onFootway(Nodes.size(), pruning == graphPruning::ALL_NODES); // Nodes that become vertices
+
+  for (FootwayInfo& footway : Footways) {
+    for (long long id : footway.Nodes) {
+      int index = Nodes.find(id); // -1 when a clipped extract leaves the node out
+
+      if (index == -1) {
+        cout << "**ERROR: footway " << footway.ID << " references missing node " << id << "." << endl;
+        return false;
+      }
+
+      onFootway[index] = true;
+    }
+  }
+
+  for (int i = 0; i < Nodes.size(); i++) { // For every node ID, in increasing order like the map used to give them
+    if (onFootway[i]) { // Building outlines and other ways are never walked, so pruning leaves them out
+      G.addVertex(Nodes.IDs[i]);
+    }
   }
 
   // ---------------------------------------------------------------------------------------------
@@ -438,7 +477,9 @@ int main() {
   Coordinates toCoords;
 
   double weightAsDistance;
-  for (auto i : Footways) {
+  vector<graph<long long, double>::BulkEdge> footwayEdges; // Every edge, added in one pass once collected
+
+  for (const FootwayInfo& i : Footways) {
 
     for (size_t j = 0; j < i.Nodes.size() - 1; j++) { // Loop until second to last element
       fromID = i.Nodes.at(j); // Gets ID for node j
@@ -450,25 +491,394 @@ int main() {
       weightAsDistance = distBetween2Points(fromCoords.Lat, fromCoords.Lon, toCoords.Lat, toCoords.Lon); // Calculate distance
 
       // Bidirectional edge adding
-      G.addEdge(fromID, toID, weightAsDistance); // Add from-->to edge to graph with calculated distance as weight
-      G.addEdge(toID, fromID, weightAsDistance); // Add to-->from edge to graph with calculated distance as weight
+      footwayEdges.push_back({fromID, toID, weightAsDistance}); // from-->to edge with calculated distance as weight
+      footwayEdges.push_back({toID, fromID, weightAsDistance}); // to-->from edge with calculated distance as weight
     }
   }
 
+  G.addEdgesBulk(footwayEdges); // Same graph as adding them one by one, repeated segments keep the last weight
+
   // ---------------------------------------------------------------------------------------------
 
-  cout << "# of vertices: " << G.NumVertices() << endl;
-  cout << "# of edges: " << G.NumEdges() << endl;
-  cout << endl;
+  // G is never mutated past this point, so freeze it into CSR form for the queries
+  CG = freeze(G);
+  footwayNodes = getFootwayNodes(Nodes, Footways);
 
-  cout << endl << "LIST OF BUILDINGS" << endl << "------------------------------" << endl;
+  if (pruning == graphPruning::COLLAPSED_CHAINS) {
+    // Buildings snap to these nodes, so they have to stay vertices for queries to start and end on them
+    spatialGrid snapGrid(footwayNodes);
+    vector<long long> endpoints;
 
-  for (BuildingInfo b : Buildings) {
-    cout << "NAME: " << b.Fullname << ", ABBREVIATION: " << b.Abbrev << endl;
+    for (BuildingInfo& building : Buildings) {
+      endpoints.push_back(getClosestNode(snapGrid, building).ID);
+    }
+
+    CG = CG.collapseChains(endpoints);
+  }
+
+  if (ordering != vertexOrdering::OSM_ID) {
+    vector<Coordinates> coords; // Of each vertex in the current order, for the curve
+
+    for (long long v : CG.getVertices()) {
+      coords.push_back(Nodes.at(v));
+    }
+
+    vector<int> newOrder = (ordering == vertexOrdering::HILBERT) ? hilbertOrder(coords) : CG.bfsOrder();
+    CG = CG.permuted(newOrder);
+  }
+
+  vertexCoords.reserve(CG.NumVertices()); // Position of each vertex by dense index, used by the A* heuristics
+
+  for (long long v : CG.getVertices()) {
+    vertexCoords.push_back(Nodes.at(v));
+  }
+
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  // Shortest path engine used for every query, selectable with --engine dijkstra|astar|bidir|radix|ch
+  searchMode mode = searchMode::DIJKSTRA;
+  bool useCH = false;
+  string engineName = "dijkstra"; // As given to --engine, for the benchmark report
+  string cacheFilename; // --compile-map writes the loaded map here and exits
+  int threadCount = max(1, static_cast<int>(thread::hardware_concurrency())); // Map loading threads, --threads overrides
+  graphPruning pruning = graphPruning::ALL_NODES; // Which nodes become graph vertices, --prune footway|chains
+  vertexOrdering ordering = vertexOrdering::OSM_ID; // Memory layout of the vertices, --order hilbert|bfs (a cache keeps the one it was compiled with)
+  string filename; // --map skips the filename prompt
+  string queriesFilename; // --queries answers the pairs in this file (- for stdin) instead of running interactively
+  resultFormat format = resultFormat::TSV; // Batch and server output, --format tsv|json
+  int servePort = 0; // --serve keeps the map loaded and answers requests on this TCP port
+  meetingObjective objective = meetingObjective::MIDPOINT; // Where the people meet, --meeting midpoint|minmax|minsum
+  int cacheCapacity = 0; // --cache keeps this many recent meeting point results, for repeated building pairs
+  bool useFixedWeights = false; // --fixed-weights stores edge weights as 32-bit fixed point, half the memory of doubles
+  bool useMatrix = false; // --matrix precomputes every building-to-building route (a cache compiled with it has one already)
+  bool benchMode = false; // --bench times queries (generated, or the --queries file) and prints one JSON report line
+  int benchQueries = 1000; // --bench-queries, how many queries --bench generates
+  unsigned benchSeed = 1; // --seed, what --bench generates them from
+  string closuresFilename; // --closures starts with these footways closed or penalized, the server can change them later
+
+  auto usage = [&]() {
+    cout << "Usage: " << argv[0] << " [--engine dijkstra|astar|bidir|radix|ch] [--prune footway|chains] [--order hilbert|bfs] [--fixed-weights] [--compile-map cachefile] [--threads n]"
+         << " [--meeting midpoint|minmax|minsum] [--matrix] [--cache n] [--map mapfile] [--queries file|- | --serve port] [--format tsv|json]"
+         << " [--bench [--bench-queries n] [--seed n]] [--closures file]" << endl;
+  };
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+
+    if (arg == "--engine" && i + 1 < argc && parseSearchMode(argv[i + 1], mode, useCH)) {
+      engineName = argv[++i];
+    }
+    else if (arg == "--compile-map" && i + 1 < argc) {
+      cacheFilename = argv[++i];
+    }
+    else if (arg == "--prune" && i + 1 < argc && parseGraphPruning(argv[i + 1], pruning)) {
+      i++;
+    }
+    else if (arg == "--order" && i + 1 < argc && parseVertexOrdering(argv[i + 1], ordering)) {
+      i++;
+    }
+    else if (arg == "--threads" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+      threadCount = atoi(argv[++i]);
+    }
+    else if (arg == "--map" && i + 1 < argc) {
+      filename = argv[++i];
+    }
+    else if (arg == "--queries" && i + 1 < argc) {
+      queriesFilename = argv[++i];
+    }
+    else if (arg == "--format" && i + 1 < argc && parseResultFormat(argv[i + 1], format)) {
+      i++;
+    }
+    else if (arg == "--meeting" && i + 1 < argc && parseMeetingObjective(argv[i + 1], objective)) {
+      i++;
+    }
+    else if (arg == "--cache" && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+      cacheCapacity = atoi(argv[++i]);
+    }
+    else if (arg == "--fixed-weights") {
+      useFixedWeights = true;
+    }
+    else if (arg == "--matrix") {
+      useMatrix = true;
+    }
+    else if (arg == "--bench") {
+      benchMode = true;
+    }
+    else if (arg == "--bench-queries" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+      benchQueries = atoi(argv[++i]);
+    }
+    else if (arg == "--closures" && i + 1 < argc) {
+      closuresFilename = argv[++i];
+    }
+    else if (arg == "--seed" && i + 1 < argc) {
+      benchSeed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+    }
+    else if (arg == "--serve" && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) < 65536) {
+      servePort = atoi(argv[++i]);
+    }
+    else {
+      usage();
+      return 0;
+    }
+  }
+
+  // Batch results (or the benchmark report) are the only thing written to stdout and the server has no prompts, so the map must come
+  // from --map. --queries feeds either the batch or the benchmark.
+  bool batchMode = !queriesFilename.empty() || servePort != 0 || benchMode;
+
+  if (batchMode && (filename.empty() || (!queriesFilename.empty() && servePort != 0) || (benchMode && servePort != 0))) {
+    usage();
+    return 0;
+  }
+
+  if (batchMode) {
+    ios::sync_with_stdio(false); // Results go out through cout's own buffer, not one write per line
+  }
+
+  // info about each building, in no particular order
+  vector<BuildingInfo>         Buildings;
+
+  cout << std::setprecision(8);
+
+  if (!batchMode) {
+    cout << "** Navigating UIC open street map **" << endl;
+    cout << endl;
+  }
+
+  string def_filename = "map.osm";
+
+  if (filename.empty()) {
+    cout << "Enter map filename> ";
+    getline(cin, filename);
+
+    if (filename == "") {
+      filename = def_filename;
+    }
+  }
+
+  int nodeCount = 0;
+  int footwayCount = 0;
+
+  compactGraph<long long, double> CG; // The footway graph, owned or borrowed from the mapped cache
+  span<const Coordinates> vertexCoords; // Position of each vertex by dense index, used by the A* heuristics
+  span<const Coordinates> footwayNodes; // Footway nodes in first-appearance order, for snapping buildings
+
+  buildingMatrix matrix; // Building distance matrix, empty unless --matrix or stored in the cache
+
+  mapCache cache; // Must outlive everything above when they point into it
+  vector<Coordinates> loadedVertexCoords;
+  vector<Coordinates> loadedFootwayNodes;
+
+  benchmarkReport report;
+  auto loadStart = chrono::steady_clock::now();
+  double parseSeconds = -1; // Stays -1 for a cache, which is mapped rather than parsed
+
+  if (mapCache::isCacheFile(filename)) {
+    //
+    // Compiled map, mapped straight into memory:
+    //
+    if (!cache.open(filename)) {
+      (batchMode ? cerr : cout) << "**Error: unable to load open street map." << endl;
+      (batchMode ? cerr : cout) << endl;
+      return 0;
+    }
+
+    nodeCount = cache.NumNodes();
+    footwayCount = cache.NumFootways();
+    Buildings = cache.buildings();
+    CG = cache.graph();
+    vertexCoords = cache.vertexCoords();
+    footwayNodes = cache.footwayNodes();
+    matrix = cache.matrix();
+  }
+  else {
+    if (!loadMap(filename, threadCount, pruning, ordering, nodeCount, footwayCount, Buildings, CG, loadedVertexCoords, loadedFootwayNodes, parseSeconds)) {
+      (batchMode ? cerr : cout) << "**Error: unable to load open street map." << endl;
+      (batchMode ? cerr : cout) << endl;
+      return 0;
+    }
+
+    vertexCoords = loadedVertexCoords;
+    footwayNodes = loadedFootwayNodes;
+  }
+
+  // The radix engine searches integer weights. Converted before anything is built over the weights, so it all agrees on them.
+  if ((useFixedWeights || mode == searchMode::RADIX_DIJKSTRA) && !CG.hasFixedWeights()) {
+    try {
+      CG = CG.toFixedWeights();
+    }
+    catch (const out_of_range& e) {
+      (batchMode ? cerr : cout) << "**Error: " << e.what() << endl;
+      return 0;
+    }
+  }
+
+  double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+  report.LoadSeconds = parseSeconds < 0 ? loadSeconds : parseSeconds;
+  report.BuildSeconds = parseSeconds < 0 ? 0 : loadSeconds - parseSeconds;
+  auto preprocessStart = chrono::steady_clock::now();
+
+  if (!batchMode) {
+    cout << endl;
+    cout << "# of nodes: " << nodeCount << endl;
+    cout << "# of footways: " << footwayCount << endl;
+    cout << "# of buildings: " << Buildings.size() << endl;
+    cout << "# of vertices: " << CG.NumVertices() << endl;
+    cout << "# of edges: " << CG.NumEdges() << endl;
+    cout << endl;
+  }
+
+  // Spatial index over the footway nodes for snapping buildings to the network, built once
+  spatialGrid FootwayNodes(footwayNodes);
+
+  if (useMatrix && matrix.empty()) {
+    vector<long long> buildingNodes; // One search tree from each building's snapped node
+
+    for (BuildingInfo& building : Buildings) {
+      buildingNodes.push_back(getClosestNode(FootwayNodes, building).ID);
+    }
+
+    matrix = buildingMatrix::build(CG, buildingNodes, threadCount);
+  }
+
+  if (!matrix.empty() && !batchMode) {
+    cout << "# of matrix tree vertices: " << matrix.NumTreeVertices() << endl;
+    cout << endl;
+  }
+
+  if (!cacheFilename.empty()) {
+    if (!mapCache::write(cacheFilename, nodeCount, footwayCount, CG, vertexCoords, footwayNodes, Buildings, &matrix)) {
+      return 0;
+    }
+
+    cout << "Map compiled to '" << cacheFilename << "'" << endl;
+    cout << "** Done **" << endl;
+    return 0;
+  }
+
+  // One-time Contraction Hierarchies preprocessing, only when the ch engine was requested
+  unique_ptr<contractionHierarchy<long long, double>> CH;
+
+  if (useCH) {
+    CH = make_unique<contractionHierarchy<long long, double>>(CG);
+
+    if (!batchMode) {
+      cout << "# of shortcuts: " << CH->NumShortcuts() << endl;
+      cout << endl;
+    }
+  }
+
+  if (!batchMode) {
+    cout << endl << "LIST OF BUILDINGS" << endl << "------------------------------" << endl;
+
+    for (BuildingInfo b : Buildings) {
+      cout << "NAME: " << b.Fullname << ", ABBREVIATION: " << b.Abbrev << endl;
+    }
+  }
+
+  report.PreprocessSeconds = chrono::duration<double>(chrono::steady_clock::now() - preprocessStart).count();
+
+  // Spatial index over the building centers for picking the meeting building, built once
+  spatialGrid BuildingCenters(getBuildingCenters(Buildings));
+
+  // Everything the queries read, as snapshots the server's closure updates swap in while queries run. Nothing else updates it.
+  liveMap Live(Buildings, FootwayNodes, BuildingCenters, CG, vertexCoords, mode, CH.get(), &matrix, objective, cacheCapacity, threadCount);
+
+  if (!closuresFilename.empty()) {
+    vector<overlayEdit> edits;
+    string error;
+
+    if (!readClosures(closuresFilename, edits, error) || !Live.apply(edits, error)) {
+      (batchMode ? cerr : cout) << "**Error: " << error << endl;
+      return 0;
+    }
+
+    report.PreprocessSeconds += Live.snapshot()->BuildSeconds; // Graph, hierarchy and matrix again, with the closures
+  }
+
+  // Read-only view of everything the queries need, shared by however many query objects are made over it
+  shared_ptr<const MeetingPointMap> Map = Live.map();
+
+  if (benchMode) {
+    vector<MeetingPointRequest> requests;
+
+    if (queriesFilename.empty()) {
+      requests = randomRequests(Buildings, benchQueries, benchSeed);
+      report.Seed = benchSeed;
+    }
+    else {
+      ifstream queriesFile(queriesFilename);
+      MeetingPointRequest request;
+      int lineNumber = 0;
+
+      if (!queriesFile) {
+        cerr << "**Error: unable to open queries file '" << queriesFilename << "'" << endl;
+        return 0;
+      }
+
+      while (readRequest(queriesFile, lineNumber, request)) {
+        requests.push_back(request);
+      }
+
+      report.QueriesFile = queriesFilename;
+    }
+
+    report.Map = filename;
+    report.Engine = engineName;
+    report.FixedWeights = CG.hasFixedWeights();
+
+    runBenchmark(*Map, requests, report);
+    writeBenchmarkReport(cout, report);
+
+    if constexpr (PROFILING) { // Kept off stdout, whose lines all have the same shape
+      writeProfile(cerr, resultFormat::JSON, *Map);
+    }
+    return 0;
+  }
+
+  if (servePort != 0) {
+    MeetingPointPool pool([&Live]() { return Live.map(); }, threadCount); // Workers pick up closure updates between jobs
+    routingServer server(pool, Live, format);
+
+    if (!server.listen(servePort)) {
+      return 0;
+    }
+
+    cerr << "Serving on port " << servePort << " with " << pool.NumThreads() << " routing threads" << endl;
+    server.serve();
+    return 0;
+  }
+
+  if (batchMode) {
+    MeetingPointPool pool(*Map, threadCount);
+    ifstream queriesFile;
+
+    if (queriesFilename != "-") {
+      queriesFile.open(queriesFilename);
+
+      if (!queriesFile) {
+        cerr << "**Error: unable to open queries file '" << queriesFilename << "'" << endl;
+        return 0;
+      }
+    }
+
+    runBatch(queriesFilename == "-" ? cin : queriesFile, cout, pool, format);
+
+    if (Map->Results.enabled()) {
+      cerr << "Result cache: " << Map->Results.hits() << " hits, " << Map->Results.misses() << " misses" << endl;
+    }
+
+    if constexpr (PROFILING) {
+      writeProfile(cerr, format, *Map);
+    }
+
+    return 0;
   }
 
   // Execute Application
-  application(Nodes, Footways, Buildings, G);
+  application(*Map);
 
   //
   // done:
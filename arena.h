@@ -0,0 +1,65 @@
+// arena.h
+//
+// Per-thread monotonic arena for the short-lived state of one query (path pieces, unpacking stacks, ...)
+// Allocation is a pointer bump and nothing is freed one by one; the whole arena is released when the
+// outermost query on the thread finishes, and its blocks go back to a per-thread pool for the next query.
+// Threads never share an arena, so there is no locking and no contention on the global heap.
+//
+
+#include <memory_resource>
+
+#pragma once
+
+using namespace std;
+
+class queryArena {
+  private:
+    pmr::unsynchronized_pool_resource pool; // Keeps released blocks around for the next query on this thread
+    pmr::monotonic_buffer_resource arena;
+    int depth; // # of scopes currently open on this thread
+
+    queryArena() : arena(64 * 1024, &pool), depth(0) {}
+
+  public:
+    queryArena(const queryArena&) = delete;
+    queryArena& operator=(const queryArena&) = delete;
+
+    // local
+    //
+    // Returns the calling thread's arena
+    static queryArena& local() {
+      thread_local queryArena instance;
+      return instance;
+    }
+
+    // scope
+    //
+    // Marks the lifetime of one query. Memory from resource() stays valid until the outermost scope on
+    // the thread ends, so nested queries can share the arena; the arena is released at that point.
+    //
+    // Example:
+    //    queryArena::scope scratch;
+    //    pmr::vector<int> stack(scratch.resource());
+    class scope {
+      private:
+        queryArena& owner;
+
+      public:
+        scope() : owner(local()) {
+          owner.depth++;
+        }
+
+        ~scope() {
+          if (--owner.depth == 0) {
+            owner.arena.release();
+          }
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        pmr::memory_resource* resource() const {
+          return &owner.arena;
+        }
+    };
+};
@@ -0,0 +1,154 @@
+// bench.cpp
+//
+// Implements the benchmark mode
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#include <sys/resource.h>
+
+#include "bench.h"
+
+using namespace std;
+
+
+//
+// randomRequests
+//
+// count pairs of buildings drawn uniformly (with repetition) by a generator seeded with seed, named by their full
+// names. mt19937's output is fixed by the standard, so a seed gives the same queries on every platform.
+//
+vector<MeetingPointRequest> randomRequests(const vector<BuildingInfo>& Buildings, int count, unsigned seed)
+{
+  vector<MeetingPointRequest> requests;
+
+  if (Buildings.empty()) {
+    return requests;
+  }
+
+  mt19937 generator(seed);
+
+  for (int i = 0; i < count; i++) {
+    const BuildingInfo& first = Buildings[generator() % Buildings.size()];
+    const BuildingInfo& second = Buildings[generator() % Buildings.size()];
+
+    requests.push_back({first.Fullname, second.Fullname});
+  }
+
+  return requests;
+}
+
+
+//
+// percentile
+//
+// Nearest-rank percentile p (0..1) of sorted values, 0 if there are none
+//
+static double percentile(const vector<double>& sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+
+  size_t rank = static_cast<size_t>(ceil(p * sorted.size()));
+  return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+}
+
+
+//
+// runBenchmark
+//
+// Answers every request in order on this thread with one query object, timing each, and fills in the query side of the
+// report. Requests run through find() exactly as the interactive and batch modes do, result cache included.
+//
+void runBenchmark(const MeetingPointMap& map, const vector<MeetingPointRequest>& requests, benchmarkReport& report)
+{
+  MeetingPointQuery query(map);
+  vector<double> micros;
+  long long totalSettled = 0;
+
+  micros.reserve(requests.size());
+  report.Found = 0;
+  report.MaxSettled = 0;
+
+  for (const MeetingPointRequest& request : requests) {
+    auto start = chrono::steady_clock::now();
+    MeetingPointResult result = query.find(request.Person1, request.Person2);
+    auto stop = chrono::steady_clock::now();
+
+    micros.push_back(chrono::duration<double, micro>(stop - start).count());
+    totalSettled += query.settled();
+    report.MaxSettled = max(report.MaxSettled, query.settled());
+
+    if (result.Status == MeetingPointResult::FOUND) {
+      report.Found++;
+    }
+  }
+
+  report.Queries = static_cast<int>(requests.size());
+  report.MeanSettled = requests.empty() ? 0 : static_cast<double>(totalSettled) / requests.size();
+
+  double totalMicros = 0;
+
+  for (double m : micros) {
+    totalMicros += m;
+  }
+
+  sort(micros.begin(), micros.end());
+
+  report.MeanMicros = micros.empty() ? 0 : totalMicros / micros.size();
+  report.P50Micros = percentile(micros, 0.50);
+  report.P95Micros = percentile(micros, 0.95);
+  report.P99Micros = percentile(micros, 0.99);
+  report.MaxMicros = micros.empty() ? 0 : micros.back();
+
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    report.PeakRSSKB = usage.ru_maxrss; // Kilobytes on Linux
+  }
+}
+
+
+//
+// writeBenchmarkReport
+//
+// The report as one JSON object on one line, so runs can be appended to a file and compared across versions
+//
+void writeBenchmarkReport(ostream& out, const benchmarkReport& report)
+{
+  out << "{\"map\":";
+  writeJSONString(out, report.Map);
+  out << ",\"engine\":";
+  writeJSONString(out, report.Engine);
+  out << ",\"fixed_weights\":" << (report.FixedWeights ? "true" : "false");
+
+  if (report.QueriesFile.empty()) {
+    out << ",\"seed\":" << report.Seed;
+  }
+  else {
+    out << ",\"queries_file\":";
+    writeJSONString(out, report.QueriesFile);
+  }
+
+  out << ",\"load_s\":" << report.LoadSeconds
+      << ",\"build_s\":" << report.BuildSeconds
+      << ",\"preprocess_s\":" << report.PreprocessSeconds
+      << ",\"queries\":" << report.Queries
+      << ",\"found\":" << report.Found
+      << ",\"mean_us\":" << report.MeanMicros
+      << ",\"p50_us\":" << report.P50Micros
+      << ",\"p95_us\":" << report.P95Micros
+      << ",\"p99_us\":" << report.P99Micros
+      << ",\"max_us\":" << report.MaxMicros
+      << ",\"mean_settled\":" << report.MeanSettled
+      << ",\"max_settled\":" << report.MaxSettled
+      << ",\"peak_rss_kb\":" << report.PeakRSSKB
+      << "}\n";
+}
@@ -0,0 +1,47 @@
+// bench.h
+//
+// Declares the benchmark mode: times a fixed set of meeting point queries and reports the numbers as one JSON line
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "osm.h"
+#include "meeting.h"
+
+using namespace std;
+
+
+//
+// benchmarkReport
+//
+// One benchmark run. main() fills in what it measured while loading, runBenchmark() the query side.
+//
+struct benchmarkReport
+{
+  string Map;
+  string Engine;
+  bool FixedWeights = false;
+  string QueriesFile; // Replayed queries, empty when they were generated from Seed
+  unsigned Seed = 0;
+
+  double LoadSeconds = 0;       // Parsing the XML, or mapping the cache
+  double BuildSeconds = 0;      // Graph, pruning and reordering after parsing, 0 for a cache
+  double PreprocessSeconds = 0; // Contraction hierarchy and distance matrix, when used
+
+  int Queries = 0;
+  int Found = 0; // Queries that ended with a meeting point
+  double MeanMicros = 0, P50Micros = 0, P95Micros = 0, P99Micros = 0, MaxMicros = 0;
+  double MeanSettled = 0;
+  long long MaxSettled = 0;
+
+  long long PeakRSSKB = 0; // Peak resident set of the whole process, read after the queries
+};
+
+
+vector<MeetingPointRequest> randomRequests(const vector<BuildingInfo>& Buildings, int count, unsigned seed);
+void runBenchmark(const MeetingPointMap& map, const vector<MeetingPointRequest>& requests, benchmarkReport& report);
+void writeBenchmarkReport(ostream& out, const benchmarkReport& report);
@@ -0,0 +1,565 @@
+// ch.h
+//
+// Contraction Hierarchies over a frozen compactGraph
+// Preprocessing contracts vertices one at a time in order of importance (cheapest first), adding a
+// shortcut edge u --> w whenever removing v would lengthen the shortest u --> w path. Every vertex ends
+// up with a rank, and any shortest path can then be found by a bidirectional search that only ever
+// climbs to higher ranks, which settles a tiny fraction of the graph. Shortcuts remember the vertex
+// they bypass so query paths are unpacked back into original edges.
+//
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "compactgraph.h"
+#include "dheap.h"
+#include "instrument.h"
+#include "arena.h"
+#include "search.h"
+
+#pragma once
+
+using namespace std;
+
+template<typename VertexT, typename WeightT>
+
+class contractionHierarchy {
+  public:
+    static constexpr WeightT INF = numeric_limits<WeightT>::max();
+
+    // queryContext
+    //
+    // The mutable state of one query at a time (search buffers and counters). The hierarchy itself is never
+    // modified by queries, so threads can share one hierarchy as long as each brings its own context.
+    class queryContext {
+      private:
+        friend class contractionHierarchy;
+
+        searchBuffers<WeightT> forward; // Same generation-stamped scheme as searchEngine
+        searchBuffers<WeightT> backward;
+        int settledCount;
+
+      public:
+        queryContext() : settledCount(0) {}
+
+        // Constructor
+        //
+        // Sizes the buffers for queries on CH
+        explicit queryContext(const contractionHierarchy& CH) : settledCount(0) {
+          forward.resize(CH.G->NumVertices());
+          backward.resize(CH.G->NumVertices());
+        }
+
+        // settled
+        //
+        // Returns the # of vertices the last query with this context settled, over both directions
+        int settled() const {
+          return settledCount;
+        }
+    };
+
+  private:
+    struct Arc { // Edge used during preprocessing, middle is the bypassed vertex for shortcuts (-1 otherwise)
+      int to;
+      WeightT weight;
+      int middle;
+    };
+
+    const compactGraph<VertexT, WeightT>* G; // The graph the hierarchy was built from, not owned
+
+    vector<int> ranks; // Dense index --> contraction order, higher rank means more important
+
+    // Upward search graph in CSR form: upOut holds u --> w with rank[w] > rank[u] (searched from the
+    // start), downIn holds u --> w with rank[u] > rank[w] stored at w (searched backwards from the end)
+    vector<int> upOffsets, upTargets, upMiddles;
+    vector<WeightT> upWeights;
+    vector<int> downOffsets, downSources, downMiddles;
+    vector<WeightT> downWeights;
+
+    int shortcutCount;
+
+    queryContext ownContext; // Used by the single-threaded shortestPath overload
+
+    // Preprocessing only -------------------------------------------------------------------------
+
+    vector<vector<Arc>> outArcs; // Remaining arcs while contracting, cleared afterwards
+    vector<vector<Arc>> inArcs; // inArcs[w] holds the arc u --> w as {u, weight, middle}
+    vector<bool> contracted;
+    vector<int> deletedNeighbors; // # of already contracted neighbors, spreads contraction evenly
+
+    searchBuffers<WeightT> witness; // Buffers for the local witness searches
+
+    static const int WITNESS_SETTLE_LIMIT = 500; // Past this many settled vertices a witness search gives up and keeps the shortcut
+
+    // addArc
+    //
+    // Adds or lowers the arc from --> to in the preprocessing adjacency
+    void addArc(int from, int to, WeightT weight, int middle) {
+      for (Arc& arc : outArcs[from]) {
+        if (arc.to == to) {
+          if (weight < arc.weight) {
+            arc.weight = weight;
+            arc.middle = middle;
+
+            for (Arc& reverseArc : inArcs[to]) {
+              if (reverseArc.to == from) {
+                reverseArc.weight = weight;
+                reverseArc.middle = middle;
+              }
+            }
+          }
+
+          return;
+        }
+      }
+
+      outArcs[from].push_back(Arc{to, weight, middle});
+      inArcs[to].push_back(Arc{from, weight, middle});
+    }
+
+    // witnessSearch
+    //
+    // Dijkstra from source over uncontracted vertices, never passing through skipV, up to maxDistance.
+    // Afterwards witness.distanceTo(w) holds the shortest distance found to w (INF if not reached).
+    void witnessSearch(int source, int skipV, WeightT maxDistance) {
+      witness.begin();
+      witness.reach(source, 0, -1);
+      witness.heap.push(source, 0);
+
+      int settledWitnesses = 0;
+      while (!witness.heap.empty() && settledWitnesses < WITNESS_SETTLE_LIMIT) {
+        if (witness.heap.topKey() > maxDistance) {
+          break;
+        }
+
+        int currentV = witness.heap.pop();
+        settledWitnesses++;
+
+        for (const Arc& arc : outArcs[currentV]) {
+          if (arc.to == skipV || contracted[arc.to]) {
+            continue;
+          }
+
+          WeightT altPathDistance = witness.distances[currentV] + arc.weight;
+          if (altPathDistance < witness.distanceTo(arc.to)) {
+            witness.reach(arc.to, altPathDistance, currentV);
+            witness.heap.pushOrDecrease(arc.to, altPathDistance);
+          }
+        }
+      }
+    }
+
+    // contract
+    //
+    // Returns the # of shortcuts needed to remove v from the remaining graph. Unless simulate is true,
+    // the shortcuts are added and v is marked as contracted.
+    int contract(int v, bool simulate) {
+      int shortcuts = 0;
+
+      WeightT maxOut = 0;
+      for (const Arc& out : outArcs[v]) {
+        if (!contracted[out.to] && out.weight > maxOut) {
+          maxOut = out.weight;
+        }
+      }
+
+      for (const Arc& in : inArcs[v]) {
+        int u = in.to;
+
+        if (contracted[u] || u == v) {
+          continue;
+        }
+
+        witnessSearch(u, v, in.weight + maxOut);
+
+        for (const Arc& out : outArcs[v]) {
+          int w = out.to;
+
+          if (contracted[w] || w == u || w == v) {
+            continue;
+          }
+
+          WeightT viaV = in.weight + out.weight;
+          if (witness.distanceTo(w) > viaV) { // No path of at most the same length avoids v, so keep it with a shortcut
+            shortcuts++;
+
+            if (!simulate) {
+              addArc(u, w, viaV, v);
+            }
+          }
+        }
+      }
+
+      if (!simulate) {
+        contracted[v] = true;
+      }
+
+      return shortcuts;
+    }
+
+    // priority
+    //
+    // Importance of v: edge difference (shortcuts added minus arcs removed) plus contracted neighbors
+    int priority(int v) {
+      int removedArcs = 0;
+
+      for (const Arc& out : outArcs[v]) {
+        removedArcs += !contracted[out.to];
+      }
+
+      for (const Arc& in : inArcs[v]) {
+        removedArcs += !contracted[in.to];
+      }
+
+      return contract(v, true) - removedArcs + deletedNeighbors[v];
+    }
+
+    // preprocess
+    //
+    // Contracts every vertex in lazy-updated priority order, or in the order of fixedRanks (by dense index) when
+    // given, and builds the upward CSR graphs
+    void preprocess(const vector<int>* fixedRanks) {
+      int vertexCount = G->NumVertices();
+
+      outArcs.assign(vertexCount, vector<Arc>());
+      inArcs.assign(vertexCount, vector<Arc>());
+      contracted.assign(vertexCount, false);
+      deletedNeighbors.assign(vertexCount, 0);
+      witness.resize(vertexCount);
+
+      for (int u = 0; u < vertexCount; u++) {
+        for (int e = G->edgeBegin(u); e < G->edgeEnd(u); e++) {
+          if (G->target(e) != u) { // Self loops never lie on a shortest path
+            addArc(u, G->target(e), G->weight(e), -1);
+          }
+        }
+      }
+
+      vector<Arc> upArcsByVertex, downArcsByVertex; // Flattened arcs in contraction order, split below
+      vector<int> upOwner, downOwner;
+      ranks.assign(vertexCount, 0);
+
+      // Records the arcs v keeps once contracted: every remaining neighbor is contracted later, so has a higher rank
+      auto keepArcs = [&](int v) {
+        for (const Arc& out : outArcs[v]) {
+          if (!contracted[out.to]) {
+            upOwner.push_back(v);
+            upArcsByVertex.push_back(out);
+          }
+        }
+
+        for (const Arc& in : inArcs[v]) {
+          if (!contracted[in.to]) {
+            downOwner.push_back(v);
+            downArcsByVertex.push_back(in);
+          }
+        }
+      };
+
+      if (fixedRanks != nullptr) { // No priorities to simulate, which is most of the work
+        vector<int> byRank(vertexCount);
+
+        for (int v = 0; v < vertexCount; v++) {
+          byRank[(*fixedRanks)[v]] = v;
+        }
+
+        for (int v : byRank) {
+          contract(v, false);
+          keepArcs(v);
+        }
+
+        ranks = *fixedRanks;
+      }
+      else {
+        indexedHeap<int> order(vertexCount);
+        for (int v = 0; v < vertexCount; v++) {
+          order.push(v, priority(v));
+        }
+
+        int nextRank = 0;
+        while (!order.empty()) {
+          int v = order.pop();
+          int current = priority(v);
+
+          if (!order.empty() && current > order.topKey()) { // Priority went stale, put it back and retry
+            order.push(v, current);
+            continue;
+          }
+
+          contract(v, false);
+          ranks[v] = nextRank++;
+          keepArcs(v);
+
+          // Neighbors' priorities changed. Lowered ones are refreshed now, raised ones are caught by the stale check above.
+          for (const Arc& out : outArcs[v]) {
+            if (!contracted[out.to]) {
+              deletedNeighbors[out.to]++;
+              order.pushOrDecrease(out.to, priority(out.to));
+            }
+          }
+
+          for (const Arc& in : inArcs[v]) {
+            if (!contracted[in.to]) {
+              deletedNeighbors[in.to]++;
+              order.pushOrDecrease(in.to, priority(in.to));
+            }
+          }
+        }
+      }
+
+      buildCSR(upOwner, upArcsByVertex, upOffsets, upTargets, upWeights, upMiddles);
+      buildCSR(downOwner, downArcsByVertex, downOffsets, downSources, downWeights, downMiddles);
+
+      outArcs.clear();
+      outArcs.shrink_to_fit();
+      inArcs.clear();
+      inArcs.shrink_to_fit();
+      contracted.clear();
+      deletedNeighbors.clear();
+      witness = searchBuffers<WeightT>();
+    }
+
+    // buildCSR
+    //
+    // Groups arcs by owner vertex into offsets plus contiguous arrays
+    void buildCSR(const vector<int>& owner, const vector<Arc>& arcs, vector<int>& offsets, vector<int>& ends,
+      vector<WeightT>& weights, vector<int>& middles) {
+      int vertexCount = G->NumVertices();
+
+      offsets.assign(vertexCount + 1, 0);
+      for (int v : owner) {
+        offsets[v + 1]++;
+      }
+
+      for (int v = 0; v < vertexCount; v++) {
+        offsets[v + 1] += offsets[v];
+      }
+
+      ends.resize(arcs.size());
+      weights.resize(arcs.size());
+      middles.resize(arcs.size());
+
+      vector<int> fill(offsets.begin(), offsets.end() - 1);
+      for (size_t i = 0; i < arcs.size(); i++) {
+        int slot = fill[owner[i]]++;
+
+        ends[slot] = arcs[i].to;
+        weights[slot] = arcs[i].weight;
+        middles[slot] = arcs[i].middle;
+      }
+    }
+
+    // finish
+    //
+    // Counts the shortcuts and sizes the hierarchy's own query context, once preprocessing is done
+    void finish() {
+      shortcutCount = 0;
+      for (int m : upMiddles) {
+        shortcutCount += m != -1;
+      }
+
+      for (int m : downMiddles) {
+        shortcutCount += m != -1;
+      }
+
+      ownContext = queryContext(*this);
+    }
+
+    // Queries ------------------------------------------------------------------------------------
+
+    // unpackArc
+    //
+    // Appends the original vertices of the arc u --> w (excluding u, including w) to out, expanding
+    // shortcuts through their middle vertex
+    void unpackArc(int u, int w, int middle, pmr::vector<int>& out) const {
+      if (middle == -1) {
+        out.push_back(w);
+        return;
+      }
+
+      // u --> middle goes down in rank, so it is stored at middle in the down graph
+      for (int e = downOffsets[middle]; e < downOffsets[middle + 1]; e++) {
+        if (downSources[e] == u) {
+          unpackArc(u, middle, downMiddles[e], out);
+          break;
+        }
+      }
+
+      // middle --> w goes up in rank, so it is stored at middle in the up graph
+      for (int e = upOffsets[middle]; e < upOffsets[middle + 1]; e++) {
+        if (upTargets[e] == w) {
+          unpackArc(middle, w, upMiddles[e], out);
+          break;
+        }
+      }
+    }
+
+    // middleOf
+    //
+    // Returns the middle of the hierarchy arc u --> w, looking in the up graph when goingUp
+    int middleOf(int u, int w, bool goingUp) const {
+      if (goingUp) {
+        for (int e = upOffsets[u]; e < upOffsets[u + 1]; e++) {
+          if (upTargets[e] == w) {
+            return upMiddles[e];
+          }
+        }
+      }
+      else {
+        for (int e = downOffsets[w]; e < downOffsets[w + 1]; e++) {
+          if (downSources[e] == u) {
+            return downMiddles[e];
+          }
+        }
+      }
+
+      return -1;
+    }
+
+  public:
+
+    // Constructor
+    //
+    // Runs the one-time preprocessing for G. G must outlive the hierarchy.
+    explicit contractionHierarchy(const compactGraph<VertexT, WeightT>& G) : G(&G) {
+      preprocess(nullptr);
+      finish();
+    }
+
+    // Constructor
+    //
+    // Rebuilds the hierarchy for G, a variant of ordered's graph with the same vertices (e.g. from compactGraph::adjusted),
+    // by contracting in ordered's vertex order instead of working one out. Shortcuts and their witness searches are redone
+    // for G's weights, so queries stay exact however the weights changed; only the order, tuned for the old weights, may
+    // make the hierarchy a little larger. G must outlive the hierarchy.
+    contractionHierarchy(const compactGraph<VertexT, WeightT>& G, const contractionHierarchy& ordered) : G(&G) {
+      preprocess(&ordered.ranks);
+      finish();
+    }
+
+    // NumShortcuts
+    //
+    // Returns the # of shortcut arcs the preprocessing added
+    int NumShortcuts() const {
+      return shortcutCount;
+    }
+
+    // settled
+    //
+    // Returns the # of vertices the last query settled, over both directions (single-threaded overload only)
+    int settled() const {
+      return ownContext.settledCount;
+    }
+
+    // shortestPath
+    //
+    // Finds the shortest path from startV to endV with a bidirectional upward search. The path is recorded
+    // in the path vector from endV back to startV, and the distance of the path is returned, or -1 if endV
+    // cannot be reached (path is left untouched in that case). Uses the hierarchy's own query context, so
+    // only one thread may call this overload at a time.
+    double shortestPath(const VertexT& startV, const VertexT& endV, vector<VertexT>& path) {
+      return shortestPath(ownContext, startV, endV, path);
+    }
+
+    // shortestPath
+    //
+    // Same as above with the caller's query context, safe to call from several threads at once as long as
+    // each passes a different context
+    double shortestPath(queryContext& context, const VertexT& startV, const VertexT& endV, vector<VertexT>& path) const {
+      searchBuffers<WeightT>& forward = context.forward;
+      searchBuffers<WeightT>& backward = context.backward;
+      int& settledCount = context.settledCount;
+
+      int startIndex = G->indexOf(startV);
+      int endIndex = G->indexOf(endV);
+
+      if (startIndex == -1 || endIndex == -1) {
+        return -1;
+      }
+
+      forward.begin();
+      backward.begin();
+      settledCount = 0;
+
+      forward.reach(startIndex, 0, -1);
+      forward.heap.push(startIndex, 0);
+      backward.reach(endIndex, 0, -1);
+      backward.heap.push(endIndex, 0);
+
+      WeightT best = INF;
+      int meetV = -1;
+
+      while (!forward.heap.empty() || !backward.heap.empty()) {
+        // Each side stops on its own once its smallest key can no longer beat the best meeting
+        bool forwardDone = forward.heap.empty() || forward.heap.topKey() >= best;
+        bool backwardDone = backward.heap.empty() || backward.heap.topKey() >= best;
+
+        if (forwardDone && backwardDone) {
+          break;
+        }
+
+        bool goForward = !forwardDone && (backwardDone || forward.heap.topKey() <= backward.heap.topKey());
+        searchBuffers<WeightT>& side = goForward ? forward : backward;
+        const searchBuffers<WeightT>& other = goForward ? backward : forward;
+        const vector<int>& offsets = goForward ? upOffsets : downOffsets;
+        const vector<int>& ends = goForward ? upTargets : downSources;
+        const vector<WeightT>& weights = goForward ? upWeights : downWeights;
+
+        int currentV = side.heap.pop();
+        settledCount++;
+        profileCount(profileCounter::SETTLED);
+
+        WeightT currentDistance = side.distances[currentV];
+        WeightT otherDistance = other.distanceTo(currentV);
+
+        if (otherDistance != INF && currentDistance + otherDistance < best) { // The searches meet at currentV
+          best = currentDistance + otherDistance;
+          meetV = currentV;
+        }
+
+        for (int e = offsets[currentV]; e < offsets[currentV + 1]; e++) {
+          int adjV = ends[e];
+          WeightT altPathDistance = currentDistance + weights[e];
+          profileCount(profileCounter::RELAXED);
+
+          if (altPathDistance < side.distanceTo(adjV)) {
+            side.reach(adjV, altPathDistance, currentV);
+            side.heap.pushOrDecrease(adjV, altPathDistance);
+            profileCount(profileCounter::HEAP_PUSHES);
+          }
+        }
+      }
+
+      if (meetV == -1) {
+        return -1;
+      }
+
+      // Hierarchy path startV --> meetV --> endV, then unpack every arc into original vertices. The scratch
+      // vectors come from the thread's query arena, which is released when the query returns.
+      queryArena::scope scratch;
+      pmr::vector<int> upPath(scratch.resource());
+      for (int v = meetV; v != -1; v = forward.predecessors[v]) {
+        upPath.push_back(v);
+      }
+      reverse(upPath.begin(), upPath.end());
+
+      pmr::vector<int> fullPath(scratch.resource());
+      fullPath.push_back(startIndex);
+
+      for (size_t i = 0; i + 1 < upPath.size(); i++) {
+        unpackArc(upPath[i], upPath[i + 1], middleOf(upPath[i], upPath[i + 1], true), fullPath);
+      }
+
+      for (int v = meetV; backward.predecessors[v] != -1; v = backward.predecessors[v]) {
+        int next = backward.predecessors[v];
+        unpackArc(v, next, middleOf(v, next, false), fullPath);
+      }
+
+      for (auto it = fullPath.rbegin(); it != fullPath.rend(); it++) {
+        path.push_back(G->vertexAt(*it));
+      }
+
+      return best;
+    }
+};
@@ -0,0 +1,753 @@
+// compactgraph.h
+//
+// Read-only compressed sparse row (CSR) form of graph<VertexT, WeightT>
+// Vertices are remapped to dense indices 0..N-1, and the edges of vertex i live in [offsets[i], offsets[i + 1])
+// of the contiguous targets/weights arrays, so searches can walk adjacency without any hashing
+// The arrays are either owned by the graph or borrowed from elsewhere (e.g. a memory-mapped map cache, mapcache.h)
+// A graph made by collapseChains() also records, per edge, the original vertices the edge passes through
+// A graph made by toFixedWeights() stores its weights as 32-bit fixed point instead of WeightT
+// adjusted() derives a copy with some edges removed and others made heavier, e.g. for footway closures (overlay.h)
+//
+
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <span>
+#include <cmath>
+#include <cstdint>
+
+#include "graph.h"
+
+#pragma once
+
+using namespace std;
+
+template<typename VertexT, typename WeightT>
+
+class compactGraph {
+  public:
+    static constexpr int FIXED_WEIGHT_BITS = 24; // Fixed point weights count units of 2^-24 (of a mile for the footway graph)
+
+  private:
+    vector<VertexT> vertexStore; // Owned storage behind the views below, empty when the arrays are borrowed
+    vector<int> orderStore;
+    vector<int> offsetStore;
+    vector<int> targetStore;
+    vector<WeightT> weightStore;
+    vector<uint32_t> fixedWeightStore;
+    vector<int> componentStore;
+    vector<int> viaOffsetStore;
+    vector<VertexT> viaStore;
+    bool ownsStorage;
+
+    span<const VertexT> Vertices; // Dense index --> original vertex
+    span<const int> order; // Dense indices sorted by vertex, binary searched to map original vertex --> dense index
+
+    span<const int> offsets; // Size NumVertices() + 1, edges of vertex i are [offsets[i], offsets[i + 1])
+    span<const int> targets; // Dense index of the vertex each edge maps to
+    span<const WeightT> weights; // Weight of each edge, parallel to targets, empty when fixedWeights holds them
+    span<const uint32_t> fixedWeights; // Empty, or the weight of each edge in fixed point units, see fixedToWeight()
+
+    span<const int> components; // Dense index --> connected component id 0..NumComponents()-1, edges taken as undirected
+    int componentCount;
+
+    span<const int> viaOffsets; // Empty, or size NumEdges() + 1: edge e passes through via[viaOffsets[e] .. viaOffsets[e + 1])
+    span<const VertexT> via; // Original vertices collapsed into edges, in order from the edge's source to its target
+
+    // bindStorage
+    //
+    // Points the views at the owned storage, needed whenever the storage was built or copied
+    void bindStorage() {
+      ownsStorage = true;
+      Vertices = vertexStore;
+      order = orderStore;
+      offsets = offsetStore;
+      targets = targetStore;
+      weights = weightStore;
+      fixedWeights = fixedWeightStore;
+      components = componentStore;
+      viaOffsets = viaOffsetStore;
+      via = viaStore;
+    }
+
+    // copyFrom
+    //
+    // Copies other, rebinding to our own copy of its storage if it owns it and sharing its borrowed arrays otherwise
+    void copyFrom(const compactGraph& other) {
+      vertexStore = other.vertexStore;
+      orderStore = other.orderStore;
+      offsetStore = other.offsetStore;
+      targetStore = other.targetStore;
+      weightStore = other.weightStore;
+      fixedWeightStore = other.fixedWeightStore;
+      componentStore = other.componentStore;
+      viaOffsetStore = other.viaOffsetStore;
+      viaStore = other.viaStore;
+      componentCount = other.componentCount;
+
+      if (other.ownsStorage) {
+        bindStorage();
+        return;
+      }
+
+      ownsStorage = false;
+      Vertices = other.Vertices;
+      order = other.order;
+      offsets = other.offsets;
+      targets = other.targets;
+      weights = other.weights;
+      fixedWeights = other.fixedWeights;
+      components = other.components;
+      viaOffsets = other.viaOffsets;
+      via = other.via;
+    }
+
+    // labelComponents
+    //
+    // Union-find over every edge, then renumbers the roots densely in order of first appearance
+    void labelComponents() {
+      vector<int> parent(vertexStore.size());
+
+      for (size_t i = 0; i < parent.size(); i++) {
+        parent[i] = static_cast<int>(i);
+      }
+
+      auto find = [&](int v) {
+        while (parent[v] != v) {
+          parent[v] = parent[parent[v]]; // Path halving keeps the trees flat
+          v = parent[v];
+        }
+
+        return v;
+      };
+
+      for (int u = 0; u < static_cast<int>(vertexStore.size()); u++) {
+        for (int e = offsetStore[u]; e < offsetStore[u + 1]; e++) {
+          int rootU = find(u);
+          int rootV = find(targetStore[e]);
+
+          if (rootU != rootV) {
+            parent[max(rootU, rootV)] = min(rootU, rootV);
+          }
+        }
+      }
+
+      componentStore.assign(vertexStore.size(), -1);
+      componentCount = 0;
+
+      vector<int> label(vertexStore.size(), -1); // Root --> dense component id
+      for (int v = 0; v < static_cast<int>(vertexStore.size()); v++) {
+        int root = find(v);
+
+        if (label[root] == -1) {
+          label[root] = componentCount++;
+        }
+
+        componentStore[v] = label[root];
+      }
+    }
+
+  public:
+
+    // Constructor
+    //
+    // Builds an empty compact graph
+    compactGraph() {
+      offsetStore.push_back(0);
+      componentCount = 0;
+      bindStorage();
+    }
+
+    // Constructor
+    //
+    // Freezes G into CSR form. Dense indices follow the order of G.getVertices(), and
+    // each vertex's edges are stored in the order G.edges() yields them (insertion order)
+    template<template<typename> class AllocatorT>
+    explicit compactGraph(const graph<VertexT, WeightT, AllocatorT>& G) {
+      vertexStore = G.getVertices();
+
+      orderStore.resize(vertexStore.size());
+      for (int i = 0; i < static_cast<int>(orderStore.size()); i++) {
+        orderStore[i] = i;
+      }
+
+      sort(orderStore.begin(), orderStore.end(), [&](int a, int b) {
+        return vertexStore[a] < vertexStore[b];
+      });
+
+      offsetStore.reserve(vertexStore.size() + 1);
+      targetStore.reserve(G.NumEdges());
+      weightStore.reserve(G.NumEdges());
+
+      bindStorage(); // indexOf below searches the vertex views
+
+      offsetStore.push_back(0);
+      for (const VertexT& v : vertexStore) {
+        for (const auto& edge : G.edges(v)) {
+          targetStore.push_back(indexOf(edge.toVert));
+          weightStore.push_back(edge.toWeight);
+        }
+
+        offsetStore.push_back(static_cast<int>(targetStore.size()));
+      }
+
+      labelComponents();
+      bindStorage();
+    }
+
+    // Constructor
+    //
+    // Wraps CSR arrays owned by someone else without copying them, laid out the way getVertices/getOrder/
+    // getOffsets/getTargets/getWeights/getComponents/getViaOffsets/getVia/getFixedWeights return them (the last
+    // three may be empty; edgeWeights is empty instead when edgeFixedWeights holds the weights).
+    // The arrays must outlive the graph and its copies.
+    compactGraph(span<const VertexT> vertices, span<const int> vertexOrder, span<const int> edgeOffsets,
+      span<const int> edgeTargets, span<const WeightT> edgeWeights, span<const int> vertexComponents, int numComponents,
+      span<const int> edgeViaOffsets = {}, span<const VertexT> edgeVia = {}, span<const uint32_t> edgeFixedWeights = {}) {
+      ownsStorage = false;
+      Vertices = vertices;
+      order = vertexOrder;
+      offsets = edgeOffsets;
+      targets = edgeTargets;
+      weights = edgeWeights;
+      fixedWeights = edgeFixedWeights;
+      components = vertexComponents;
+      componentCount = numComponents;
+      viaOffsets = edgeViaOffsets;
+      via = edgeVia;
+    }
+
+    compactGraph(const compactGraph& other) {
+      copyFrom(other);
+    }
+
+    compactGraph& operator=(const compactGraph& other) {
+      if (this != &other) {
+        copyFrom(other);
+      }
+
+      return *this;
+    }
+
+    compactGraph(compactGraph&&) = default; // Moving a vector keeps its buffer, so the views stay valid
+    compactGraph& operator=(compactGraph&&) = default;
+
+    // NumVertices
+    //
+    // Returns the # of vertices in the graph.
+    int NumVertices() const {
+      return static_cast<int>(Vertices.size());
+    }
+
+    // NumEdges
+    //
+    // Returns the # of edges in the graph.
+    int NumEdges() const {
+      return static_cast<int>(targets.size());
+    }
+
+    // indexOf
+    //
+    // Returns the dense index of vertex v, or -1 if v is not in the graph
+    int indexOf(const VertexT& v) const {
+      auto it = lower_bound(order.begin(), order.end(), v, [&](int i, const VertexT& key) {
+        return Vertices[i] < key;
+      });
+
+      if (it == order.end() || Vertices[*it] != v) {
+        return -1;
+      }
+
+      return *it;
+    }
+
+    // vertexAt
+    //
+    // Returns the original vertex stored at dense index i
+    const VertexT& vertexAt(int i) const {
+      return Vertices[i];
+    }
+
+    // edgeBegin / edgeEnd
+    //
+    // The edges of dense vertex i are the edge indices e with edgeBegin(i) <= e < edgeEnd(i)
+    int edgeBegin(int i) const {
+      return offsets[i];
+    }
+
+    int edgeEnd(int i) const {
+      return offsets[i + 1];
+    }
+
+    // target / weight
+    //
+    // Returns the dense index the edge e maps to, and the weight of edge e
+    int target(int e) const {
+      return targets[e];
+    }
+
+    WeightT weight(int e) const {
+      return fixedWeights.empty() ? weights[e] : fixedToWeight(fixedWeights[e]);
+    }
+
+    // forEachEdge
+    //
+    // Calls fn(target, weight) for every edge leaving dense vertex i
+    template<typename Fn>
+    void forEachEdge(int i, Fn fn) const {
+      for (int e = offsets[i]; e < offsets[i + 1]; e++) {
+        fn(targets[e], weight(e));
+      }
+    }
+
+    // hasFixedWeights / fixedWeight
+    //
+    // Whether the weights are stored in fixed point, and the weight of edge e in fixed point units if they are
+    bool hasFixedWeights() const {
+      return !fixedWeights.empty();
+    }
+
+    uint32_t fixedWeight(int e) const {
+      return fixedWeights[e];
+    }
+
+    // fixedToWeight
+    //
+    // Converts fixed point units to a weight. Sums of converted weights are exact in a double (53 bits) until they
+    // pass 2^29 units of weight, so searching with them gives the same answer as summing the integers.
+    static WeightT fixedToWeight(unsigned long long units) {
+      return static_cast<WeightT>(ldexp(static_cast<double>(units), -FIXED_WEIGHT_BITS));
+    }
+
+    // NumComponents
+    //
+    // Returns the # of connected components (isolated vertices count as their own component)
+    int NumComponents() const {
+      return componentCount;
+    }
+
+    // componentOf
+    //
+    // Returns the component id of dense vertex i
+    int componentOf(int i) const {
+      return components[i];
+    }
+
+    // connected
+    //
+    // Returns true if u and v are in the same component. When false, no path exists between them in either
+    // direction, so callers can reject the pair without searching. Vertices not in the graph are never connected.
+    bool connected(const VertexT& u, const VertexT& v) const {
+      int uIndex = indexOf(u);
+      int vIndex = indexOf(v);
+
+      return uIndex != -1 && vIndex != -1 && components[uIndex] == components[vIndex];
+    }
+
+    // getVertices
+    //
+    // Returns the vertices in dense index order
+    span<const VertexT> getVertices() const {
+      return Vertices;
+    }
+
+    // getOrder / getOffsets / getTargets / getWeights / getComponents
+    //
+    // The raw arrays behind the graph, e.g. for writing it out to a map cache
+    span<const int> getOrder() const {
+      return order;
+    }
+
+    span<const int> getOffsets() const {
+      return offsets;
+    }
+
+    span<const int> getTargets() const {
+      return targets;
+    }
+
+    span<const WeightT> getWeights() const {
+      return weights;
+    }
+
+    span<const uint32_t> getFixedWeights() const {
+      return fixedWeights;
+    }
+
+    span<const int> getComponents() const {
+      return components;
+    }
+
+    span<const int> getViaOffsets() const {
+      return viaOffsets;
+    }
+
+    span<const VertexT> getVia() const {
+      return via;
+    }
+
+    // bfsOrder
+    //
+    // Returns the dense indices in breadth-first order: a search from the lowest index not visited yet, repeated until
+    // every vertex is listed, with neighbors in edge order. Neighbors then tend to sit close together, see permuted().
+    vector<int> bfsOrder() const {
+      int n = NumVertices();
+      vector<int> visitOrder;
+      vector<bool> visited(n, false);
+
+      visitOrder.reserve(n);
+
+      for (int root = 0; root < n; root++) {
+        if (visited[root]) {
+          continue;
+        }
+
+        visited[root] = true;
+        visitOrder.push_back(root);
+
+        for (size_t next = visitOrder.size() - 1; next < visitOrder.size(); next++) { // visitOrder doubles as the queue
+          int u = visitOrder[next];
+
+          for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+            if (!visited[targets[e]]) {
+              visited[targets[e]] = true;
+              visitOrder.push_back(targets[e]);
+            }
+          }
+        }
+      }
+
+      return visitOrder;
+    }
+
+    // permuted
+    //
+    // Returns a copy of the graph with the dense indices renumbered: newOrder lists every dense index once, and newOrder[i]
+    // becomes dense index i. Vertices, edges (in the same order per vertex), weights, geometry and components stay the
+    // same, so searches give the same answers; only the memory layout of the per-vertex arrays changes.
+    compactGraph permuted(span<const int> newOrder) const {
+      int n = NumVertices();
+      vector<int> newIndex(n, -1);
+
+      for (int i = 0; i < n; i++) {
+        newIndex[newOrder[i]] = i;
+      }
+
+      compactGraph renumbered;
+      renumbered.offsetStore.clear();
+      renumbered.offsetStore.reserve(n + 1);
+      renumbered.offsetStore.push_back(0);
+
+      if (!viaOffsets.empty()) {
+        renumbered.viaOffsetStore.push_back(0);
+      }
+
+      for (int i = 0; i < n; i++) {
+        int u = newOrder[i];
+
+        renumbered.vertexStore.push_back(Vertices[u]);
+        renumbered.componentStore.push_back(components[u]);
+
+        for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+          renumbered.targetStore.push_back(newIndex[targets[e]]);
+
+          if (fixedWeights.empty()) {
+            renumbered.weightStore.push_back(weights[e]);
+          }
+          else {
+            renumbered.fixedWeightStore.push_back(fixedWeights[e]);
+          }
+
+          if (!viaOffsets.empty()) {
+            renumbered.viaStore.insert(renumbered.viaStore.end(), via.begin() + viaOffsets[e], via.begin() + viaOffsets[e + 1]);
+            renumbered.viaOffsetStore.push_back(static_cast<int>(renumbered.viaStore.size()));
+          }
+        }
+
+        renumbered.offsetStore.push_back(static_cast<int>(renumbered.targetStore.size()));
+      }
+
+      for (int k = 0; k < n; k++) { // Still sorted by vertex, only the indices the entries name have changed
+        renumbered.orderStore.push_back(newIndex[order[k]]);
+      }
+
+      renumbered.componentCount = componentCount;
+      renumbered.bindStorage();
+
+      return renumbered;
+    }
+
+    // toFixedWeights
+    //
+    // Returns a copy of the graph that stores each weight as a 32-bit count of 2^-FIXED_WEIGHT_BITS units instead of a
+    // WeightT, rounded up so no weight shrinks (a great-circle lower bound stays one, which A* relies on). weight()
+    // converts back, so every search works on the copy unchanged. Throws out_of_range for a negative weight or one of
+    // 2^(32 - FIXED_WEIGHT_BITS) or more (256 miles).
+    compactGraph toFixedWeights() const {
+      compactGraph fixed;
+
+      fixed.vertexStore.assign(Vertices.begin(), Vertices.end());
+      fixed.orderStore.assign(order.begin(), order.end());
+      fixed.offsetStore.assign(offsets.begin(), offsets.end());
+      fixed.targetStore.assign(targets.begin(), targets.end());
+      fixed.componentStore.assign(components.begin(), components.end());
+      fixed.viaOffsetStore.assign(viaOffsets.begin(), viaOffsets.end());
+      fixed.viaStore.assign(via.begin(), via.end());
+      fixed.componentCount = componentCount;
+
+      fixed.fixedWeightStore.reserve(targets.size());
+
+      for (int e = 0; e < NumEdges(); e++) {
+        double units = ceil(ldexp(static_cast<double>(weight(e)), FIXED_WEIGHT_BITS));
+
+        if (!(units >= 0 && units <= static_cast<double>(UINT32_MAX))) {
+          throw out_of_range("compactGraph::toFixedWeights: edge weight out of fixed point range");
+        }
+
+        fixed.fixedWeightStore.push_back(static_cast<uint32_t>(units));
+      }
+
+      fixed.bindStorage();
+      return fixed;
+    }
+
+    // adjusted
+    //
+    // Returns a copy of the graph without the edges whose dropEdge entry is non-zero, and with addWeight added to the
+    // weight of every other edge (both indexed by edge). Vertices keep their dense indices, so anything kept per
+    // vertex (coordinates, snapped buildings, a hierarchy's ranks) still applies to the copy. Components are only
+    // relabeled when edges were dropped, since heavier edges can't split one. Fixed point weights stay fixed point,
+    // with the added weight rounded up as in toFixedWeights(), and the same out_of_range past the fixed point range.
+    compactGraph adjusted(span<const char> dropEdge, span<const WeightT> addWeight) const {
+      int n = NumVertices();
+      bool dropped = false;
+
+      compactGraph changed;
+      changed.vertexStore.assign(Vertices.begin(), Vertices.end());
+      changed.orderStore.assign(order.begin(), order.end());
+      changed.offsetStore.clear();
+      changed.offsetStore.reserve(n + 1);
+      changed.offsetStore.push_back(0);
+
+      if (!viaOffsets.empty()) {
+        changed.viaOffsetStore.push_back(0);
+      }
+
+      for (int u = 0; u < n; u++) {
+        for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+          if (dropEdge[e]) {
+            dropped = true;
+            continue;
+          }
+
+          changed.targetStore.push_back(targets[e]);
+
+          if (fixedWeights.empty()) {
+            changed.weightStore.push_back(weights[e] + addWeight[e]);
+          }
+          else {
+            double units = fixedWeights[e] + ceil(ldexp(static_cast<double>(addWeight[e]), FIXED_WEIGHT_BITS));
+
+            if (!(units >= 0 && units <= static_cast<double>(UINT32_MAX))) {
+              throw out_of_range("compactGraph::adjusted: edge weight out of fixed point range");
+            }
+
+            changed.fixedWeightStore.push_back(static_cast<uint32_t>(units));
+          }
+
+          if (!viaOffsets.empty()) {
+            changed.viaStore.insert(changed.viaStore.end(), via.begin() + viaOffsets[e], via.begin() + viaOffsets[e + 1]);
+            changed.viaOffsetStore.push_back(static_cast<int>(changed.viaStore.size()));
+          }
+        }
+
+        changed.offsetStore.push_back(static_cast<int>(changed.targetStore.size()));
+      }
+
+      if (dropped) {
+        changed.labelComponents();
+      }
+      else {
+        changed.componentStore.assign(components.begin(), components.end());
+        changed.componentCount = componentCount;
+      }
+
+      changed.bindStorage();
+      return changed;
+    }
+
+    // collapseChains
+    //
+    // Returns a smaller copy of the graph where every chain of pass-through vertices becomes one edge. A vertex
+    // is passed through if it is not in keep and it has exactly two neighbors, each linked to it both ways with
+    // the same weight (an undirected degree-2 point along a footway). Each chain u --> ... --> v turns into one
+    // edge u --> v weighing the sum of its edges and remembering the vertices in between, see expandPath().
+    // Only the cheapest edge between two vertices is kept, and chains that loop back to where they started are
+    // dropped. Vertices only reachable through pass-through vertices (rings with nothing to keep) are dropped.
+    compactGraph collapseChains(span<const VertexT> keep) const {
+      int n = NumVertices();
+      vector<bool> passThrough(n, false);
+
+      auto weightBetween = [&](int u, int v, WeightT& w) { // The single u --> v edge, false if there are none or several
+        int found = 0;
+
+        for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+          if (targets[e] == v) {
+            w = weight(e);
+            found++;
+          }
+        }
+
+        return found == 1;
+      };
+
+      for (int v = 0; v < n; v++) {
+        if (offsets[v + 1] - offsets[v] != 2 || targets[offsets[v]] == targets[offsets[v] + 1]
+          || targets[offsets[v]] == v || targets[offsets[v] + 1] == v) {
+          continue;
+        }
+
+        bool symmetric = true;
+
+        for (int e = offsets[v]; e < offsets[v + 1]; e++) {
+          WeightT back;
+          symmetric = symmetric && weightBetween(targets[e], v, back) && back == weight(e);
+        }
+
+        passThrough[v] = symmetric;
+      }
+
+      for (const VertexT& k : keep) {
+        int i = indexOf(k);
+
+        if (i != -1) {
+          passThrough[i] = false;
+        }
+      }
+
+      compactGraph collapsed;
+      vector<int> newIndex(n, -1);
+
+      for (int v = 0; v < n; v++) {
+        if (!passThrough[v]) {
+          newIndex[v] = static_cast<int>(collapsed.vertexStore.size());
+          collapsed.vertexStore.push_back(Vertices[v]);
+        }
+      }
+
+      collapsed.offsetStore.assign(1, 0);
+      collapsed.viaOffsetStore.assign(1, 0);
+
+      vector<int> chainTarget; // Edges of the vertex being processed, before keeping the cheapest per target
+      vector<WeightT> chainWeight;
+      vector<vector<VertexT>> chainVia;
+
+      for (int u = 0; u < n; u++) {
+        if (passThrough[u]) {
+          continue;
+        }
+
+        chainTarget.clear();
+        chainWeight.clear();
+        chainVia.clear();
+
+        for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+          int prev = u;
+          int cur = targets[e];
+          WeightT total = weight(e);
+          vector<VertexT> between;
+
+          while (passThrough[cur]) { // Walk the chain until it reaches a vertex that stays
+            int next = (targets[offsets[cur]] == prev) ? targets[offsets[cur] + 1] : targets[offsets[cur]];
+            int step = (targets[offsets[cur]] == prev) ? offsets[cur] + 1 : offsets[cur];
+
+            between.push_back(Vertices[cur]);
+            total = total + weight(step);
+            prev = cur;
+            cur = next;
+          }
+
+          if (cur == u) { // A loop back to u never shortens a path
+            continue;
+          }
+
+          size_t existing = find(chainTarget.begin(), chainTarget.end(), cur) - chainTarget.begin();
+
+          if (existing == chainTarget.size()) {
+            chainTarget.push_back(cur);
+            chainWeight.push_back(total);
+            chainVia.push_back(between);
+          }
+          else if (total < chainWeight[existing]) {
+            chainWeight[existing] = total;
+            chainVia[existing] = between;
+          }
+        }
+
+        for (size_t c = 0; c < chainTarget.size(); c++) {
+          collapsed.targetStore.push_back(newIndex[chainTarget[c]]);
+          collapsed.weightStore.push_back(chainWeight[c]);
+          collapsed.viaStore.insert(collapsed.viaStore.end(), chainVia[c].begin(), chainVia[c].end());
+          collapsed.viaOffsetStore.push_back(static_cast<int>(collapsed.viaStore.size()));
+        }
+
+        collapsed.offsetStore.push_back(static_cast<int>(collapsed.targetStore.size()));
+      }
+
+      collapsed.orderStore.resize(collapsed.vertexStore.size());
+      for (int i = 0; i < static_cast<int>(collapsed.orderStore.size()); i++) {
+        collapsed.orderStore[i] = i;
+      }
+
+      sort(collapsed.orderStore.begin(), collapsed.orderStore.end(), [&](int a, int b) {
+        return collapsed.vertexStore[a] < collapsed.vertexStore[b];
+      });
+
+      collapsed.labelComponents();
+      collapsed.bindStorage();
+
+      return collapsed;
+    }
+
+    // expandPath
+    //
+    // Puts the vertices collapsed into edges back into a path found on this graph, so it lists every original
+    // vertex along the way. path is in the order the searches record it (endV first, startV last). Does
+    // nothing on a graph that was not made by collapseChains().
+    void expandPath(vector<VertexT>& path) const {
+      if (viaOffsets.empty() || path.size() < 2) {
+        return;
+      }
+
+      vector<VertexT> expanded;
+      expanded.push_back(path[0]);
+
+      for (size_t i = 0; i + 1 < path.size(); i++) {
+        int from = indexOf(path[i + 1]); // The path was walked from path[i + 1] to path[i]
+        int to = indexOf(path[i]);
+        int cheapest = -1;
+
+        for (int e = offsets[from]; e < offsets[from + 1]; e++) {
+          if (targets[e] == to && (cheapest == -1 || weight(e) < weight(cheapest))) {
+            cheapest = e;
+          }
+        }
+
+        for (int k = viaOffsets[cheapest + 1] - 1; k >= viaOffsets[cheapest]; k--) {
+          expanded.push_back(via[k]);
+        }
+
+        expanded.push_back(path[i + 1]);
+      }
+
+      path.swap(expanded);
+    }
+};
+
+// freeze
+//
+// Returns the read-only CSR form of G. G is not modified and can be discarded afterwards.
+template<typename VertexT, typename WeightT, template<typename> class AllocatorT>
+compactGraph<VertexT, WeightT> freeze(const graph<VertexT, WeightT, AllocatorT>& G) {
+  return compactGraph<VertexT, WeightT>(G);
+}
@@ -0,0 +1,193 @@
+// dheap.h
+//
+// Indexed d-ary min-heap over dense item ids 0..N-1 (4-ary by default) with decrease-key
+// Each item's position in the heap is tracked so a key can be lowered in place instead of pushing duplicates
+//
+
+#include <vector>
+#include <utility>
+
+#pragma once
+
+using namespace std;
+
+template<typename KeyT, int D = 4>
+
+class indexedHeap {
+  private:
+    struct HeapEntry { // Keys live next to their items so sift loops stay in one array
+      KeyT key;
+      int item;
+    };
+
+    vector<HeapEntry> heap; // The heap itself, heap[0] is the minimum
+    vector<int> position; // Item --> index in heap, -1 if the item is not in the heap
+
+    // siftUp
+    //
+    // Moves the entry at index i up until its parent's key is not larger
+    void siftUp(int i) {
+      HeapEntry entry = heap[i];
+
+      while (i > 0) {
+        int parent = (i - 1) / D;
+
+        if (!(entry.key < heap[parent].key)) {
+          break;
+        }
+
+        heap[i] = heap[parent];
+        position[heap[i].item] = i;
+        i = parent;
+      }
+
+      heap[i] = entry;
+      position[entry.item] = i;
+    }
+
+    // siftDown
+    //
+    // Moves the entry at index i down until none of its children has a smaller key
+    void siftDown(int i) {
+      HeapEntry entry = heap[i];
+      int count = static_cast<int>(heap.size());
+
+      while (true) {
+        int firstChild = i * D + 1;
+
+        if (firstChild >= count) {
+          break;
+        }
+
+        int lastChild = firstChild + D < count ? firstChild + D : count;
+        int minChild = firstChild;
+
+        for (int c = firstChild + 1; c < lastChild; c++) { // Find the smallest of up to D children
+          if (heap[c].key < heap[minChild].key) {
+            minChild = c;
+          }
+        }
+
+        if (!(heap[minChild].key < entry.key)) {
+          break;
+        }
+
+        heap[i] = heap[minChild];
+        position[heap[i].item] = i;
+        i = minChild;
+      }
+
+      heap[i] = entry;
+      position[entry.item] = i;
+    }
+
+  public:
+
+    // Constructor
+    //
+    // Builds a heap able to hold items 0..itemCount-1
+    explicit indexedHeap(int itemCount = 0) {
+      position.assign(itemCount, -1);
+    }
+
+    // resize
+    //
+    // Makes room for items 0..itemCount-1. Only valid while the heap is empty.
+    void resize(int itemCount) {
+      position.assign(itemCount, -1);
+      heap.clear();
+    }
+
+    bool empty() const {
+      return heap.empty();
+    }
+
+    int size() const {
+      return static_cast<int>(heap.size());
+    }
+
+    // contains
+    //
+    // Returns true if item is currently in the heap
+    bool contains(int item) const {
+      return position[item] != -1;
+    }
+
+    // top / topKey
+    //
+    // Returns the item with the smallest key and that key. Heap must not be empty.
+    int top() const {
+      return heap[0].item;
+    }
+
+    const KeyT& topKey() const {
+      return heap[0].key;
+    }
+
+    // keyOf
+    //
+    // Returns the current key of an item that is in the heap
+    const KeyT& keyOf(int item) const {
+      return heap[position[item]].key;
+    }
+
+    // push
+    //
+    // Inserts item with the given key. The item must not already be in the heap.
+    void push(int item, KeyT key) {
+      heap.push_back(HeapEntry{key, item});
+      siftUp(static_cast<int>(heap.size()) - 1);
+    }
+
+    // decrease
+    //
+    // Lowers the key of an item already in the heap
+    void decrease(int item, KeyT key) {
+      int i = position[item];
+
+      heap[i].key = key;
+      siftUp(i);
+    }
+
+    // pushOrDecrease
+    //
+    // Inserts item if it is not in the heap, otherwise lowers its key if the new key is smaller
+    void pushOrDecrease(int item, KeyT key) {
+      if (position[item] == -1) {
+        push(item, key);
+      }
+      else if (key < heap[position[item]].key) {
+        decrease(item, key);
+      }
+    }
+
+    // pop
+    //
+    // Removes and returns the item with the smallest key. Heap must not be empty.
+    int pop() {
+      int item = heap[0].item;
+      position[item] = -1;
+
+      HeapEntry last = heap.back();
+      heap.pop_back();
+
+      if (!heap.empty()) {
+        heap[0] = last;
+        position[last.item] = 0;
+        siftDown(0);
+      }
+
+      return item;
+    }
+
+    // clear
+    //
+    // Empties the heap in time proportional to its current size, not to the item count
+    void clear() {
+      for (const HeapEntry& entry : heap) {
+        position[entry.item] = -1;
+      }
+
+      heap.clear();
+    }
+};
@@ -78,3 +78,98 @@ Coordinates centerBetween2Points(double lat1, double long1, double lat2, double
   return Coordinates(-1, lat_ret, long_ret);
     
 }
+
+
+//
+// PrecomputeTrig
+//
+// Converts (lat, long) into TrigCoordinates, using the same PI as distBetween2Points.
+// The unit vector is exactly what distBetween2Points builds on every call: its acos argument is the
+// dot product of two of these vectors.
+//
+TrigCoordinates precomputeTrig(double lat, double lon)
+{
+  double PI = 3.14159265;
+
+  TrigCoordinates p;
+  p.LatRad = lat * PI / 180.0;
+  p.LonRad = lon * PI / 180.0;
+  p.CosLat = cos(p.LatRad);
+
+  p.X = p.CosLat * cos(p.LonRad);
+  p.Y = p.CosLat * sin(p.LonRad);
+  p.Z = sin(p.LatRad);
+
+  return p;
+}
+
+//
+// ChordSquared
+//
+// Returns the squared straight-line distance between p1 and p2 through the unit sphere. It grows
+// strictly with the great-circle distance, so it ranks points like distBetween2Points for
+// nearest-neighbor searches, at the cost of three multiply-adds and no trig. Never NaN. Where
+// acos rounds two nearly equal distances to the same value the chord still tells them apart, so
+// such ties are decided by the chord, not by the order the points come in.
+//
+double chordSquared(const TrigCoordinates& p1, const TrigCoordinates& p2)
+{
+  double dx = p1.X - p2.X;
+  double dy = p1.Y - p2.Y;
+  double dz = p1.Z - p2.Z;
+
+  return dx * dx + dy * dy + dz * dz;
+}
+
+//
+// ChordSquaredBatch
+//
+// out[i] = chordSquared(from, to[i]) for i in 0..count-1. A plain loop with no branches or calls,
+// which the compiler can vectorize, for scanning many points from one query point.
+//
+void chordSquaredBatch(const TrigCoordinates& from, const TrigCoordinates* to, int count, double* out)
+{
+  double fx = from.X, fy = from.Y, fz = from.Z;
+
+  for (int i = 0; i < count; i++)
+  {
+    double dx = fx - to[i].X;
+    double dy = fy - to[i].Y;
+    double dz = fz - to[i].Z;
+
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
+}
+
+//
+// ChordSquaredToMiles / MilesToChordSquared
+//
+// Converts between a squared chord and the great-circle distance in miles (same earth radius as
+// distBetween2Points). Only needed where a real distance has to come out of a chord.
+//
+double chordSquaredToMiles(double chordSq)
+{
+  double earth_rad = 3963.1;  // statue miles:
+  double halfChord = sqrt(chordSq) / 2.0;
+
+  if (halfChord > 1.0)
+  {
+    halfChord = 1.0;
+  }
+
+  return earth_rad * 2.0 * asin(halfChord);
+}
+
+double milesToChordSquared(double miles)
+{
+  double earth_rad = 3963.1;  // statue miles:
+  double halfAngle = miles / earth_rad / 2.0;
+
+  if (halfAngle > 3.14159265 / 2.0) // Past the antipode every point is in range
+  {
+    return 4.0;
+  }
+
+  double chord = 2.0 * sin(halfAngle);
+  return chord * chord;
+}
@@ -3,6 +3,8 @@
 // Declares distance/center point functions
 //
 
+#pragma once
+
 #include <iostream>
 #include <cmath>
 #include "osm.h"
@@ -11,3 +13,33 @@ using namespace std;
 
 double distBetween2Points(double lat1, double long1, double lat2, double long2);
 Coordinates centerBetween2Points(double lat1, double long1, double lat2, double long2);
+
+
+//
+// TrigCoordinates
+//
+// A (lat, lon) position with its trig precomputed once at load time: the point on the unit sphere
+// (X, Y, Z), plus the radians and cos(lat). Distances between two of these need no trig at all.
+//
+struct TrigCoordinates
+{
+  double X;
+  double Y;
+  double Z;
+  double LatRad;
+  double LonRad;
+  double CosLat;
+
+  TrigCoordinates()
+  {
+    X = Y = Z = 0.0;
+    LatRad = LonRad = 0.0;
+    CosLat = 1.0;
+  }
+};
+
+TrigCoordinates precomputeTrig(double lat, double lon);
+double chordSquared(const TrigCoordinates& p1, const TrigCoordinates& p2);
+void   chordSquaredBatch(const TrigCoordinates& from, const TrigCoordinates* to, int count, double* out);
+double chordSquaredToMiles(double chordSq);
+double milesToChordSquared(double miles);
@@ -1,40 +1,74 @@
 // graph.h
 //
 // Weighted graph class using adjacency list representation (implemented with an unordered map of vertex keys and vectors of edge structs as values)
-// Vertices and weights are templated
+// Vertices and weights are templated, and so is the allocator the adjacency lists are drawn from (std::allocator by default,
+// or e.g. std::pmr::polymorphic_allocator to put every edge vector and map node in one memory resource / arena)
 //
 
 #include <iostream>
 #include <stdexcept>
 #include <vector>
 #include <set>
+#include <span>
+#include <algorithm>
 #include <unordered_map>
+#include <functional>
+#include <memory>
 
 #pragma once
 
 using namespace std;
 
-template<typename VertexT, typename WeightT>
+template<typename VertexT, typename WeightT, template<typename> class AllocatorT = allocator>
 
 class graph {
-  private:
-    int vertCount; // Counter variables for vertices and edges
-    int edgeCount;
-
+  public:
     struct EdgeData { // We will use this struct for edges
       VertexT toVert;
       WeightT toWeight;
     };
 
+    struct BulkEdge { // One (from, to, weight) edge handed to addEdgesBulk
+      VertexT from;
+      VertexT to;
+      WeightT weight;
+    };
+
+    // edgeRange
+    //
+    // Non-owning view over the edges leaving one vertex, usable with range-based for.
+    // Yields the EdgeData structs by reference straight out of the edgeMap, so nothing is copied or allocated
+    class edgeRange {
+      private:
+        const EdgeData* first;
+        const EdgeData* last;
+
+      public:
+        edgeRange(const EdgeData* first, const EdgeData* last) : first(first), last(last) {}
+
+        const EdgeData* begin() const { return first; }
+        const EdgeData* end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+  private:
+    int vertCount; // Counter variables for vertices and edges
+    int edgeCount;
+
+    using edgeVector = vector<EdgeData, AllocatorT<EdgeData>>; // One vertex's edges, from the graph's allocator
+    using edgeMapType = unordered_map<VertexT, edgeVector, hash<VertexT>, equal_to<VertexT>, AllocatorT<pair<const VertexT, edgeVector>>>;
+
     vector<VertexT> Vertices; // Vector storing the vertices to keep track of unique vertices
-    unordered_map<VertexT, vector<EdgeData>> edgeMap; // Unordered map of vertex keys and edge data vectors as values
+    edgeMapType edgeMap; // Unordered map of vertex keys and edge data vectors as values
 
   public:
     
     // Constructor
     //
-    // Sets vertCount and edgeCount to 0
-    graph() {
+    // Sets vertCount and edgeCount to 0. The adjacency lists use alloc (a default constructed allocator if not given).
+    explicit graph(const AllocatorT<EdgeData>& alloc = AllocatorT<EdgeData>())
+      : edgeMap(0, hash<VertexT>(), equal_to<VertexT>(), AllocatorT<pair<const VertexT, edgeVector>>(alloc)) {
       vertCount = 0;
       edgeCount = 0;
     }
@@ -61,8 +95,8 @@ class graph {
         return false; // Return false if it's 1
       }
 
-      vector<EdgeData> blankVectorOfEdges; // Creates a blank vector of edges
-      edgeMap.emplace(v, blankVectorOfEdges); // Adds vertex with no edges to map
+      edgeVector blankVectorOfEdges(AllocatorT<EdgeData>(edgeMap.get_allocator())); // Creates a blank vector of edges
+      edgeMap.emplace(v, std::move(blankVectorOfEdges)); // Adds vertex with no edges to map
 
       Vertices.push_back(v); // Add new vertex to Vertices vector to keep track of unique vertices
 
@@ -70,6 +104,14 @@ class graph {
       return true; // Return true after adding
     }
 
+    // reserve
+    //
+    // Makes room for vertexCount vertices so adding them does not rehash or reallocate along the way
+    void reserve(int vertexCount) {
+      Vertices.reserve(vertexCount);
+      edgeMap.reserve(vertexCount);
+    }
+
     // addEdge
     //
     // Adds the edge (from, to, weight) to the graph, and returns
@@ -82,7 +124,7 @@ class graph {
         return false;
       }
 
-      vector<EdgeData> *searchVector = &edgeMap.at(from); // Using pointer here to modify actual vector in graph's edgeMap
+      edgeVector *searchVector = &edgeMap.at(from); // Using pointer here to modify actual vector in graph's edgeMap
       for (size_t i = 0; i < searchVector->size(); i++) {
         if (searchVector->at(i).toVert == to) { // If the edge already exists
           searchVector->at(i).toWeight = weight; // Overwrite the edge in the vector of edge data in the edgeMap
@@ -102,6 +144,111 @@ class graph {
       return true; // Return true
     }
 
+    // addEdgesBulk
+    //
+    // Adds every edge in newEdges, leaving the graph exactly as calling addEdge on each of them in order
+    // would: edges whose vertices do not exist are skipped, a repeated (from, to) keeps the last weight,
+    // and new edges are appended to their source in order of first appearance. Sorts the edges once and
+    // looks up each source once instead of scanning its edges for every addition, so it takes
+    // O(E log E) plus one scan per source that already had edges. Returns the # of edges accepted.
+    int addEdgesBulk(span<const BulkEdge> newEdges) {
+      vector<int> order(newEdges.size());
+
+      for (size_t i = 0; i < order.size(); i++) {
+        order[i] = static_cast<int>(i);
+      }
+
+      stable_sort(order.begin(), order.end(), [&](int a, int b) { // Groups by (from, to), input order within a group
+        if (newEdges[a].from < newEdges[b].from || newEdges[b].from < newEdges[a].from) {
+          return newEdges[a].from < newEdges[b].from;
+        }
+
+        return newEdges[a].to < newEdges[b].to;
+      });
+
+      struct Run { // One distinct (from, to): where it first appears and which input has the winning weight
+        int first;
+        int last;
+      };
+
+      vector<Run> runs;
+      int accepted = 0;
+
+      for (size_t start = 0; start < order.size(); ) {
+        const VertexT& from = newEdges[order[start]].from;
+        size_t end = start;
+
+        while (end < order.size() && !(from < newEdges[order[end]].from) && !(newEdges[order[end]].from < from)) {
+          end++;
+        }
+
+        auto source = edgeMap.find(from);
+
+        if (source == edgeMap.end()) { // Unknown source, none of its edges can be added
+          start = end;
+          continue;
+        }
+
+        //
+        // collapse each run of the same target into one edge:
+        //
+        runs.clear();
+
+        for (size_t i = start; i < end; ) {
+          size_t j = i + 1;
+
+          while (j < end && !(newEdges[order[i]].to < newEdges[order[j]].to)) {
+            j++;
+          }
+
+          if (edgeMap.count(newEdges[order[i]].to)) {
+            runs.push_back(Run{order[i], order[j - 1]});
+            accepted += static_cast<int>(j - i);
+          }
+
+          i = j;
+        }
+
+        //
+        // overwrite edges the source already has, append the others in order of first appearance:
+        //
+        edgeVector& sourceEdges = source->second;
+        vector<int> existing(sourceEdges.size()); // Positions in sourceEdges sorted by target, for binary search
+
+        for (size_t i = 0; i < existing.size(); i++) {
+          existing[i] = static_cast<int>(i);
+        }
+
+        sort(existing.begin(), existing.end(), [&](int a, int b) {
+          return sourceEdges[a].toVert < sourceEdges[b].toVert;
+        });
+
+        sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) {
+          return a.first < b.first;
+        });
+
+        for (const Run& run : runs) {
+          const BulkEdge& winner = newEdges[run.last];
+
+          auto it = lower_bound(existing.begin(), existing.end(), winner.to, [&](int position, const VertexT& to) {
+            return sourceEdges[position].toVert < to;
+          });
+
+          if (it != existing.end() && !(winner.to < sourceEdges[*it].toVert)) {
+            sourceEdges[*it].toWeight = winner.weight;
+          }
+          else {
+            sourceEdges.push_back(EdgeData{winner.to, winner.weight});
+            edgeCount++;
+          }
+        }
+
+        start = end;
+      }
+
+      return accepted;
+    }
+
     // getWeight
     //
     // Returns the weight associated with a given edge.  If
@@ -114,10 +261,10 @@ class graph {
         return false;
       }
 
-      vector<EdgeData> searchVector = edgeMap.at(from); // const functions do not like [] indexing so we must use at()
+      const edgeVector& searchVector = edgeMap.at(from); // const functions do not like [] indexing so we must use at(), reference avoids a copy
       for (size_t i = 0; i < searchVector.size(); i++) {
-        if (searchVector.at(i).toVert == to) { // Once we find the edge, set weight param to the weight in the edge data struct
-          weight = searchVector.at(i).toWeight; // weight returned here technically
+        if (searchVector[i].toVert == to) { // Once we find the edge, set weight param to the weight in the edge data struct
+          weight = searchVector[i].toWeight; // weight returned here technically
 
           return true; // Return true
         }
@@ -139,14 +286,43 @@ class graph {
         return S;
       }
 
-      vector<EdgeData> searchVector = edgeMap.at(v); // Get the vector of neighboring edges of v
+      const edgeVector& searchVector = edgeMap.at(v); // Get the vector of neighboring edges of v
       for (size_t i = 0; i < searchVector.size(); i++) {
-        S.insert(searchVector.at(i).toVert); // Iterate through and insert each toVert (what vertex the edge maps to) as a neighbor
+        S.insert(searchVector[i].toVert); // Iterate through and insert each toVert (what vertex the edge maps to) as a neighbor
       }
 
       return S; // Return set
     }
 
+    // edges
+    //
+    // Returns a view over the edges leaving v, in insertion order, without copying them.
+    // Each element is an EdgeData with toVert and toWeight. If v is not in the graph, the range is empty.
+    //
+    // Example:
+    //    for (const auto& edge : G.edges(v)) { ... edge.toVert ... edge.toWeight ... }
+    edgeRange edges(VertexT v) const {
+      auto it = edgeMap.find(v);
+
+      if (it == edgeMap.end()) { // Vertex not in the map, return empty range
+        return edgeRange(nullptr, nullptr);
+      }
+
+      const edgeVector& vertexEdges = it->second;
+      return edgeRange(vertexEdges.data(), vertexEdges.data() + vertexEdges.size());
+    }
+
+    // forEachEdge
+    //
+    // Calls fn(toVert, toWeight) for every edge leaving v, passing both by const reference.
+    // Does nothing if v is not in the graph.
+    template<typename Fn>
+    void forEachEdge(VertexT v, Fn fn) const {
+      for (const EdgeData& edge : edges(v)) {
+        fn(edge.toVert, edge.toWeight);
+      }
+    }
+
     // getVertices
     //
     // Returns a vector containing all the vertices currently in
@@ -201,4 +377,4 @@ class graph {
       
       output << "**************************************************" << endl;
     }
-};
\ No newline at end of file
+};
\ No newline at end of file
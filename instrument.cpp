@@ -0,0 +1,203 @@
+// instrument.cpp
+//
+// Implements the query instrumentation histograms and their output
+//
+
+#include <iostream>
+#include <bit>
+
+#include "instrument.h"
+
+using namespace std;
+
+
+//
+// profileCounterName / profileStageName
+//
+// Names used in the output
+//
+const char* profileCounterName(profileCounter counter)
+{
+  switch (counter) {
+    case profileCounter::SETTLED:
+      return "settled";
+    case profileCounter::RELAXED:
+      return "relaxed";
+    case profileCounter::HEAP_PUSHES:
+      return "heap_pushes";
+    case profileCounter::FALLBACKS:
+      return "fallbacks";
+    case profileCounter::CACHE_HITS:
+      return "cache_hits";
+    case profileCounter::CACHE_MISSES:
+      return "cache_misses";
+    default:
+      return "unknown";
+  }
+}
+
+const char* profileStageName(profileStage stage)
+{
+  switch (stage) {
+    case profileStage::QUERY:
+      return "query";
+    case profileStage::LOOKUP:
+      return "lookup";
+    case profileStage::CENTER:
+      return "center";
+    case profileStage::SEARCH:
+      return "search";
+    default:
+      return "unknown";
+  }
+}
+
+
+//
+// bucketOf
+//
+// Histogram bucket of a non-negative value: 0 for 0, otherwise 1 + the position of its highest bit
+//
+static int bucketOf(long long value)
+{
+  int b = value <= 0 ? 0 : bit_width(static_cast<unsigned long long>(value));
+  return b < profileHistogram::BUCKETS ? b : profileHistogram::BUCKETS - 1;
+}
+
+
+//
+// Constructor
+//
+profileHistogram::profileHistogram()
+{
+  queries = 0;
+
+  for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+    counterTotals[c] = 0;
+
+    for (int b = 0; b < BUCKETS; b++) {
+      counterBuckets[c][b] = 0;
+    }
+  }
+
+  for (int s = 0; s < NUM_PROFILE_STAGES; s++) {
+    stageNanos[s] = 0;
+
+    for (int b = 0; b < BUCKETS; b++) {
+      stageBuckets[s][b] = 0;
+    }
+  }
+}
+
+
+//
+// add
+//
+// Folds one query's profile in. Does nothing without ROUTING_PROFILE, so callers need no #ifdef.
+//
+void profileHistogram::add(const queryProfile& profile)
+{
+  if constexpr (!PROFILING) {
+    return;
+  }
+
+  lock_guard<mutex> guard(lock);
+  queries++;
+
+  for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+    counterTotals[c] += profile.Counters[c];
+    counterBuckets[c][bucketOf(profile.Counters[c])]++;
+  }
+
+  for (int s = 0; s < NUM_PROFILE_STAGES; s++) {
+    stageNanos[s] += profile.StageNanos[s];
+    stageBuckets[s][bucketOf(profile.StageNanos[s] / 1000)]++;
+  }
+}
+
+
+//
+// writeBuckets
+//
+// Bucket counts joined by commas, trailing empty buckets left out
+//
+static void writeBuckets(ostream& out, const long long* buckets)
+{
+  int used = profileHistogram::BUCKETS;
+
+  while (used > 1 && buckets[used - 1] == 0) {
+    used--;
+  }
+
+  for (int b = 0; b < used; b++) {
+    out << (b > 0 ? "," : "") << buckets[b];
+  }
+}
+
+
+//
+// writeTSV / writeJSON
+//
+// The histograms on one line, either tab separated (profile, the # of queries, then name=total:buckets per stage
+// and counter, stage totals in microseconds) or as one JSON object
+//
+void profileHistogram::writeTSV(ostream& out) const
+{
+  lock_guard<mutex> guard(lock);
+
+  out << "profile\t" << queries;
+
+  for (int s = 0; s < NUM_PROFILE_STAGES; s++) {
+    out << '\t' << profileStageName(static_cast<profileStage>(s)) << "_us=" << stageNanos[s] / 1000 << ':';
+    writeBuckets(out, stageBuckets[s]);
+  }
+
+  for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+    out << '\t' << profileCounterName(static_cast<profileCounter>(c)) << '=' << counterTotals[c] << ':';
+    writeBuckets(out, counterBuckets[c]);
+  }
+
+  out << '\n';
+}
+
+void profileHistogram::writeJSON(ostream& out) const
+{
+  lock_guard<mutex> guard(lock);
+
+  out << "{\"queries\":" << queries;
+
+  for (int s = 0; s < NUM_PROFILE_STAGES; s++) {
+    out << ",\"" << profileStageName(static_cast<profileStage>(s)) << "_us\":{\"total\":" << stageNanos[s] / 1000 << ",\"histogram\":[";
+    writeBuckets(out, stageBuckets[s]);
+    out << "]}";
+  }
+
+  for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+    out << ",\"" << profileCounterName(static_cast<profileCounter>(c)) << "\":{\"total\":" << counterTotals[c] << ",\"histogram\":[";
+    writeBuckets(out, counterBuckets[c]);
+    out << "]}";
+  }
+
+  out << "}\n";
+}
+
+
+//
+// writeQueryProfile
+//
+// One query's profile on one line, stage times in microseconds
+//
+void writeQueryProfile(ostream& out, const queryProfile& profile)
+{
+  out << "Profile:";
+
+  for (int s = 0; s < NUM_PROFILE_STAGES; s++) {
+    out << ' ' << profileStageName(static_cast<profileStage>(s)) << '=' << profile.StageNanos[s] / 1000.0 << "us";
+  }
+
+  for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) {
+    out << ' ' << profileCounterName(static_cast<profileCounter>(c)) << '=' << profile.Counters[c];
+  }
+
+  out << '\n';
+}
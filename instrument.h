@@ -0,0 +1,129 @@
+// instrument.h
+//
+// Declares the query instrumentation: per-query counters and stage timers, and histograms aggregating them
+// Everything here compiles to nothing unless built with -DROUTING_PROFILE (make build PROFILE=1)
+//
+
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <mutex>
+
+using namespace std;
+
+
+#ifdef ROUTING_PROFILE
+constexpr bool PROFILING = true;
+#else
+constexpr bool PROFILING = false;
+#endif
+
+
+//
+// What is counted and timed. Stage times are inclusive: SEARCH runs inside QUERY, and so on.
+//
+enum class profileCounter { SETTLED, RELAXED, HEAP_PUSHES, FALLBACKS, CACHE_HITS, CACHE_MISSES, NUM_COUNTERS };
+enum class profileStage { QUERY, LOOKUP, CENTER, SEARCH, NUM_STAGES };
+
+const int NUM_PROFILE_COUNTERS = static_cast<int>(profileCounter::NUM_COUNTERS);
+const int NUM_PROFILE_STAGES = static_cast<int>(profileStage::NUM_STAGES);
+
+const char* profileCounterName(profileCounter counter);
+const char* profileStageName(profileStage stage);
+
+
+//
+// queryProfile
+//
+// Counters and stage times of one query. Each thread has its own current one (currentProfile), which the
+// hot paths add to without any locking; MeetingPointQuery clears it when a query starts.
+//
+struct queryProfile
+{
+  long long Counters[NUM_PROFILE_COUNTERS] = {};
+  long long StageNanos[NUM_PROFILE_STAGES] = {};
+
+  void clear()
+  {
+    *this = queryProfile();
+  }
+};
+
+inline thread_local queryProfile currentProfile;
+
+
+//
+// profileCount
+//
+// Adds n to a counter of the current query
+//
+inline void profileCount(profileCounter counter, long long n = 1)
+{
+  if constexpr (PROFILING) {
+    currentProfile.Counters[static_cast<int>(counter)] += n;
+  }
+}
+
+
+//
+// profileTimer
+//
+// Adds the time from its construction to the end of its scope to a stage of the current query
+//
+class profileTimer
+{
+#ifdef ROUTING_PROFILE
+private:
+  profileStage Stage;
+  chrono::steady_clock::time_point Start;
+
+public:
+  explicit profileTimer(profileStage stage) : Stage(stage), Start(chrono::steady_clock::now()) {}
+
+  ~profileTimer()
+  {
+    currentProfile.StageNanos[static_cast<int>(Stage)] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - Start).count();
+  }
+#else
+public:
+  explicit profileTimer(profileStage) {}
+#endif
+
+  profileTimer(const profileTimer&) = delete;
+  profileTimer& operator=(const profileTimer&) = delete;
+};
+
+
+//
+// profileHistogram
+//
+// Many query profiles folded together: per stage and per counter the total and a histogram of the per-query values
+// in powers of two (bucket b counts values in [2^(b-1), 2^b), bucket 0 the zeros), stage times in microseconds.
+// Internally locked, so every thread can add to the same one.
+//
+class profileHistogram
+{
+public:
+  static const int BUCKETS = 40;
+
+private:
+  mutable mutex lock;
+  long long queries;
+  long long counterTotals[NUM_PROFILE_COUNTERS];
+  long long stageNanos[NUM_PROFILE_STAGES];
+  long long counterBuckets[NUM_PROFILE_COUNTERS][BUCKETS];
+  long long stageBuckets[NUM_PROFILE_STAGES][BUCKETS];
+
+public:
+  profileHistogram();
+
+  profileHistogram(const profileHistogram&) = delete;
+  profileHistogram& operator=(const profileHistogram&) = delete;
+
+  void add(const queryProfile& profile);
+  void writeTSV(ostream& out) const;
+  void writeJSON(ostream& out) const;
+};
+
+void writeQueryProfile(ostream& out, const queryProfile& profile);
@@ -0,0 +1,161 @@
+// lrucache.h
+//
+// Bounded, thread-safe least-recently-used cache of immutable values, split into independently locked shards
+// Values are handed out as shared_ptr<const ValueT>, so a hit copies a pointer under the lock and nothing else
+//
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <utility>
+
+#pragma once
+
+using namespace std;
+
+template<typename KeyT, typename ValueT>
+
+class lruCache {
+  private:
+    using entryList = list<pair<KeyT, shared_ptr<const ValueT>>>; // Most recently used first
+
+    struct shard { // One lock, one recency list, one lookup table
+      mutex lock;
+      entryList entries;
+      unordered_map<KeyT, typename entryList::iterator> index;
+    };
+
+    vector<unique_ptr<shard>> shards;
+    size_t shardCapacity; // Entries per shard, 0 disables the cache
+
+    atomic<long long> hitCount;
+    atomic<long long> missCount;
+
+    shard& shardOf(const KeyT& key) {
+      return *shards[hash<KeyT>()(key) % shards.size()];
+    }
+
+  public:
+    // Constructor
+    //
+    // Holds up to capacity values (rounded up to a multiple of shardCount), 0 disables the cache. More shards
+    // means less lock contention between threads, at the price of the recency order only being kept per shard.
+    explicit lruCache(size_t capacity = 0, int shardCount = 16) : hitCount(0), missCount(0) {
+      int count = max(1, shardCount);
+
+      for (int s = 0; s < count; s++) {
+        shards.push_back(make_unique<shard>());
+      }
+
+      shardCapacity = (capacity + count - 1) / count;
+    }
+
+    bool enabled() const {
+      return shardCapacity > 0;
+    }
+
+    // find
+    //
+    // Returns the value cached for key, marking it most recently used, or nullptr. Counts a hit or a miss.
+    shared_ptr<const ValueT> find(const KeyT& key) {
+      if (!enabled()) {
+        return nullptr;
+      }
+
+      shard& s = shardOf(key);
+      lock_guard<mutex> guard(s.lock);
+      auto found = s.index.find(key);
+
+      if (found == s.index.end()) {
+        missCount++;
+        return nullptr;
+      }
+
+      s.entries.splice(s.entries.begin(), s.entries, found->second); // Iterators stay valid across splice
+      hitCount++;
+      return found->second->second;
+    }
+
+    // insert
+    //
+    // Caches value for key (replacing any value there), evicting the shard's least recently used entry when full
+    void insert(const KeyT& key, shared_ptr<const ValueT> value) {
+      if (!enabled()) {
+        return;
+      }
+
+      shard& s = shardOf(key);
+      lock_guard<mutex> guard(s.lock);
+      auto found = s.index.find(key);
+
+      if (found != s.index.end()) {
+        found->second->second = move(value);
+        s.entries.splice(s.entries.begin(), s.entries, found->second);
+        return;
+      }
+
+      if (s.entries.size() >= shardCapacity) {
+        s.index.erase(s.entries.back().first);
+        s.entries.pop_back();
+      }
+
+      s.entries.emplace_front(key, move(value));
+      s.index[key] = s.entries.begin();
+    }
+
+    // clear
+    //
+    // Drops every entry, e.g. when the data the values were computed from changes. Counters are kept.
+    void clear() {
+      for (unique_ptr<shard>& s : shards) {
+        lock_guard<mutex> guard(s->lock);
+        s->entries.clear();
+        s->index.clear();
+      }
+    }
+
+    // entries
+    //
+    // Returns every cached key and value, least recently used first within each shard, so inserting them in order
+    // into another cache of the same shape (e.g. one replacing this one) keeps their recency. Doesn't count as use.
+    vector<pair<KeyT, shared_ptr<const ValueT>>> entries() {
+      vector<pair<KeyT, shared_ptr<const ValueT>>> all;
+
+      for (unique_ptr<shard>& s : shards) {
+        lock_guard<mutex> guard(s->lock);
+        all.insert(all.end(), s->entries.rbegin(), s->entries.rend());
+      }
+
+      return all;
+    }
+
+    // size
+    //
+    // Returns the # of entries cached right now, over all shards
+    size_t size() {
+      size_t total = 0;
+
+      for (unique_ptr<shard>& s : shards) {
+        lock_guard<mutex> guard(s->lock);
+        total += s->entries.size();
+      }
+
+      return total;
+    }
+
+    // hits / misses
+    //
+    // Returns the # of find() calls that found a value, and that did not, since construction
+    long long hits() const {
+      return hitCount;
+    }
+
+    long long misses() const {
+      return missCount;
+    }
+};
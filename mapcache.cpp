@@ -0,0 +1,594 @@
+// mapcache.cpp
+//
+// Implements the binary map cache, written with plain file output and read back with mmap
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <climits>
+#include <type_traits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mapcache.h"
+
+using namespace std;
+
+
+//
+// File identification. Bump CACHE_VERSION whenever the layout below changes.
+//
+static const char CACHE_MAGIC[8] = {'O', 'S', 'M', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t CACHE_VERSION = 4;
+
+static_assert(is_trivially_copyable<Coordinates>::value, "Coordinates are mapped straight from the cache file");
+static_assert(sizeof(Coordinates) == 24, "Coordinates layout is part of the cache file format");
+
+
+//
+// Header
+//
+// First bytes of the file. Offsets are from the start of the file, counts are in elements.
+//
+struct mapCache::Header
+{
+  char Magic[8];
+  uint32_t Version;
+  uint32_t HeaderSize;
+  uint64_t FileSize;
+
+  uint64_t NodeCount; // # of nodes and footways in the source map, only kept for the startup stats
+  uint64_t FootwayCount;
+
+  uint64_t VertexCount;
+  uint64_t EdgeCount;
+  uint64_t WeightCount; // EdgeCount, or 0 when the weights are stored in fixed point
+  uint64_t FixedWeightCount; // EdgeCount for a graph with fixed point weights, otherwise 0
+  uint64_t ComponentCount;
+  uint64_t FootwayNodeCount;
+  uint64_t BuildingCount;
+  uint64_t StringBytes;
+  uint64_t ViaCount; // # of collapsed vertices, 0 with ViaOffsets empty unless the graph was built with chains collapsed
+  uint64_t ViaOffsetCount;
+  uint64_t MatrixBuildingCount; // 0 without a distance matrix, BuildingCount with one
+  uint64_t MatrixTreeCount;
+
+  uint64_t VerticesOffset; // long long x VertexCount
+  uint64_t OrderOffset; // int x VertexCount
+  uint64_t OffsetsOffset; // int x (VertexCount + 1)
+  uint64_t TargetsOffset; // int x EdgeCount
+  uint64_t WeightsOffset; // double x WeightCount
+  uint64_t FixedWeightsOffset; // uint32_t x FixedWeightCount
+  uint64_t ComponentsOffset; // int x VertexCount
+  uint64_t VertexCoordsOffset; // Coordinates x VertexCount
+  uint64_t FootwayNodesOffset; // Coordinates x FootwayNodeCount
+  uint64_t BuildingsOffset; // BuildingRecord x BuildingCount
+  uint64_t StringsOffset; // char x StringBytes
+  uint64_t ViaOffsetsOffset; // int x ViaOffsetCount
+  uint64_t ViaOffset; // long long x ViaCount
+  uint64_t MatrixVerticesOffset; // int x MatrixBuildingCount
+  uint64_t MatrixDistancesOffset; // double x MatrixBuildingCount^2
+  uint64_t MatrixTreeOffsetsOffset; // long long x (MatrixBuildingCount + 1), or nothing without a matrix
+  uint64_t MatrixTreeVerticesOffset; // int x MatrixTreeCount
+  uint64_t MatrixTreeParentsOffset; // int x MatrixTreeCount
+};
+
+
+//
+// alignUp
+//
+// Rounds offset up to the next multiple of 8, the alignment every section starts on
+//
+static uint64_t alignUp(uint64_t offset)
+{
+  return (offset + 7) & ~uint64_t(7);
+}
+
+
+//
+// writeSection
+//
+// Pads the file out to offset and writes count elements of data there
+//
+template<typename T>
+static void writeSection(ofstream& out, uint64_t& written, uint64_t offset, const T* data, uint64_t count)
+{
+  static const char zeros[8] = {0};
+
+  out.write(zeros, offset - written);
+  out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+
+  written = offset + count * sizeof(T);
+}
+
+
+//
+// Constructor / Destructor
+//
+mapCache::mapCache()
+{
+  mapping = nullptr;
+  mappingSize = 0;
+  header = nullptr;
+}
+
+mapCache::~mapCache()
+{
+  close();
+}
+
+
+//
+// isCacheFile
+//
+// Returns true if filename starts with the cache magic, i.e. it should be opened as a cache and not as XML
+//
+bool mapCache::isCacheFile(const string& filename)
+{
+  ifstream in(filename, ios::binary);
+  char magic[8];
+
+  if (!in.read(magic, sizeof(magic)))
+  {
+    return false;
+  }
+
+  return memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0;
+}
+
+
+//
+// write
+//
+// Compiles a loaded map into a cache file. G is the frozen footway graph, vertexCoords the position of each of
+// its dense vertices, and footwayNodes the footway nodes in the order the snapping grid is built from.
+// matrix, if not nullptr or empty, is the distance matrix built over Buildings.
+// Returns false (after printing an error) if the file cannot be written.
+//
+bool mapCache::write(const string& filename, int nodeCount, int footwayCount,
+  const compactGraph<long long, double>& G, span<const Coordinates> vertexCoords,
+  span<const Coordinates> footwayNodes, const vector<BuildingInfo>& Buildings, const buildingMatrix* matrix)
+{
+  //
+  // building records plus one string section holding every name:
+  //
+  vector<BuildingRecord> records;
+  string strings;
+
+  for (const BuildingInfo& b : Buildings)
+  {
+    BuildingRecord r;
+
+    r.ID = b.Coords.ID;
+    r.Lat = b.Coords.Lat;
+    r.Lon = b.Coords.Lon;
+    r.NameOffset = strings.size();
+    r.NameLength = b.Fullname.size();
+    strings += b.Fullname;
+    r.AbbrevOffset = strings.size();
+    r.AbbrevLength = b.Abbrev.size();
+    strings += b.Abbrev;
+
+    records.push_back(r);
+  }
+
+  //
+  // lay the sections out one after another:
+  //
+  Header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.Magic, CACHE_MAGIC, sizeof(h.Magic));
+  h.Version = CACHE_VERSION;
+  h.HeaderSize = sizeof(Header);
+
+  h.NodeCount = nodeCount;
+  h.FootwayCount = footwayCount;
+  h.VertexCount = G.NumVertices();
+  h.EdgeCount = G.NumEdges();
+  h.WeightCount = G.getWeights().size();
+  h.FixedWeightCount = G.getFixedWeights().size();
+  h.ComponentCount = G.NumComponents();
+  h.FootwayNodeCount = footwayNodes.size();
+  h.BuildingCount = records.size();
+  h.StringBytes = strings.size();
+  h.ViaOffsetCount = G.getViaOffsets().size();
+  h.ViaCount = G.getVia().size();
+
+  buildingMatrix none;
+  const buildingMatrix& M = (matrix != nullptr) ? *matrix : none;
+
+  h.MatrixBuildingCount = M.NumBuildings();
+  h.MatrixTreeCount = M.NumTreeVertices();
+
+  uint64_t end = sizeof(Header);
+
+  auto place = [&](uint64_t& offset, uint64_t bytes) {
+    offset = alignUp(end);
+    end = offset + bytes;
+  };
+
+  place(h.VerticesOffset, h.VertexCount * sizeof(long long));
+  place(h.OrderOffset, h.VertexCount * sizeof(int));
+  place(h.OffsetsOffset, (h.VertexCount + 1) * sizeof(int));
+  place(h.TargetsOffset, h.EdgeCount * sizeof(int));
+  place(h.WeightsOffset, h.WeightCount * sizeof(double));
+  place(h.FixedWeightsOffset, h.FixedWeightCount * sizeof(uint32_t));
+  place(h.ComponentsOffset, h.VertexCount * sizeof(int));
+  place(h.VertexCoordsOffset, h.VertexCount * sizeof(Coordinates));
+  place(h.FootwayNodesOffset, h.FootwayNodeCount * sizeof(Coordinates));
+  place(h.BuildingsOffset, h.BuildingCount * sizeof(BuildingRecord));
+  place(h.StringsOffset, h.StringBytes);
+  place(h.ViaOffsetsOffset, h.ViaOffsetCount * sizeof(int));
+  place(h.ViaOffset, h.ViaCount * sizeof(long long));
+  place(h.MatrixVerticesOffset, h.MatrixBuildingCount * sizeof(int));
+  place(h.MatrixDistancesOffset, h.MatrixBuildingCount * h.MatrixBuildingCount * sizeof(double));
+  place(h.MatrixTreeOffsetsOffset, M.getTreeOffsets().size() * sizeof(long long));
+  place(h.MatrixTreeVerticesOffset, h.MatrixTreeCount * sizeof(int));
+  place(h.MatrixTreeParentsOffset, h.MatrixTreeCount * sizeof(int));
+
+  h.FileSize = end;
+
+  ofstream out(filename, ios::binary | ios::trunc);
+
+  if (!out)
+  {
+    cout << "**ERROR: unable to write map cache '" << filename << "'." << endl;
+    return false;
+  }
+
+  uint64_t written = 0;
+
+  writeSection(out, written, 0, &h, 1);
+  writeSection(out, written, h.VerticesOffset, G.getVertices().data(), h.VertexCount);
+  writeSection(out, written, h.OrderOffset, G.getOrder().data(), h.VertexCount);
+  writeSection(out, written, h.OffsetsOffset, G.getOffsets().data(), h.VertexCount + 1);
+  writeSection(out, written, h.TargetsOffset, G.getTargets().data(), h.EdgeCount);
+  writeSection(out, written, h.WeightsOffset, G.getWeights().data(), h.WeightCount);
+  writeSection(out, written, h.FixedWeightsOffset, G.getFixedWeights().data(), h.FixedWeightCount);
+  writeSection(out, written, h.ComponentsOffset, G.getComponents().data(), h.VertexCount);
+  writeSection(out, written, h.VertexCoordsOffset, vertexCoords.data(), h.VertexCount);
+  writeSection(out, written, h.FootwayNodesOffset, footwayNodes.data(), h.FootwayNodeCount);
+  writeSection(out, written, h.BuildingsOffset, records.data(), h.BuildingCount);
+  writeSection(out, written, h.StringsOffset, strings.data(), h.StringBytes);
+  writeSection(out, written, h.ViaOffsetsOffset, G.getViaOffsets().data(), h.ViaOffsetCount);
+  writeSection(out, written, h.ViaOffset, G.getVia().data(), h.ViaCount);
+  writeSection(out, written, h.MatrixVerticesOffset, M.getBuildingVertices().data(), h.MatrixBuildingCount);
+  writeSection(out, written, h.MatrixDistancesOffset, M.getDistances().data(), h.MatrixBuildingCount * h.MatrixBuildingCount);
+  writeSection(out, written, h.MatrixTreeOffsetsOffset, M.getTreeOffsets().data(), M.getTreeOffsets().size());
+  writeSection(out, written, h.MatrixTreeVerticesOffset, M.getTreeVertices().data(), h.MatrixTreeCount);
+  writeSection(out, written, h.MatrixTreeParentsOffset, M.getTreeParents().data(), h.MatrixTreeCount);
+
+  out.close();
+
+  if (!out)
+  {
+    cout << "**ERROR: unable to write map cache '" << filename << "'." << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// open
+//
+// Maps a cache file read-only and checks its header, its section bounds and every index the graph and
+// matrix follow. Returns false (after printing an error) if the file cannot be mapped, is from another
+// version, or is truncated or corrupt.
+//
+bool mapCache::open(const string& filename)
+{
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+
+  if (fd < 0)
+  {
+    cout << "**ERROR: unable to open map cache '" << filename << "'." << endl;
+    return false;
+  }
+
+  struct stat info;
+
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header))
+  {
+    cout << "**ERROR: map cache '" << filename << "' is truncated." << endl;
+    ::close(fd);
+    return false;
+  }
+
+  void* p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // The mapping stays valid after the descriptor is closed
+
+  if (p == MAP_FAILED)
+  {
+    cout << "**ERROR: unable to map map cache '" << filename << "'." << endl;
+    return false;
+  }
+
+  mapping = p;
+  mappingSize = info.st_size;
+  header = static_cast<const Header*>(mapping);
+
+  if (memcmp(header->Magic, CACHE_MAGIC, sizeof(header->Magic)) != 0
+    || header->Version != CACHE_VERSION || header->HeaderSize != sizeof(Header))
+  {
+    cout << "**ERROR: map cache '" << filename << "' was written by another version, recompile it." << endl;
+    close();
+    return false;
+  }
+
+  //
+  // every section has to be aligned and lie inside the file:
+  //
+  const Header& h = *header;
+  bool valid = (h.FileSize == mappingSize);
+
+  auto check = [&](uint64_t offset, uint64_t count, uint64_t size) {
+    valid = valid && offset % 8 == 0 && offset <= mappingSize && count <= (mappingSize - offset) / size;
+  };
+
+  check(h.VerticesOffset, h.VertexCount, sizeof(long long));
+  check(h.OrderOffset, h.VertexCount, sizeof(int));
+  check(h.OffsetsOffset, h.VertexCount + 1, sizeof(int));
+  check(h.TargetsOffset, h.EdgeCount, sizeof(int));
+  check(h.WeightsOffset, h.WeightCount, sizeof(double));
+  check(h.FixedWeightsOffset, h.FixedWeightCount, sizeof(uint32_t));
+  valid = valid && (h.WeightCount + h.FixedWeightCount == h.EdgeCount) && (h.WeightCount == 0 || h.FixedWeightCount == 0);
+  check(h.ComponentsOffset, h.VertexCount, sizeof(int));
+  check(h.VertexCoordsOffset, h.VertexCount, sizeof(Coordinates));
+  check(h.FootwayNodesOffset, h.FootwayNodeCount, sizeof(Coordinates));
+  check(h.BuildingsOffset, h.BuildingCount, sizeof(BuildingRecord));
+  check(h.StringsOffset, h.StringBytes, 1);
+  check(h.ViaOffsetsOffset, h.ViaOffsetCount, sizeof(int));
+  check(h.ViaOffset, h.ViaCount, sizeof(long long));
+  valid = valid && (h.ViaOffsetCount == 0 || h.ViaOffsetCount == h.EdgeCount + 1);
+
+  valid = valid && (h.MatrixBuildingCount == 0 || h.MatrixBuildingCount == h.BuildingCount);
+  check(h.MatrixVerticesOffset, h.MatrixBuildingCount, sizeof(int));
+  check(h.MatrixDistancesOffset, h.MatrixBuildingCount * h.MatrixBuildingCount, sizeof(double));
+  check(h.MatrixTreeOffsetsOffset, h.MatrixBuildingCount + 1, sizeof(long long));
+  check(h.MatrixTreeVerticesOffset, h.MatrixTreeCount, sizeof(int));
+  check(h.MatrixTreeParentsOffset, h.MatrixTreeCount, sizeof(int));
+
+  if (valid)
+  {
+    for (const BuildingRecord& r : section<BuildingRecord>(h.BuildingsOffset, h.BuildingCount))
+    {
+      valid = valid && r.NameOffset <= h.StringBytes && r.NameLength <= h.StringBytes - r.NameOffset
+        && r.AbbrevOffset <= h.StringBytes && r.AbbrevLength <= h.StringBytes - r.AbbrevOffset;
+    }
+  }
+
+  if (valid)
+  {
+    //
+    // so are the graph's: offsets run from 0 to the edge count without going down, every target is a vertex,
+    // every component label is below the component count, order is a permutation, and so on for the via nodes:
+    //
+    uint64_t V = h.VertexCount;
+    uint64_t E = h.EdgeCount;
+    valid = V < (uint64_t)INT_MAX && E < (uint64_t)INT_MAX && h.ViaCount < (uint64_t)INT_MAX && h.ComponentCount <= V;
+
+    span<const int> offsets = section<int>(h.OffsetsOffset, V + 1);
+    valid = valid && offsets[0] == 0 && offsets[V] == (long long)E;
+
+    for (uint64_t v = 0; valid && v < V; v++)
+    {
+      valid = offsets[v] <= offsets[v + 1];
+    }
+
+    for (int t : section<int>(h.TargetsOffset, E))
+    {
+      valid = valid && t >= 0 && t < (long long)V;
+    }
+
+    for (int c : section<int>(h.ComponentsOffset, V))
+    {
+      valid = valid && c >= 0 && c < (long long)h.ComponentCount;
+    }
+
+    vector<bool> seen(valid ? V : 0, false);
+
+    for (int i : section<int>(h.OrderOffset, V))
+    {
+      valid = valid && i >= 0 && i < (long long)V && !seen[i];
+
+      if (valid)
+      {
+        seen[i] = true;
+      }
+    }
+
+    if (valid && h.ViaOffsetCount > 0)
+    {
+      span<const int> viaOffsets = section<int>(h.ViaOffsetsOffset, h.ViaOffsetCount);
+      valid = viaOffsets[0] == 0 && viaOffsets[E] == (long long)h.ViaCount;
+
+      for (uint64_t e = 0; valid && e < E; e++)
+      {
+        valid = viaOffsets[e] <= viaOffsets[e + 1];
+      }
+    }
+  }
+
+  if (valid && h.MatrixBuildingCount > 0)
+  {
+    //
+    // matrix indices are followed without further checks, so they must all point inside the graph and trees:
+    //
+    auto vertexInRange = [&](int v) { return v >= -1 && v < (long long)h.VertexCount; };
+    span<const long long> treeOffsets = section<long long>(h.MatrixTreeOffsetsOffset, h.MatrixBuildingCount + 1);
+
+    valid = treeOffsets[0] == 0 && treeOffsets[h.MatrixBuildingCount] == (long long)h.MatrixTreeCount;
+
+    for (uint64_t r = 0; valid && r < h.MatrixBuildingCount; r++)
+    {
+      valid = treeOffsets[r] <= treeOffsets[r + 1];
+    }
+
+    for (int v : section<int>(h.MatrixVerticesOffset, h.MatrixBuildingCount))
+    {
+      valid = valid && vertexInRange(v);
+    }
+
+    for (int v : section<int>(h.MatrixTreeVerticesOffset, h.MatrixTreeCount))
+    {
+      valid = valid && v >= 0 && vertexInRange(v);
+    }
+
+    for (int v : section<int>(h.MatrixTreeParentsOffset, h.MatrixTreeCount))
+    {
+      valid = valid && vertexInRange(v);
+    }
+  }
+
+  if (!valid)
+  {
+    cout << "**ERROR: map cache '" << filename << "' is truncated or corrupt." << endl;
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// close
+//
+// Unmaps the file. Graphs and views handed out by this cache must not be used afterwards.
+//
+void mapCache::close()
+{
+  if (mapping != nullptr)
+  {
+    munmap(mapping, mappingSize);
+  }
+
+  mapping = nullptr;
+  mappingSize = 0;
+  header = nullptr;
+}
+
+
+//
+// section
+//
+// View of count elements of type T at offset in the mapping, already bounds checked by open()
+//
+template<typename T>
+span<const T> mapCache::section(uint64_t offset, uint64_t count) const
+{
+  return span<const T>(reinterpret_cast<const T*>(static_cast<const char*>(mapping) + offset), count);
+}
+
+
+//
+// NumNodes / NumFootways
+//
+// # of nodes and footways the map was compiled from
+//
+int mapCache::NumNodes() const
+{
+  return static_cast<int>(header->NodeCount);
+}
+
+int mapCache::NumFootways() const
+{
+  return static_cast<int>(header->FootwayCount);
+}
+
+
+//
+// graph
+//
+// The footway graph, borrowing its arrays from the mapping
+//
+compactGraph<long long, double> mapCache::graph() const
+{
+  const Header& h = *header;
+
+  return compactGraph<long long, double>(
+    section<long long>(h.VerticesOffset, h.VertexCount),
+    section<int>(h.OrderOffset, h.VertexCount),
+    section<int>(h.OffsetsOffset, h.VertexCount + 1),
+    section<int>(h.TargetsOffset, h.EdgeCount),
+    section<double>(h.WeightsOffset, h.WeightCount),
+    section<int>(h.ComponentsOffset, h.VertexCount),
+    static_cast<int>(h.ComponentCount),
+    section<int>(h.ViaOffsetsOffset, h.ViaOffsetCount),
+    section<long long>(h.ViaOffset, h.ViaCount),
+    section<uint32_t>(h.FixedWeightsOffset, h.FixedWeightCount));
+}
+
+
+//
+// vertexCoords / footwayNodes
+//
+// Position of each dense vertex of graph(), and the footway nodes in first-appearance order
+//
+span<const Coordinates> mapCache::vertexCoords() const
+{
+  return section<Coordinates>(header->VertexCoordsOffset, header->VertexCount);
+}
+
+span<const Coordinates> mapCache::footwayNodes() const
+{
+  return section<Coordinates>(header->FootwayNodesOffset, header->FootwayNodeCount);
+}
+
+
+//
+// buildings
+//
+// The building table. BuildingInfo owns its strings, so this is the one section that is copied out.
+//
+vector<BuildingInfo> mapCache::buildings() const
+{
+  span<const BuildingRecord> records = section<BuildingRecord>(header->BuildingsOffset, header->BuildingCount);
+  const char* strings = static_cast<const char*>(mapping) + header->StringsOffset;
+
+  vector<BuildingInfo> Buildings;
+  Buildings.reserve(records.size());
+
+  for (const BuildingRecord& r : records)
+  {
+    string name(strings + r.NameOffset, r.NameLength);
+    string abbrev(strings + r.AbbrevOffset, r.AbbrevLength);
+
+    Buildings.push_back(BuildingInfo(name, abbrev, r.ID, r.Lat, r.Lon));
+  }
+
+  return Buildings;
+}
+
+
+//
+// matrix
+//
+// The building distance matrix, borrowing its arrays from the mapping. Empty if the cache was compiled without one.
+//
+buildingMatrix mapCache::matrix() const
+{
+  const Header& h = *header;
+
+  if (h.MatrixBuildingCount == 0)
+  {
+    return buildingMatrix();
+  }
+
+  return buildingMatrix(static_cast<int>(h.MatrixBuildingCount),
+    section<int>(h.MatrixVerticesOffset, h.MatrixBuildingCount),
+    section<double>(h.MatrixDistancesOffset, h.MatrixBuildingCount * h.MatrixBuildingCount),
+    section<long long>(h.MatrixTreeOffsetsOffset, h.MatrixBuildingCount + 1),
+    section<int>(h.MatrixTreeVerticesOffset, h.MatrixTreeCount),
+    section<int>(h.MatrixTreeParentsOffset, h.MatrixTreeCount));
+}
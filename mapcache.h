@@ -0,0 +1,81 @@
+// mapcache.h
+//
+// Declares the binary map cache: a compiled form of an .osm map that is memory-mapped at startup
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include "osm.h"
+#include "compactgraph.h"
+#include "matrix.h"
+
+using namespace std;
+
+
+//
+// mapCache
+//
+// A map file compiled ahead of time (application.exe --compile-map) holding everything startup would
+// otherwise rebuild from the XML: the CSR footway graph with its weights and component labels, the
+// position of every vertex, the footway nodes in first-appearance order, and the building table.
+// Graphs with collapsed chains keep their per-edge geometry in the cache as well, graphs with fixed point
+// weights keep them in fixed point, and a building distance
+// matrix, when one was built, is stored after everything else.
+// Every section is stored exactly as it is used in memory, so open() only maps the file and the
+// graph and coordinate views point straight into the mapping; nothing is parsed or copied per element.
+//
+// Layout: a fixed header (magic, version, counts, section offsets) followed by 8-byte aligned sections.
+// The file is written in native byte order and is only meant to be read back on the same platform.
+//
+class mapCache
+{
+private:
+  struct Header; // Defined in mapcache.cpp
+
+  struct BuildingRecord // One building, names are (offset, length) into the string section
+  {
+    long long ID;
+    double Lat;
+    double Lon;
+    uint64_t NameOffset, NameLength;
+    uint64_t AbbrevOffset, AbbrevLength;
+  };
+
+  void* mapping; // The mapped file, nullptr while closed
+  size_t mappingSize;
+  const Header* header;
+
+  template<typename T>
+  span<const T> section(uint64_t offset, uint64_t count) const;
+
+public:
+  mapCache();
+  ~mapCache();
+
+  mapCache(const mapCache&) = delete;
+  mapCache& operator=(const mapCache&) = delete;
+
+  static bool isCacheFile(const string& filename);
+
+  static bool write(const string& filename, int nodeCount, int footwayCount,
+         const compactGraph<long long, double>& G, span<const Coordinates> vertexCoords,
+         span<const Coordinates> footwayNodes, const vector<BuildingInfo>& Buildings, const buildingMatrix* matrix = nullptr);
+
+  bool open(const string& filename);
+  void close();
+
+  int NumNodes() const;
+  int NumFootways() const;
+
+  compactGraph<long long, double> graph() const;
+  span<const Coordinates> vertexCoords() const;
+  span<const Coordinates> footwayNodes() const;
+  vector<BuildingInfo> buildings() const;
+  buildingMatrix matrix() const;
+};
@@ -0,0 +1,273 @@
+// matrix.cpp
+//
+// Implements the building distance matrix
+//
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "matrix.h"
+#include "search.h"
+
+using namespace std;
+
+
+//
+// Constructor
+//
+// Empty matrix, holds no buildings
+//
+buildingMatrix::buildingMatrix()
+{
+  buildings = 0;
+  treeOffsetStore.push_back(0);
+  bindStorage();
+}
+
+
+//
+// Constructor
+//
+// View over arrays owned elsewhere (a mapped cache), which must outlive the matrix
+//
+buildingMatrix::buildingMatrix(int numBuildings, span<const int> buildingVertices, span<const double> distances,
+  span<const long long> treeOffsets, span<const int> treeVertices, span<const int> treeParents)
+{
+  buildings = numBuildings;
+  BuildingVertices = buildingVertices;
+  Distances = distances;
+  TreeOffsets = treeOffsets;
+  TreeVertices = treeVertices;
+  TreeParents = treeParents;
+}
+
+
+//
+// bindStorage
+//
+// Points the views at the owned arrays
+//
+void buildingMatrix::bindStorage()
+{
+  BuildingVertices = vertexStore;
+  Distances = distanceStore;
+  TreeOffsets = treeOffsetStore;
+  TreeVertices = treeVertexStore;
+  TreeParents = treeParentStore;
+}
+
+
+//
+// build
+//
+// Runs a shortest path tree from the node of every building (buildingNodes, by building index) on threadCount
+// threads and keeps each tree's distances and paths to the other buildings
+//
+buildingMatrix buildingMatrix::build(const compactGraph<long long, double>& G, span<const long long> buildingNodes, int threadCount)
+{
+  return compute(G, buildingNodes, nullptr, {}, threadCount);
+}
+
+
+//
+// rebuild
+//
+// Like build(), but copies every row of previous (a matrix over the same buildings on an earlier version of G) whose
+// staleRows entry is zero instead of running its tree again. Only right when those rows' distances and trees are
+// still shortest in G, which is up to the caller (overlay.cpp keeps the rows whose trees avoid every changed edge).
+//
+buildingMatrix buildingMatrix::rebuild(const compactGraph<long long, double>& G, span<const long long> buildingNodes,
+  const buildingMatrix& previous, span<const char> staleRows, int threadCount)
+{
+  return compute(G, buildingNodes, &previous, staleRows, threadCount);
+}
+
+
+//
+// compute
+//
+// Builds the matrix, running a tree for every row, or only for the stale rows when there is a previous matrix
+//
+buildingMatrix buildingMatrix::compute(const compactGraph<long long, double>& G, span<const long long> buildingNodes,
+  const buildingMatrix* previous, span<const char> staleRows, int threadCount)
+{
+  buildingMatrix matrix;
+  int B = static_cast<int>(buildingNodes.size());
+
+  matrix.buildings = B;
+  matrix.vertexStore.resize(B);
+  matrix.distanceStore.assign(static_cast<size_t>(B) * B, -1);
+
+  for (int i = 0; i < B; i++) {
+    matrix.vertexStore[i] = G.indexOf(buildingNodes[i]);
+  }
+
+  vector<vector<pair<int, int>>> trees(B); // Per row (vertex, parent), sorted by vertex
+  atomic<int> nextRow(0);
+
+  auto work = [&]() {
+    shortestPathTree<long long, double> tree(G);
+    vector<long long> path;
+
+    for (int row = nextRow++; row < B; row = nextRow++) {
+      if (previous != nullptr && !staleRows[row]) {
+        size_t first = static_cast<size_t>(row) * B;
+        copy(previous->Distances.begin() + first, previous->Distances.begin() + first + B, matrix.distanceStore.begin() + first);
+
+        for (long long k = previous->TreeOffsets[row]; k < previous->TreeOffsets[row + 1]; k++) {
+          trees[row].emplace_back(previous->TreeVertices[k], previous->TreeParents[k]);
+        }
+
+        continue;
+      }
+
+      map<int, int> parents;
+      tree.reset(buildingNodes[row]);
+
+      for (int col = 0; col < B; col++) {
+        path.clear();
+        double distance = tree.pathTo(buildingNodes[col], path);
+
+        if (distance == -1) {
+          continue;
+        }
+
+        matrix.distanceStore[static_cast<size_t>(row) * B + col] = distance;
+
+        for (size_t k = 0; k < path.size(); k++) { // path runs from the target back to the source
+          int v = G.indexOf(path[k]);
+
+          if (!parents.emplace(v, k + 1 < path.size() ? G.indexOf(path[k + 1]) : -1).second) {
+            break; // The rest of the way back is already in the tree
+          }
+        }
+      }
+
+      trees[row].assign(parents.begin(), parents.end());
+    }
+  };
+
+  vector<thread> workers;
+
+  for (int t = 1; t < min(max(1, threadCount), max(1, B)); t++) {
+    workers.emplace_back(work);
+  }
+
+  work();
+
+  for (thread& worker : workers) {
+    worker.join();
+  }
+
+  matrix.treeOffsetStore.assign(1, 0);
+
+  for (int row = 0; row < B; row++) {
+    for (const pair<int, int>& entry : trees[row]) {
+      matrix.treeVertexStore.push_back(entry.first);
+      matrix.treeParentStore.push_back(entry.second);
+    }
+
+    matrix.treeOffsetStore.push_back(static_cast<long long>(matrix.treeVertexStore.size()));
+  }
+
+  matrix.bindStorage();
+  return matrix;
+}
+
+
+//
+// empty / NumBuildings / NumTreeVertices
+//
+bool buildingMatrix::empty() const
+{
+  return buildings == 0;
+}
+
+int buildingMatrix::NumBuildings() const
+{
+  return buildings;
+}
+
+long long buildingMatrix::NumTreeVertices() const
+{
+  return static_cast<long long>(TreeVertices.size());
+}
+
+
+//
+// distance
+//
+// Shortest distance from building from to building to (indices into Buildings), -1 if unreachable
+//
+double buildingMatrix::distance(int from, int to) const
+{
+  return Distances[static_cast<size_t>(from) * buildings + to];
+}
+
+
+//
+// path
+//
+// Records the shortest path from building from to building to in the path vector, from to's node back to from's like
+// the search engines do, and returns its distance. Returns -1 if to is unreachable (path is left untouched in that case).
+//
+double buildingMatrix::path(const compactGraph<long long, double>& G, int from, int to, vector<long long>& path) const
+{
+  double total = distance(from, to);
+
+  if (total == -1) {
+    return -1;
+  }
+
+  const int* begin = TreeVertices.data() + TreeOffsets[from];
+  const int* end = TreeVertices.data() + TreeOffsets[from + 1];
+  long long steps = end - begin; // A path visits each tree vertex at most once
+
+  for (int v = BuildingVertices[to]; v != -1 && steps-- > 0; ) {
+    const int* found = lower_bound(begin, end, v);
+
+    if (found == end || *found != v) { // Only possible with a corrupt cache
+      break;
+    }
+
+    path.push_back(G.vertexAt(v));
+    v = TreeParents[found - TreeVertices.data()];
+  }
+
+  return total;
+}
+
+
+//
+// get* accessors
+//
+// The raw arrays, e.g. for writing them to a cache file
+//
+span<const int> buildingMatrix::getBuildingVertices() const
+{
+  return BuildingVertices;
+}
+
+span<const double> buildingMatrix::getDistances() const
+{
+  return Distances;
+}
+
+span<const long long> buildingMatrix::getTreeOffsets() const
+{
+  return TreeOffsets;
+}
+
+span<const int> buildingMatrix::getTreeVertices() const
+{
+  return TreeVertices;
+}
+
+span<const int> buildingMatrix::getTreeParents() const
+{
+  return TreeParents;
+}
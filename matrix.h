@@ -0,0 +1,77 @@
+// matrix.h
+//
+// Declares the building distance matrix: every building-to-building shortest path, precomputed
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <span>
+
+#include "compactgraph.h"
+
+using namespace std;
+
+
+//
+// buildingMatrix
+//
+// Queries only ever start and end at buildings snapped to their nearest footway node, so with B buildings
+// there are only B x B answers. build() runs one Dijkstra tree per building, in parallel, and keeps the
+// distance to every other building plus the part of the tree that leads to them: for each source building
+// the sorted dense indices of the tree's vertices and the parent of each (-1 at the root). Distances and
+// paths are exactly what shortestPathTree gives from the same source. rebuild() reruns only the rows a change
+// to the graph made stale and copies the rest from the matrix before it.
+//
+// Like compactGraph the arrays are either owned or borrowed from a mapped cache file.
+//
+class buildingMatrix
+{
+private:
+  int buildings;
+
+  vector<int> vertexStore; // Owned arrays, empty when borrowing
+  vector<double> distanceStore;
+  vector<long long> treeOffsetStore;
+  vector<int> treeVertexStore;
+  vector<int> treeParentStore;
+
+  span<const int> BuildingVertices; // Dense index of each building's node, -1 if it is not in the graph
+  span<const double> Distances;     // buildings x buildings, row = from, -1 where unreachable
+  span<const long long> TreeOffsets; // buildings + 1, tree of row r is TreeVertices[TreeOffsets[r] .. TreeOffsets[r + 1])
+  span<const int> TreeVertices;
+  span<const int> TreeParents; // Dense index of the parent of each TreeVertices entry
+
+  void bindStorage();
+
+  static buildingMatrix compute(const compactGraph<long long, double>& G, span<const long long> buildingNodes,
+    const buildingMatrix* previous, span<const char> staleRows, int threadCount);
+
+public:
+  buildingMatrix();
+  buildingMatrix(int numBuildings, span<const int> buildingVertices, span<const double> distances,
+    span<const long long> treeOffsets, span<const int> treeVertices, span<const int> treeParents);
+
+  buildingMatrix(const buildingMatrix&) = delete;
+  buildingMatrix& operator=(const buildingMatrix&) = delete;
+  buildingMatrix(buildingMatrix&&) = default; // Moving a vector keeps its buffer, so the views stay valid
+  buildingMatrix& operator=(buildingMatrix&&) = default;
+
+  static buildingMatrix build(const compactGraph<long long, double>& G, span<const long long> buildingNodes, int threadCount);
+  static buildingMatrix rebuild(const compactGraph<long long, double>& G, span<const long long> buildingNodes,
+    const buildingMatrix& previous, span<const char> staleRows, int threadCount);
+
+  bool empty() const;
+  int NumBuildings() const;
+  long long NumTreeVertices() const;
+
+  double distance(int from, int to) const;
+  double path(const compactGraph<long long, double>& G, int from, int to, vector<long long>& path) const;
+
+  span<const int> getBuildingVertices() const;
+  span<const double> getDistances() const;
+  span<const long long> getTreeOffsets() const;
+  span<const int> getTreeVertices() const;
+  span<const int> getTreeParents() const;
+};
@@ -0,0 +1,977 @@
+// meeting.cpp
+//
+// Implements the meeting point query, split out of the interactive application loop so that any number
+// of threads can answer queries over one shared, immutable map
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <limits>
+
+#include "dist.h"
+#include "meeting.h"
+
+using namespace std;
+
+
+//
+// getClosestNode
+//
+// Returns the Coordinates struct of the footway node that is closest to the building parameter
+// FootwayNodes is a spatial index over every footway node, so only the few grid cells around the building are scanned
+//
+Coordinates getClosestNode(const spatialGrid& FootwayNodes, const BuildingInfo& building)
+{
+  int closest = FootwayNodes.nearest(building.Coords.Lat, building.Coords.Lon);
+
+  return FootwayNodes.point(closest); // Returns the Coordinates struct of the minimum node
+}
+
+
+//
+// getCenterBuildingIndex
+//
+// Returns index of the next building in Buildings closest to the midpoint that candidates walks outward from, skipping any in invalidCenters
+// candidates is a cursor over the BuildingCenters spatial index, so each call only looks at the grid cells it needs and a fallback just takes the next one
+// If component is not -1, buildings whose nearest footway node lies in another connected component (buildingComponents) are skipped up front
+// Returns -1 once every building has been tried
+//
+static int getCenterBuildingIndex(spatialGrid::cursor& candidates, const vector<BuildingInfo>& Buildings, const set<string>& invalidCenters,
+  const vector<int>& buildingComponents, int component)
+{
+  profileTimer timer(profileStage::CENTER);
+  int index = candidates.next(); // Point indices in BuildingCenters are indices into Buildings
+
+  while (index != -1) {
+    if (invalidCenters.count(Buildings.at(index).Fullname)) { // Count returns 1 if this Building's name is present in the invalidCenters set
+      index = candidates.next(); // Skip this building and move on to the next
+    }
+    else if (component != -1 && buildingComponents.at(index) != component) { // Nobody could walk there, skip it too
+      index = candidates.next();
+    }
+    else {
+      break;
+    }
+  }
+
+  return index; // Return index of closest building
+}
+
+
+//
+// MeetingPointMap
+//
+// Snaps every building to its nearest footway node once, and labels it with that node's component so center candidates can be
+// filtered without searching
+//
+MeetingPointMap::MeetingPointMap(const vector<BuildingInfo>& Buildings, const spatialGrid& FootwayNodes, const spatialGrid& BuildingCenters,
+  const compactGraph<long long, double>& G, span<const Coordinates> vertexCoords, searchMode mode,
+  const contractionHierarchy<long long, double>* CH, const buildingMatrix* Matrix, meetingObjective objective, size_t cacheCapacity)
+  : Buildings(Buildings), Names(Buildings), FootwayNodes(FootwayNodes), BuildingCenters(BuildingCenters), G(G), vertexCoords(vertexCoords),
+    mode(mode), CH(CH), Matrix((Matrix != nullptr && !Matrix->empty()) ? Matrix : nullptr), objective(objective),
+    Results(cacheCapacity)
+{
+  VertexBuilding.assign(G.NumVertices(), -1);
+
+  for (int i = 0; i < static_cast<int>(Buildings.size()); i++) {
+    BuildingNodes.push_back(getClosestNode(FootwayNodes, Buildings[i]));
+
+    int v = G.indexOf(BuildingNodes.back().ID);
+    BuildingComponents.push_back(v == -1 ? -1 : G.componentOf(v)); // -1 when no footway node is a vertex, never reachable
+
+    if (v != -1 && VertexBuilding[v] == -1) {
+      VertexBuilding[v] = i;
+    }
+  }
+}
+
+
+//
+// resultKey
+//
+// Cache key of a query between two resolved buildings. Order matters, person 1's path and distance come first.
+//
+long long MeetingPointMap::resultKey(int firstIndex, int secondIndex)
+{
+  return (static_cast<long long>(firstIndex) << 32) | static_cast<unsigned int>(secondIndex);
+}
+
+
+//
+// MeetingPointQuery
+//
+// Sizes this query object's own search state for the map's graph
+//
+MeetingPointQuery::MeetingPointQuery(const MeetingPointMap& map)
+  : Map(&map), engine(map.G, map.vertexCoords), tree1(map.G), tree2(map.G), settledCount(0)
+{
+  if (map.CH != nullptr) {
+    chContext = contractionHierarchy<long long, double>::queryContext(*map.CH);
+  }
+}
+
+
+//
+// routeFrom
+//
+// Shortest path from the tree's source to `to` recorded into path. Dijkstra answers straight from the kept-alive tree,
+// the point-to-point engines (A*, bidirectional A*, contraction hierarchy) search again for every target.
+// On a graph with collapsed chains the path is expanded back into every footway node it passes.
+//
+double MeetingPointQuery::routeFrom(shortestPathTree<long long, double>& tree, long long to, vector<long long>& path)
+{
+  double distance;
+
+  if (Map->CH != nullptr) {
+    distance = Map->CH->shortestPath(chContext, tree.source(), to, path);
+    settledCount += chContext.settled();
+  }
+  else if (Map->mode != searchMode::DIJKSTRA) {
+    distance = engine.shortestPath(Map->mode, tree.source(), to, path);
+    settledCount += engine.settled();
+  }
+  else {
+    distance = tree.pathTo(to, path);
+  }
+
+  Map->G.expandPath(path);
+  return distance;
+}
+
+
+//
+// routeBetween
+//
+// Same as routeFrom for a route between two buildings (indices into Buildings, the tree is fromBuilding's and toNode
+// is toBuilding's node), which the distance matrix answers with a lookup when there is one
+//
+double MeetingPointQuery::routeBetween(shortestPathTree<long long, double>& tree, int fromBuilding, int toBuilding, long long toNode,
+  vector<long long>& path)
+{
+  if (Map->Matrix == nullptr) {
+    return routeFrom(tree, toNode, path);
+  }
+
+  double distance = Map->Matrix->path(Map->G, fromBuilding, toBuilding, path);
+
+  Map->G.expandPath(path);
+  return distance;
+}
+
+
+//
+// find
+//
+// Runs one query: looks both buildings up and answers from the map's result cache if this pair was asked recently,
+// otherwise solves it (and caches the answer)
+//
+MeetingPointResult MeetingPointQuery::find(const string& person1Building, const string& person2Building)
+{
+  MeetingPointResult result;
+
+  startProfile();
+  {
+    profileTimer timer(profileStage::QUERY);
+    answer(person1Building, person2Building, result);
+  }
+  finishProfile();
+
+  return result;
+}
+
+
+//
+// answer
+//
+// The body of find(), which times it
+//
+void MeetingPointQuery::answer(const string& person1Building, const string& person2Building, MeetingPointResult& result)
+{
+  settledCount = 0;
+
+  // FIND BUILDINGS 1 AND 2 -----------------------------------------------------------------------
+  int firstIndex, secondIndex;
+  {
+    profileTimer timer(profileStage::LOOKUP);
+    firstIndex = Map->Names.search(person1Building); // Abbreviations first, then full names, like it always matched
+    secondIndex = Map->Names.search(person2Building);
+  }
+
+  if (firstIndex == -1) {
+    result.Status = MeetingPointResult::PERSON1_NOT_FOUND;
+    return;
+  }
+
+  if (secondIndex == -1) {
+    result.Status = MeetingPointResult::PERSON2_NOT_FOUND;
+    return;
+  }
+
+  long long key = MeetingPointMap::resultKey(firstIndex, secondIndex);
+
+  if (shared_ptr<const MeetingPointResult> cached = Map->Results.find(key)) { // Skips snapping and every search
+    profileCount(profileCounter::CACHE_HITS);
+    result = *cached;
+    return;
+  }
+
+  if (Map->Results.enabled()) {
+    profileCount(profileCounter::CACHE_MISSES);
+  }
+
+  long long treesSettled = tree1.settledTotal() + tree2.settledTotal();
+  solve(firstIndex, secondIndex, result);
+  settledCount += tree1.settledTotal() + tree2.settledTotal() - treesSettled;
+
+  if (Map->Results.enabled()) {
+    Map->Results.insert(key, make_shared<const MeetingPointResult>(result));
+  }
+}
+
+
+//
+// startProfile / finishProfile
+//
+// Clear this thread's profile before a query, then keep it as the query's profile and add it to the map's histograms.
+// Nothing at all without ROUTING_PROFILE.
+//
+void MeetingPointQuery::startProfile()
+{
+  if constexpr (PROFILING) {
+    currentProfile.clear();
+  }
+}
+
+void MeetingPointQuery::finishProfile()
+{
+  if constexpr (PROFILING) {
+    lastProfile = currentProfile;
+    Map->Profile.add(lastProfile);
+  }
+}
+
+
+//
+// solve
+//
+// Answers a query between two resolved buildings: snaps them to the network, then walks the buildings outward from
+// their midpoint until one is reachable by both people (or runs the optimal meeting point search)
+//
+void MeetingPointQuery::solve(int firstIndex, int secondIndex, MeetingPointResult& result)
+{
+  const vector<BuildingInfo>& Buildings = Map->Buildings;
+  const compactGraph<long long, double>& G = Map->G;
+
+  result.Person1 = Buildings.at(firstIndex);
+  result.Person2 = Buildings.at(secondIndex);
+
+  // Snap both people to the footway network now, so we know which component a center has to be in
+  result.Person1Node = Map->BuildingNodes.at(firstIndex);
+  result.Person2Node = Map->BuildingNodes.at(secondIndex);
+
+  // Different components (or no matrix entry) means no path from 1 to 2, no search needed
+  bool reachable = Map->Matrix ? Map->Matrix->distance(firstIndex, secondIndex) != -1 : G.connected(result.Person1Node.ID, result.Person2Node.ID);
+  int sharedComponent = reachable ? G.componentOf(G.indexOf(result.Person1Node.ID)) : -1;
+
+  if (Map->objective != meetingObjective::MIDPOINT && reachable) { // Unreachable pairs still report the midpoint building below
+    profileTimer timer(profileStage::SEARCH);
+    findOptimal(firstIndex, secondIndex, result);
+    return;
+  }
+
+  // GET THE MIDPOINT BETWEEN BUILDINGS 1 AND 2 AND FIND CLOSEST BUILDING (CENTER) ----------------
+  Coordinates midpoint = centerBetween2Points(result.Person1.Coords.Lat, result.Person1.Coords.Lon,
+                            result.Person2.Coords.Lat, result.Person2.Coords.Lon);
+
+  spatialGrid::cursor centerCandidates = Map->BuildingCenters.byDistance(midpoint.Lat, midpoint.Lon); // Buildings in increasing distance from the midpoint
+  set<string> invalidCenters; // Centers found unreachable, skipped by getCenterBuildingIndex
+
+  int centerIndex = getCenterBuildingIndex(centerCandidates, Buildings, invalidCenters, Map->BuildingComponents, sharedComponent);
+
+  if (centerIndex == -1) { // Only possible if there are no buildings to choose from
+    result.Status = MeetingPointResult::NO_DESTINATION;
+    return;
+  }
+
+  result.Destinations.push_back(Buildings.at(centerIndex));
+  result.DestinationNodes.push_back(Map->BuildingNodes.at(centerIndex));
+
+  if (!reachable) { // Checks if there is a valid path from 1 to 2 with the component labels, before running any search
+    result.Status = MeetingPointResult::UNREACHABLE;
+    return;
+  }
+
+  // SHORTEST PATHS, FALLING BACK TO THE NEXT CLOSEST BUILDING ------------------------------------
+  tree1.reset(result.Person1Node.ID); // New sources, so start two fresh search trees
+  tree2.reset(result.Person2Node.ID);
+
+  while (true) {
+    vector<long long> path1;
+    vector<long long> path2;
+
+    long long centerID = result.DestinationNodes.back().ID;
+    double totalDistance1, totalDistance2;
+    {
+      profileTimer timer(profileStage::SEARCH);
+      totalDistance1 = routeBetween(tree1, firstIndex, centerIndex, centerID, path1);
+      totalDistance2 = routeBetween(tree2, secondIndex, centerIndex, centerID, path2);
+    }
+
+    if (totalDistance1 != -1 && totalDistance2 != -1) {
+      reverse(path1.begin(), path1.end()); // Engines record paths from the target back
+      reverse(path2.begin(), path2.end());
+
+      result.Status = MeetingPointResult::FOUND;
+      result.Distance1 = totalDistance1;
+      result.Distance2 = totalDistance2;
+      result.Path1 = move(path1);
+      result.Path2 = move(path2);
+      return;
+    }
+
+    invalidCenters.insert(result.Destinations.back().Fullname); // So we don't use it next time
+    profileCount(profileCounter::FALLBACKS);
+
+    centerIndex = getCenterBuildingIndex(centerCandidates, Buildings, invalidCenters, Map->BuildingComponents, sharedComponent);
+
+    if (centerIndex == -1) { // No buildings left to choose
+      result.Status = MeetingPointResult::DESTINATIONS_EXHAUSTED;
+      return;
+    }
+
+    result.Destinations.push_back(Buildings.at(centerIndex));
+    result.DestinationNodes.push_back(Map->BuildingNodes.at(centerIndex));
+  }
+}
+
+
+//
+// findOptimal
+//
+// Picks the building that minimizes the objective over both people's network distances, for two people known to be
+// connected. Ties (every building along the path between the two has the same sum) go to the building that is best by
+// the other objective, then to the lowest building index; costs within TIE_MILES count as equal, so rounding in summed
+// edge weights does not decide. With a distance matrix that is a scan of two rows; otherwise both
+// search trees grow in lockstep (always the one with the nearer frontier) and stop as soon as nothing unsettled can
+// beat the best building settled by both. A building settled by only one tree still gets a bound from the other
+// tree's frontier, so the search usually ends long before either tree covers the map.
+//
+void MeetingPointQuery::findOptimal(int firstIndex, int secondIndex, MeetingPointResult& result)
+{
+  const double INF = numeric_limits<double>::max();
+  const double TIE_MILES = 1e-9;
+  bool minMax = Map->objective == meetingObjective::MIN_MAX;
+
+  auto cost = [&](double d1, double d2) {
+    return minMax ? max(d1, d2) : d1 + d2; // INF stays INF (or inf) either way
+  };
+
+  int best = -1;
+  double bestCost = INF;
+  double bestTie = INF; // The other objective's cost of best
+
+  auto consider = [&](int building, double d1, double d2) {
+    double c = cost(d1, d2);
+    double tie = minMax ? d1 + d2 : max(d1, d2);
+
+    if (c > bestCost + TIE_MILES || (c >= bestCost - TIE_MILES && (tie > bestTie + TIE_MILES
+        || (tie >= bestTie - TIE_MILES && building > best)))) {
+      return;
+    }
+
+    best = building;
+    bestCost = c;
+    bestTie = tie;
+  };
+
+  if (Map->Matrix != nullptr) {
+    for (int j = 0; j < static_cast<int>(Map->Buildings.size()); j++) {
+      double d1 = Map->Matrix->distance(firstIndex, j);
+      double d2 = Map->Matrix->distance(secondIndex, j);
+
+      if (d1 != -1 && d2 != -1) {
+        consider(j, d1, d2);
+      }
+    }
+  }
+  else {
+    tree1.reset(result.Person1Node.ID);
+    tree2.reset(result.Person2Node.ID);
+
+    vector<int> only1, only2; // Building vertices settled by one tree but not (when added) the other, in settle order
+    size_t next1 = 0, next2 = 0; // First entries that may still be unsettled by the other tree
+
+    while (true) {
+      while (next1 < only1.size() && tree2.hasSettled(only1[next1])) {
+        next1++;
+      }
+
+      while (next2 < only2.size() && tree1.hasSettled(only2[next2])) {
+        next2++;
+      }
+
+      // Lower bound on the cost of every building vertex not settled by both trees yet
+      double r1 = tree1.frontier();
+      double r2 = tree2.frontier();
+      double bound = cost(r1, r2);
+
+      if (next1 < only1.size()) {
+        bound = min(bound, cost(tree1.distanceAt(only1[next1]), r2));
+      }
+
+      if (next2 < only2.size()) {
+        bound = min(bound, cost(r1, tree2.distanceAt(only2[next2])));
+      }
+
+      if ((best != -1 && bound > bestCost + TIE_MILES) || (r1 == INF && r2 == INF)) { // Every tie has been seen by then
+        break;
+      }
+
+      bool first = r1 <= r2;
+      shortestPathTree<long long, double>& grown = first ? tree1 : tree2;
+      shortestPathTree<long long, double>& other = first ? tree2 : tree1;
+
+      int v = grown.settleNext();
+      int building = Map->VertexBuilding[v];
+
+      if (building == -1) {
+        continue;
+      }
+
+      if (other.hasSettled(v)) {
+        consider(building, tree1.distanceAt(v), tree2.distanceAt(v));
+      }
+      else {
+        (first ? only1 : only2).push_back(v);
+      }
+    }
+  }
+
+  if (best == -1) { // Can't happen for connected people, each stands on a building node
+    result.Status = MeetingPointResult::DESTINATIONS_EXHAUSTED;
+    return;
+  }
+
+  result.Destinations.push_back(Map->Buildings.at(best));
+  result.DestinationNodes.push_back(Map->BuildingNodes.at(best));
+
+  vector<long long> path1;
+  vector<long long> path2;
+  long long centerID = result.DestinationNodes.back().ID;
+
+  if (Map->Matrix != nullptr) {
+    result.Distance1 = routeBetween(tree1, firstIndex, best, centerID, path1);
+    result.Distance2 = routeBetween(tree2, secondIndex, best, centerID, path2);
+  }
+  else { // Both trees have settled the destination, so these only walk back the predecessors
+    result.Distance1 = tree1.pathTo(centerID, path1);
+    result.Distance2 = tree2.pathTo(centerID, path2);
+    Map->G.expandPath(path1);
+    Map->G.expandPath(path2);
+  }
+
+  reverse(path1.begin(), path1.end()); // Paths run from each person to the destination
+  reverse(path2.begin(), path2.end());
+
+  result.Status = MeetingPointResult::FOUND;
+  result.Path1 = move(path1);
+  result.Path2 = move(path2);
+}
+
+
+//
+// route
+//
+// Point-to-point query: looks both buildings up, snaps them to the network and finds the shortest path between them
+//
+RouteResult MeetingPointQuery::route(const string& fromBuilding, const string& toBuilding)
+{
+  RouteResult result;
+
+  startProfile();
+  {
+    profileTimer timer(profileStage::QUERY);
+    answerRoute(fromBuilding, toBuilding, result);
+  }
+  finishProfile();
+
+  return result;
+}
+
+
+//
+// answerRoute
+//
+// The body of route(), which times it
+//
+void MeetingPointQuery::answerRoute(const string& fromBuilding, const string& toBuilding, RouteResult& result)
+{
+  const vector<BuildingInfo>& Buildings = Map->Buildings;
+  settledCount = 0;
+
+  int fromIndex, toIndex;
+  {
+    profileTimer timer(profileStage::LOOKUP);
+    fromIndex = Map->Names.search(fromBuilding);
+    toIndex = Map->Names.search(toBuilding);
+  }
+
+  if (fromIndex == -1) {
+    result.Status = RouteResult::FROM_NOT_FOUND;
+    return;
+  }
+
+  if (toIndex == -1) {
+    result.Status = RouteResult::TO_NOT_FOUND;
+    return;
+  }
+
+  result.From = Buildings.at(fromIndex);
+  result.To = Buildings.at(toIndex);
+  result.FromNode = Map->BuildingNodes.at(fromIndex);
+  result.ToNode = Map->BuildingNodes.at(toIndex);
+
+  if (!Map->G.connected(result.FromNode.ID, result.ToNode.ID)) { // No search needed to know there is no path
+    result.Status = RouteResult::UNREACHABLE;
+    return;
+  }
+
+  long long treeSettled = tree1.settledTotal();
+  {
+    profileTimer timer(profileStage::SEARCH);
+    tree1.reset(result.FromNode.ID);
+    result.Distance = routeBetween(tree1, fromIndex, toIndex, result.ToNode.ID, result.Path);
+  }
+  settledCount += tree1.settledTotal() - treeSettled;
+
+  if (result.Distance == -1) {
+    result.Status = RouteResult::UNREACHABLE;
+    result.Path.clear();
+    return;
+  }
+
+  reverse(result.Path.begin(), result.Path.end()); // Engines record paths from the target back
+  result.Status = RouteResult::FOUND;
+}
+
+
+//
+// settled
+//
+// # of vertices settled by every search the last find() or route() ran, 0 if it was answered without searching
+//
+long long MeetingPointQuery::settled() const
+{
+  return settledCount;
+}
+
+
+//
+// profile
+//
+// Counters and stage times of the last find() or route(), all zero without ROUTING_PROFILE
+//
+const queryProfile& MeetingPointQuery::profile() const
+{
+  return lastProfile;
+}
+
+
+//
+// MeetingPointPool
+//
+// Starts threadCount workers, each building its own query object on its own thread
+//
+MeetingPointPool::MeetingPointPool(const MeetingPointMap& map, int threadCount)
+  : Map(&map), stopping(false)
+{
+  for (int t = 0; t < max(1, threadCount); t++) {
+    workers.emplace_back(&MeetingPointPool::work, this);
+  }
+}
+
+MeetingPointPool::MeetingPointPool(mapSource source, int threadCount)
+  : Map(nullptr), Source(move(source)), stopping(false)
+{
+  for (int t = 0; t < max(1, threadCount); t++) {
+    workers.emplace_back(&MeetingPointPool::work, this);
+  }
+}
+
+MeetingPointPool::~MeetingPointPool()
+{
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+
+  jobReady.notify_all();
+
+  for (thread& worker : workers) {
+    worker.join();
+  }
+}
+
+int MeetingPointPool::NumThreads() const
+{
+  return static_cast<int>(workers.size());
+}
+
+
+//
+// work
+//
+// Worker loop: run queued jobs with this worker's query object until the pool stops and the queue is empty.
+// With a map source the query object is remade whenever the source hands out a new map.
+//
+void MeetingPointPool::work()
+{
+  shared_ptr<const MeetingPointMap> current = Source ? Source() : nullptr; // Keeps the map alive while the query uses it
+  optional<MeetingPointQuery> query;
+  query.emplace(current ? *current : *Map);
+
+  while (true) {
+    job task;
+
+    {
+      unique_lock<mutex> guard(lock);
+      jobReady.wait(guard, [&]() { return stopping || !jobs.empty(); });
+
+      if (jobs.empty()) { // Only when stopping
+        return;
+      }
+
+      task = move(jobs.front());
+      jobs.pop_front();
+    }
+
+    if (Source) {
+      shared_ptr<const MeetingPointMap> latest = Source();
+
+      if (latest != current) {
+        query.emplace(*latest);
+        current = move(latest);
+      }
+    }
+
+    task(*query);
+  }
+}
+
+
+//
+// submit
+//
+// Queues task to run on the next free worker. The task must not block on other jobs of this pool.
+//
+void MeetingPointPool::submit(job task)
+{
+  {
+    lock_guard<mutex> guard(lock);
+    jobs.push_back(move(task));
+  }
+
+  jobReady.notify_one();
+}
+
+
+//
+// run
+//
+// Answers every request in the batch and returns the results in request order. One job per worker takes
+// requests off a shared counter, so a slow query never holds up the rest of a worker's share.
+//
+vector<MeetingPointResult> MeetingPointPool::run(const vector<MeetingPointRequest>& requests)
+{
+  vector<MeetingPointResult> answers(requests.size());
+  atomic<size_t> nextRequest(0);
+
+  mutex doneLock;
+  condition_variable allDone;
+  int busyJobs = NumThreads();
+
+  for (int t = 0; t < NumThreads(); t++) {
+    submit([&](MeetingPointQuery& query) {
+      for (size_t i = nextRequest++; i < requests.size(); i = nextRequest++) {
+        answers[i] = query.find(requests[i].Person1, requests[i].Person2);
+      }
+
+      lock_guard<mutex> guard(doneLock);
+
+      if (--busyJobs == 0) {
+        allDone.notify_all();
+      }
+    });
+  }
+
+  unique_lock<mutex> guard(doneLock);
+  allDone.wait(guard, [&]() { return busyJobs == 0; });
+
+  return answers;
+}
+
+
+//
+// statusName
+//
+// Short machine readable name of a result status, as written by writeResult
+//
+const char* statusName(MeetingPointResult::statusType status)
+{
+  switch (status) {
+    case MeetingPointResult::FOUND:                  return "ok";
+    case MeetingPointResult::PERSON1_NOT_FOUND:      return "person1_not_found";
+    case MeetingPointResult::PERSON2_NOT_FOUND:      return "person2_not_found";
+    case MeetingPointResult::NO_DESTINATION:         return "no_destination";
+    case MeetingPointResult::UNREACHABLE:            return "unreachable";
+    case MeetingPointResult::DESTINATIONS_EXHAUSTED: return "destinations_exhausted";
+  }
+
+  return "unknown";
+}
+
+
+//
+// writeTSVField / writeJSONString
+//
+// Building names come from the map and the request, so keep them from breaking the line format: tabs and
+// line breaks become spaces in TSV, JSON strings are escaped
+//
+static void writeTSVField(ostream& out, const string& field)
+{
+  for (char c : field) {
+    out << ((c == '\t' || c == '\n' || c == '\r') ? ' ' : c);
+  }
+}
+
+void writeJSONString(ostream& out, const string& value)
+{
+  static const char* HEX = "0123456789abcdef";
+
+  out << '"';
+
+  for (char c : value) {
+    unsigned char u = static_cast<unsigned char>(c);
+
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    }
+    else if (c == '\n') {
+      out << "\\n";
+    }
+    else if (c == '\t') {
+      out << "\\t";
+    }
+    else if (c == '\r') {
+      out << "\\r";
+    }
+    else if (u < 0x20) {
+      out << "\\u00" << HEX[u >> 4] << HEX[u & 0xF];
+    }
+    else {
+      out << c;
+    }
+  }
+
+  out << '"';
+}
+
+//
+// writePath
+//
+// Node IDs of path joined by separator
+//
+static void writePath(ostream& out, const vector<long long>& path, char separator)
+{
+  for (size_t i = 0; i < path.size(); i++) {
+    if (i > 0) {
+      out << separator;
+    }
+
+    out << path[i];
+  }
+}
+
+
+//
+// routeStatusName
+//
+// Same as statusName, for route results
+//
+static const char* routeStatusName(RouteResult::statusType status)
+{
+  switch (status) {
+    case RouteResult::FOUND:          return "ok";
+    case RouteResult::FROM_NOT_FOUND: return "from_not_found";
+    case RouteResult::TO_NOT_FOUND:   return "to_not_found";
+    case RouteResult::UNREACHABLE:    return "unreachable";
+  }
+
+  return "unknown";
+}
+
+
+//
+// writeResultHeader
+//
+// Column names line for TSV output, nothing for JSON
+//
+void writeResultHeader(ostream& out, resultFormat format)
+{
+  if (format == resultFormat::TSV) {
+    out << "person1\tperson2\tstatus\tdestination\tdestination_node\tdistance1\tdistance2\tpath1\tpath2\n";
+  }
+}
+
+
+//
+// writeResult
+//
+// One line for the request and its result. The destination is the building the people meet at (the last one
+// tried), it is left empty, like the distances and paths, unless the status is ok. Never flushes, so batches
+// of results go out in large writes.
+//
+void writeResult(ostream& out, resultFormat format, const MeetingPointRequest& request, const MeetingPointResult& result)
+{
+  bool found = result.Status == MeetingPointResult::FOUND;
+
+  if (format == resultFormat::TSV) {
+    writeTSVField(out, request.Person1);
+    out << '\t';
+    writeTSVField(out, request.Person2);
+    out << '\t' << statusName(result.Status) << '\t';
+
+    if (found) {
+      writeTSVField(out, result.Destinations.back().Fullname);
+      out << '\t' << result.DestinationNodes.back().ID << '\t' << result.Distance1 << '\t' << result.Distance2 << '\t';
+      writePath(out, result.Path1, ',');
+      out << '\t';
+      writePath(out, result.Path2, ',');
+    }
+    else {
+      out << "\t\t\t\t\t";
+    }
+
+    out << '\n';
+    return;
+  }
+
+  out << "{\"person1\":";
+  writeJSONString(out, request.Person1);
+  out << ",\"person2\":";
+  writeJSONString(out, request.Person2);
+  out << ",\"status\":\"" << statusName(result.Status) << '"';
+
+  if (found) {
+    out << ",\"destination\":";
+    writeJSONString(out, result.Destinations.back().Fullname);
+    out << ",\"destination_node\":" << result.DestinationNodes.back().ID
+        << ",\"distance1\":" << result.Distance1 << ",\"distance2\":" << result.Distance2 << ",\"path1\":[";
+    writePath(out, result.Path1, ',');
+    out << "],\"path2\":[";
+    writePath(out, result.Path2, ',');
+    out << ']';
+  }
+
+  out << "}\n";
+}
+
+
+//
+// writeRoute
+//
+// One line for a route request (Person1 is the start, Person2 the end) and its result: TSV columns are from, to,
+// status, distance and path, JSON has the same fields. Never flushes.
+//
+void writeRoute(ostream& out, resultFormat format, const MeetingPointRequest& request, const RouteResult& result)
+{
+  bool found = result.Status == RouteResult::FOUND;
+
+  if (format == resultFormat::TSV) {
+    writeTSVField(out, request.Person1);
+    out << '\t';
+    writeTSVField(out, request.Person2);
+    out << '\t' << routeStatusName(result.Status) << '\t';
+
+    if (found) {
+      out << result.Distance << '\t';
+      writePath(out, result.Path, ',');
+    }
+    else {
+      out << '\t';
+    }
+
+    out << '\n';
+    return;
+  }
+
+  out << "{\"from\":";
+  writeJSONString(out, request.Person1);
+  out << ",\"to\":";
+  writeJSONString(out, request.Person2);
+  out << ",\"status\":\"" << routeStatusName(result.Status) << '"';
+
+  if (found) {
+    out << ",\"distance\":" << result.Distance << ",\"path\":[";
+    writePath(out, result.Path, ',');
+    out << ']';
+  }
+
+  out << "}\n";
+}
+
+
+//
+// writeError
+//
+// One line reporting a request that could not be answered at all, e.g. a malformed server request
+//
+void writeError(ostream& out, resultFormat format, const string& message)
+{
+  if (format == resultFormat::TSV) {
+    out << "error\t";
+    writeTSVField(out, message);
+    out << '\n';
+    return;
+  }
+
+  out << "{\"status\":\"error\",\"message\":";
+  writeJSONString(out, message);
+  out << "}\n";
+}
+
+
+//
+// writeCacheStats
+//
+// One line with the map's result cache counters: hits, misses and entries held
+//
+void writeCacheStats(ostream& out, resultFormat format, const MeetingPointMap& map)
+{
+  if (format == resultFormat::TSV) {
+    out << "cache\t" << map.Results.hits() << '\t' << map.Results.misses() << '\t' << map.Results.size() << '\n';
+    return;
+  }
+
+  out << "{\"status\":\"ok\",\"cache_hits\":" << map.Results.hits() << ",\"cache_misses\":" << map.Results.misses()
+      << ",\"cache_entries\":" << map.Results.size() << "}\n";
+}
+
+
+//
+// writeProfile
+//
+// One line with the map's query profile histograms, see profileHistogram
+//
+void writeProfile(ostream& out, resultFormat format, const MeetingPointMap& map)
+{
+  if (format == resultFormat::TSV) {
+    map.Profile.writeTSV(out);
+  }
+  else {
+    map.Profile.writeJSON(out);
+  }
+}
@@ -0,0 +1,264 @@
+// meeting.h
+//
+// Declares the meeting point query: from two buildings, find the building closest to their midpoint that
+// both people can walk to, and the shortest footway path of each person to it
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include "osm.h"
+#include "compactgraph.h"
+#include "search.h"
+#include "ch.h"
+#include "spatial.h"
+#include "matrix.h"
+#include "nameindex.h"
+#include "lrucache.h"
+#include "instrument.h"
+
+using namespace std;
+
+
+Coordinates getClosestNode(const spatialGrid& FootwayNodes, const BuildingInfo& building);
+
+struct MeetingPointResult;
+
+
+// Which building the people meet at: the one nearest to the midpoint between them that both can reach (the
+// original behavior), or the one that minimizes the longer of the two walks, or their total length
+enum class meetingObjective { MIDPOINT, MIN_MAX, MIN_SUM };
+
+
+//
+// MeetingPointMap
+//
+// Everything queries read and nobody writes: the buildings, the spatial indices, the frozen footway graph
+// and the engine to search it with. One map is shared by every MeetingPointQuery, on any number of threads.
+// With a building distance matrix every route is looked up in it instead of searched, whatever the engine.
+// The one mutable part is the result cache, which is internally locked and belongs to the map, so a map
+// built over reloaded data always starts with an empty cache.
+// The map only refers to the data passed in, which must outlive it.
+//
+class MeetingPointMap
+{
+public:
+  MeetingPointMap(const vector<BuildingInfo>& Buildings, const spatialGrid& FootwayNodes, const spatialGrid& BuildingCenters,
+    const compactGraph<long long, double>& G, span<const Coordinates> vertexCoords, searchMode mode,
+    const contractionHierarchy<long long, double>* CH, const buildingMatrix* Matrix = nullptr,
+    meetingObjective objective = meetingObjective::MIDPOINT, size_t cacheCapacity = 0);
+
+  const vector<BuildingInfo>& Buildings;
+  nameIndex Names; // For looking buildings up by partial name or abbreviation
+  const spatialGrid& FootwayNodes;    // For snapping buildings to the network
+  const spatialGrid& BuildingCenters; // For picking the meeting building
+  const compactGraph<long long, double>& G;
+  span<const Coordinates> vertexCoords; // Position of each vertex by dense index, used by the A* heuristics
+  searchMode mode;
+  const contractionHierarchy<long long, double>* CH; // Used instead of mode when not nullptr
+  const buildingMatrix* Matrix; // Used instead of any search when not nullptr
+  meetingObjective objective;
+
+  vector<Coordinates> BuildingNodes; // Each building's nearest footway node
+  vector<int> BuildingComponents; // Connected component of each building's nearest footway node
+  vector<int> VertexBuilding; // Dense vertex --> lowest index of a building snapped to it, -1 if none
+
+  // Results of recent queries by (person 1's, person 2's) building index, see resultKey(). Disabled when
+  // built with capacity 0.
+  mutable lruCache<long long, MeetingPointResult> Results;
+
+  // Every query's counters and stage times, folded into histograms. Only filled when built with ROUTING_PROFILE.
+  mutable profileHistogram Profile;
+
+  static long long resultKey(int firstIndex, int secondIndex);
+};
+
+
+//
+// MeetingPointResult
+//
+// The outcome of one query, with everything needed to report it. Destinations lists the center building
+// first and then every fallback tried after it, in order; when Status is FOUND the last one is where the
+// people meet. Paths run from each person's node to the destination node.
+//
+struct MeetingPointResult
+{
+  enum statusType
+  {
+    FOUND,
+    PERSON1_NOT_FOUND,
+    PERSON2_NOT_FOUND,
+    NO_DESTINATION,        // No building to choose from at all
+    UNREACHABLE,           // The two people are in different components of the network
+    DESTINATIONS_EXHAUSTED // Every building was tried, none is reachable by both
+  };
+
+  statusType Status;
+
+  BuildingInfo Person1, Person2;
+  Coordinates Person1Node, Person2Node;
+
+  vector<BuildingInfo> Destinations;
+  vector<Coordinates> DestinationNodes;
+
+  double Distance1, Distance2;
+  vector<long long> Path1, Path2;
+
+  MeetingPointResult() : Status(FOUND), Distance1(-1), Distance2(-1) {}
+};
+
+
+//
+// MeetingPointRequest
+//
+// One query: both people's buildings as partial names or abbreviations
+//
+struct MeetingPointRequest
+{
+  string Person1;
+  string Person2;
+};
+
+
+//
+// RouteResult
+//
+// The outcome of a point-to-point route between two buildings, snapped to their nearest footway nodes.
+// The path runs from the first building's node to the second's.
+//
+struct RouteResult
+{
+  enum statusType
+  {
+    FOUND,
+    FROM_NOT_FOUND,
+    TO_NOT_FOUND,
+    UNREACHABLE
+  };
+
+  statusType Status;
+
+  BuildingInfo From, To;
+  Coordinates FromNode, ToNode;
+
+  double Distance;
+  vector<long long> Path;
+
+  RouteResult() : Status(FOUND), Distance(-1) {}
+};
+
+
+//
+// MeetingPointQuery
+//
+// Answers meeting point queries over a shared MeetingPointMap. A query object owns all the mutable search
+// state (engine buffers, search trees, hierarchy context), so it is reentrant in the sense that matters
+// here: each thread uses its own MeetingPointQuery and they never touch each other's state or the map's.
+//
+class MeetingPointQuery
+{
+private:
+  const MeetingPointMap* Map;
+
+  searchEngine<long long, double> engine; // Search buffers are sized once and reused by every query
+  shortestPathTree<long long, double> tree1; // Search trees from person 1 and 2, kept alive for a whole query so
+  shortestPathTree<long long, double> tree2; // every target (center, fallback centers) comes out of one expansion
+  contractionHierarchy<long long, double>::queryContext chContext;
+
+  long long settledCount; // Over every search of the last find() or route()
+  queryProfile lastProfile;
+
+  double routeFrom(shortestPathTree<long long, double>& tree, long long to, vector<long long>& path);
+  double routeBetween(shortestPathTree<long long, double>& tree, int fromBuilding, int toBuilding, long long toNode, vector<long long>& path);
+  void findOptimal(int firstIndex, int secondIndex, MeetingPointResult& result);
+  void solve(int firstIndex, int secondIndex, MeetingPointResult& result);
+  void answer(const string& person1Building, const string& person2Building, MeetingPointResult& result);
+  void answerRoute(const string& fromBuilding, const string& toBuilding, RouteResult& result);
+  void startProfile();
+  void finishProfile();
+
+public:
+  explicit MeetingPointQuery(const MeetingPointMap& map);
+
+  MeetingPointQuery(const MeetingPointQuery&) = delete;
+  MeetingPointQuery& operator=(const MeetingPointQuery&) = delete;
+
+  MeetingPointResult find(const string& person1Building, const string& person2Building);
+  RouteResult route(const string& fromBuilding, const string& toBuilding);
+
+  long long settled() const;
+  const queryProfile& profile() const;
+};
+
+
+//
+// MeetingPointPool
+//
+// A fixed set of worker threads, each with its own MeetingPointQuery over the same map, taking jobs off one
+// queue. submit() queues a job and returns at once, the job later runs on some worker with that worker's
+// query object. run() answers a whole batch of requests on every worker and returns the results in request
+// order.
+// Built over a map source instead of a map (e.g. a liveMap, overlay.h), each worker asks the source for the
+// current map before every job and makes itself a new query object when it changed, holding on to the old map
+// until then.
+//
+class MeetingPointPool
+{
+public:
+  using job = function<void(MeetingPointQuery&)>;
+  using mapSource = function<shared_ptr<const MeetingPointMap>()>;
+
+private:
+  const MeetingPointMap* Map; // nullptr when Source gives the map
+  mapSource Source;
+  vector<thread> workers;
+
+  mutex lock;
+  condition_variable jobReady; // Signalled when a job is queued or the pool stops
+  deque<job> jobs;
+  bool stopping; // Set by the destructor, workers finish the queued jobs and exit
+
+  void work();
+
+public:
+  MeetingPointPool(const MeetingPointMap& map, int threadCount);
+  MeetingPointPool(mapSource source, int threadCount);
+  ~MeetingPointPool();
+
+  MeetingPointPool(const MeetingPointPool&) = delete;
+  MeetingPointPool& operator=(const MeetingPointPool&) = delete;
+
+  int NumThreads() const;
+
+  void submit(job task);
+  vector<MeetingPointResult> run(const vector<MeetingPointRequest>& requests);
+};
+
+
+//
+// Compact result output for batch runs: one line per query, either tab separated (with a header line) or
+// one JSON object per line. Paths are node IDs from each person to the destination.
+//
+enum class resultFormat { TSV, JSON };
+
+const char* statusName(MeetingPointResult::statusType status);
+void writeResultHeader(ostream& out, resultFormat format);
+void writeResult(ostream& out, resultFormat format, const MeetingPointRequest& request, const MeetingPointResult& result);
+void writeRoute(ostream& out, resultFormat format, const MeetingPointRequest& request, const RouteResult& result);
+void writeError(ostream& out, resultFormat format, const string& message);
+void writeJSONString(ostream& out, const string& value);
+void writeCacheStats(ostream& out, resultFormat format, const MeetingPointMap& map);
+void writeProfile(ostream& out, resultFormat format, const MeetingPointMap& map);
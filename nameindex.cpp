@@ -0,0 +1,180 @@
+// nameindex.cpp
+//
+// Implements the building name index
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "nameindex.h"
+
+using namespace std;
+
+
+//
+// Longest gram indexed. Terms at least this long are looked up by their rarest gram of this length.
+//
+static const size_t MAX_GRAM = 3;
+
+
+//
+// gramKey
+//
+// Packs the gram text[start .. start + length) (length <= MAX_GRAM) with its length, so grams of different lengths never collide
+//
+static uint32_t gramKey(const string& text, size_t start, size_t length)
+{
+  uint32_t key = static_cast<uint32_t>(length) << 24;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    key |= static_cast<uint32_t>(static_cast<unsigned char>(text[start + i])) << (8 * (2 - i));
+  }
+
+  return key;
+}
+
+
+//
+// build
+//
+// Indexes every gram of every field, each building listed once per gram
+//
+void nameIndex::gramTable::build(const vector<const string*>& fields)
+{
+  vector<pair<uint32_t, int>> entries;
+
+  for (int b = 0; b < static_cast<int>(fields.size()); b++)
+  {
+    const string& text = *fields[b];
+
+    for (size_t length = 1; length <= MAX_GRAM; length++)
+    {
+      for (size_t start = 0; start + length <= text.size(); start++)
+      {
+        entries.push_back({gramKey(text, start, length), b});
+      }
+    }
+  }
+
+  sort(entries.begin(), entries.end());
+  entries.erase(unique(entries.begin(), entries.end()), entries.end());
+
+  keys.clear();
+  offsets.clear();
+  postings.clear();
+
+  for (const pair<uint32_t, int>& entry : entries)
+  {
+    if (keys.empty() || keys.back() != entry.first)
+    {
+      keys.push_back(entry.first);
+      offsets.push_back(static_cast<int>(postings.size()));
+    }
+
+    postings.push_back(entry.second);
+  }
+
+  offsets.push_back(static_cast<int>(postings.size()));
+}
+
+
+//
+// search
+//
+// Lowest building index whose field contains term, or -1
+//
+int nameIndex::gramTable::search(const string& term, const vector<const string*>& fields) const
+{
+  if (term.empty()) // find("") matches at 0 in every string, like the linear scan
+  {
+    return fields.empty() ? -1 : 0;
+  }
+
+  //
+  // candidates are the buildings holding the term's rarest gram, which every match must contain:
+  //
+  size_t length = min(term.size(), MAX_GRAM);
+  int bestBegin = 0, bestEnd = -1;
+
+  for (size_t start = 0; start + length <= term.size(); start++)
+  {
+    uint32_t key = gramKey(term, start, length);
+    auto found = lower_bound(keys.begin(), keys.end(), key);
+
+    if (found == keys.end() || *found != key) // Some gram appears nowhere, so the term does not either
+    {
+      return -1;
+    }
+
+    int k = static_cast<int>(found - keys.begin());
+
+    if (bestEnd == -1 || offsets[k + 1] - offsets[k] < bestEnd - bestBegin)
+    {
+      bestBegin = offsets[k];
+      bestEnd = offsets[k + 1];
+    }
+  }
+
+  for (int p = bestBegin; p < bestEnd; p++) // Ascending, so the first match is the lowest index
+  {
+    if (term.size() <= MAX_GRAM || fields[postings[p]]->find(term) != string::npos)
+    {
+      return postings[p];
+    }
+  }
+
+  return -1;
+}
+
+
+//
+// Constructor
+//
+// Empty index, every search returns -1
+//
+nameIndex::nameIndex()
+{
+  abbrevGrams.build(abbrevs);
+  nameGrams.build(names);
+}
+
+
+//
+// Constructor
+//
+// Indexes the abbreviations and full names of Buildings
+//
+nameIndex::nameIndex(const vector<BuildingInfo>& Buildings)
+{
+  for (const BuildingInfo& building : Buildings)
+  {
+    abbrevs.push_back(&building.Abbrev);
+    names.push_back(&building.Fullname);
+  }
+
+  abbrevGrams.build(abbrevs);
+  nameGrams.build(names);
+}
+
+
+//
+// search
+//
+// Returns the index in Buildings of the first building whose abbreviation contains term, else the first building whose
+// full name contains term, else -1
+//
+int nameIndex::search(const string& term) const
+{
+  int found = abbrevGrams.search(term, abbrevs);
+
+  if (found == -1)
+  {
+    found = nameGrams.search(term, names);
+  }
+
+  return found;
+}
@@ -0,0 +1,55 @@
+// nameindex.h
+//
+// Declares the building name index used to look buildings up by partial name or abbreviation
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "osm.h"
+
+using namespace std;
+
+
+//
+// nameIndex
+//
+// Substring search over the building table without scanning it. Every 1, 2 and 3 character gram of each
+// abbreviation and each full name is indexed (sorted flat gram keys, each with the sorted list of buildings
+// containing it). A search only looks at the buildings holding the term's rarest gram, in index order, and
+// checks each with string::find, so the answer is exactly what a linear scan gives: the first building
+// whose abbreviation contains the term, else the first whose full name does, else -1.
+//
+// The index refers to the Buildings vector it was built from, which must outlive it and not change.
+//
+class nameIndex
+{
+private:
+  struct gramTable // The grams of one field (abbreviations or full names)
+  {
+    vector<uint32_t> keys; // Sorted, see gramKey()
+    vector<int> offsets;   // Buildings of keys[k] are postings[offsets[k] .. offsets[k + 1])
+    vector<int> postings;  // Building indices, ascending per key
+
+    void build(const vector<const string*>& fields);
+    int search(const string& term, const vector<const string*>& fields) const;
+  };
+
+  vector<const string*> abbrevs; // Field of each building, by building index
+  vector<const string*> names;
+  gramTable abbrevGrams;
+  gramTable nameGrams;
+
+public:
+  nameIndex();
+  explicit nameIndex(const vector<BuildingInfo>& Buildings);
+
+  nameIndex(const nameIndex&) = delete; // The field pointers refer to Buildings, not to the index
+  nameIndex& operator=(const nameIndex&) = delete;
+
+  int search(const string& term) const;
+};
@@ -14,12 +14,21 @@
 //
 
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <map>
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <span>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "tinyxml2.h"
 #include "osm.h"
@@ -65,9 +74,13 @@ bool LoadOpenStreetMap(string filename, XMLDocument& xmldoc)
 
 
 //
-// ReadMapNodes
+// readMapNodes
 //
-int ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes)
+// Walks the node elements in file order, calling store(id, lat, lon) for each one.
+// Returns the # of node elements seen.
+//
+template<typename StoreFn>
+static int readMapNodes(XMLDocument& xmldoc, StoreFn store)
 {
   XMLElement* osm = xmldoc.FirstChildElement("osm");
   assert(osm != nullptr);
@@ -96,9 +109,9 @@ int ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes)
     nodeCount++;
 
     //
-    // store node in the map:
+    // store node:
     //
-    Nodes[id] = Coordinates(id, latitude, longitude);
+    store(id, latitude, longitude);
 
     //
     // next node element in the XML doc:
@@ -113,6 +126,27 @@ int ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes)
 }
 
 
+//
+// ReadMapNodes
+//
+int ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes)
+{
+  return readMapNodes(xmldoc, [&](long long id, double lat, double lon) {
+    Nodes[id] = Coordinates(id, lat, lon);
+  });
+}
+
+int ReadMapNodes(XMLDocument& xmldoc, NodeTable& Nodes)
+{
+  int nodeCount = readMapNodes(xmldoc, [&](long long id, double lat, double lon) {
+    Nodes.add(id, lat, lon);
+  });
+
+  Nodes.finalize();
+  return nodeCount;
+}
+
+
 //
 // ReadFootways
 //
@@ -200,10 +234,14 @@ int ReadFootways(XMLDocument& xmldoc, vector<FootwayInfo>& Footways)
 
 
 //
-// ReadUniversityBuildings
+// readUniversityBuildings
 //
-int ReadUniversityBuildings(XMLDocument& xmldoc,
-  map<long long, Coordinates>& Nodes,
+// Finds the named university buildings, positioned at the average of their nodes.
+// lookup(id) returns the coordinates of a node, which has to exist.
+//
+template<typename LookupFn>
+static int readUniversityBuildings(XMLDocument& xmldoc,
+  LookupFn lookup,
   vector<BuildingInfo>& Buildings)
 {
   XMLElement* osm = xmldoc.FirstChildElement("osm");
@@ -275,10 +313,10 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
         assert(ndref != nullptr);
 
         long long id = ndref->Int64Value();
-        assert(Nodes.find(id) != Nodes.end());
+        Coordinates node = lookup(id);
 
-        totalLat += Nodes[id].Lat;
-        totalLon += Nodes[id].Lon;
+        totalLat += node.Lat;
+        totalLon += node.Lon;
         numNodes++;
 
         // advance to next node ref:
@@ -318,3 +356,1003 @@ int ReadUniversityBuildings(XMLDocument& xmldoc,
   //
   return buildingCount;
 }
+
+
+//
+// ReadUniversityBuildings
+//
+int ReadUniversityBuildings(XMLDocument& xmldoc,
+  map<long long, Coordinates>& Nodes,
+  vector<BuildingInfo>& Buildings)
+{
+  return readUniversityBuildings(xmldoc, [&](long long id) {
+    assert(Nodes.find(id) != Nodes.end());
+    return Nodes[id];
+  }, Buildings);
+}
+
+int ReadUniversityBuildings(XMLDocument& xmldoc,
+  const NodeTable& Nodes,
+  vector<BuildingInfo>& Buildings)
+{
+  return readUniversityBuildings(xmldoc, [&](long long id) {
+    int index = Nodes.find(id);
+    assert(index != -1);
+    return Nodes.coordsAt(index);
+  }, Buildings);
+}
+
+
+//
+// osmStream
+//
+// Minimal pull parser for OpenStreetMap XML, used by StreamOpenStreetMap. Reads either a file through a
+// fixed-size buffer, the whole file through a read-only mapping, or a byte range already in memory, and hands out one tag at a time (name plus decoded
+// attributes), skipping text, comments, processing instructions and declarations. Nothing is kept once
+// a tag is consumed, so memory stays flat no matter how large the file is.
+//
+class osmStream
+{
+private:
+  FILE* file; // nullptr when reading a range in memory
+  void* mapping; // The file's mapping after mapFile(), else nullptr
+  size_t mappingSize;
+  vector<char> buffer;
+  const char* data; // Bytes being read, either buffer or the range
+  size_t pos, len;
+  bool failed;
+
+  int peek()
+  {
+    if (pos == len)
+    {
+      if (file == nullptr)
+      {
+        return EOF;
+      }
+
+      len = fread(buffer.data(), 1, buffer.size(), file);
+      pos = 0;
+
+      if (len == 0)
+      {
+        failed = failed || ferror(file);  // a read error is not the end of the document
+        return EOF;
+      }
+    }
+
+    return (unsigned char)data[pos];
+  }
+
+  int get()
+  {
+    int c = peek();
+
+    if (c != EOF)
+    {
+      pos++;
+    }
+
+    return c;
+  }
+
+  static bool isSpace(int c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  }
+
+  void skipSpace()
+  {
+    while (isSpace(peek()))
+    {
+      get();
+    }
+  }
+
+  //
+  // skipPast: consumes input up to and including terminator
+  //
+  void skipPast(const char* terminator)
+  {
+    size_t n = strlen(terminator), matched = 0;
+
+    while (matched < n)
+    {
+      int c = get();
+
+      if (c == EOF)
+      {
+        failed = true;
+        return;
+      }
+
+      if (c == terminator[matched])
+      {
+        matched++;
+      }
+      else
+      {
+        matched = (c == terminator[0]) ? 1 : 0;
+      }
+    }
+  }
+
+  //
+  // appendEntity: decodes one &...; reference (the '&' already consumed) onto out, like tinyxml2 does
+  //
+  void appendEntity(string& out)
+  {
+    string entity;
+    int c;
+
+    while ((c = get()) != EOF && c != ';' && entity.size() < 10)
+    {
+      entity += (char)c;
+    }
+
+    if (c != ';')
+    {
+      out += '&';  // not an entity after all, keep the text as is
+      out += entity;
+      if (c != EOF) out += (char)c;
+      return;
+    }
+
+    if (entity == "amp") out += '&';
+    else if (entity == "lt") out += '<';
+    else if (entity == "gt") out += '>';
+    else if (entity == "quot") out += '"';
+    else if (entity == "apos") out += '\'';
+    else if (entity.size() > 1 && entity[0] == '#')
+    {
+      unsigned long code = (entity[1] == 'x') ? strtoul(entity.c_str() + 2, nullptr, 16) : strtoul(entity.c_str() + 1, nullptr, 10);
+
+      //
+      // encode the code point as UTF-8:
+      //
+      if (code < 0x80)
+      {
+        out += (char)code;
+      }
+      else if (code < 0x800)
+      {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+      }
+      else if (code < 0x10000)
+      {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+      }
+      else
+      {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+      }
+    }
+    else
+    {
+      out += '&';
+      out += entity;
+      out += ';';
+    }
+  }
+
+public:
+  string Name;  // name of the current tag
+  vector<pair<string, string>> Attributes;  // (name, decoded value) of the current tag, reused between tags
+  size_t AttributeCount;
+  bool IsEnd;  // </name>
+  bool IsEmpty;  // <name ... />
+
+  osmStream()
+  {
+    file = nullptr;
+    mapping = nullptr;
+    mappingSize = 0;
+    data = nullptr;
+    pos = len = 0;
+    failed = false;
+    AttributeCount = 0;
+    IsEnd = IsEmpty = false;
+  }
+
+  ~osmStream()
+  {
+    if (file != nullptr)
+    {
+      fclose(file);
+    }
+
+    if (mapping != nullptr)
+    {
+      munmap(mapping, mappingSize);
+    }
+  }
+
+  bool open(const string& filename)
+  {
+    file = fopen(filename.c_str(), "rb");
+    buffer.resize(1 << 16);
+    data = buffer.data();
+    return file != nullptr;
+  }
+
+  //
+  // mapFile: switches the file open() opened, before anything is read, to a read-only mapping of the whole
+  // file, so it can be handed out in ranges (contents()) without a copy; the pages are the page cache's and
+  // can be dropped again under memory pressure, unlike a buffer holding the file. Returns false if the file
+  // can't be mapped.
+  //
+  bool mapFile()
+  {
+    struct stat info;
+
+    if (file == nullptr || fstat(fileno(file), &info) != 0)
+    {
+      return false;
+    }
+
+    if (info.st_size > 0)
+    {
+      void* p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+
+      if (p == MAP_FAILED)
+      {
+        return false;
+      }
+
+      mapping = p;
+      mappingSize = info.st_size;
+      madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+    }
+
+    fclose(file);  // the mapping stays valid after the file is closed
+    file = nullptr;
+
+    openRange(static_cast<const char*>(mapping), static_cast<const char*>(mapping) + mappingSize);
+    return true;
+  }
+
+  //
+  // contents: the mapped file, empty unless mapFile() succeeded
+  //
+  span<const char> contents() const
+  {
+    return span<const char>(static_cast<const char*>(mapping), mappingSize);
+  }
+
+  //
+  // openRange: reads the bytes [begin, end) instead of a file, they must stay alive while reading
+  //
+  void openRange(const char* begin, const char* end)
+  {
+    data = begin;
+    pos = 0;
+    len = end - begin;
+  }
+
+  //
+  // offset: # of bytes of the range consumed so far, only meaningful after openRange
+  //
+  size_t offset() const
+  {
+    return pos;
+  }
+
+  bool error() const
+  {
+    return failed;
+  }
+
+  //
+  // attribute: returns the decoded value of the named attribute of the current tag, or nullptr
+  //
+  const char* attribute(const char* name) const
+  {
+    for (size_t i = 0; i < AttributeCount; i++)
+    {
+      if (Attributes[i].first == name)
+      {
+        return Attributes[i].second.c_str();
+      }
+    }
+
+    return nullptr;
+  }
+
+  //
+  // next: advances to the next tag, returns false at the end of the file or on malformed input
+  //
+  bool next()
+  {
+    while (true)
+    {
+      int c;
+
+      while ((c = get()) != EOF && c != '<')  // skip text between tags
+        ;
+
+      if (c == EOF)
+      {
+        return false;
+      }
+
+      c = peek();
+
+      if (c == '?')
+      {
+        skipPast("?>");
+      }
+      else if (c == '!')
+      {
+        get();
+
+        if (peek() == '-')
+        {
+          skipPast("-->");
+        }
+        else if (peek() == '[')
+        {
+          skipPast("]]>");
+        }
+        else
+        {
+          skipPast(">");
+        }
+      }
+      else
+      {
+        break;
+      }
+
+      if (failed)
+      {
+        return false;
+      }
+    }
+
+    IsEnd = IsEmpty = false;
+    AttributeCount = 0;
+    Name.clear();
+
+    if (peek() == '/')
+    {
+      get();
+      IsEnd = true;
+    }
+
+    int c;
+
+    while ((c = peek()) != EOF && !isSpace(c) && c != '>' && c != '/')
+    {
+      Name += (char)get();
+    }
+
+    while (true)
+    {
+      skipSpace();
+      c = get();
+
+      if (c == '>')
+      {
+        break;
+      }
+
+      if (c == '/')
+      {
+        if (get() != '>')
+        {
+          failed = true;
+          return false;
+        }
+
+        IsEmpty = true;
+        break;
+      }
+
+      if (c == EOF || IsEnd)
+      {
+        failed = true;
+        return false;
+      }
+
+      //
+      // attribute name="value", reusing the string buffers of earlier tags:
+      //
+      if (AttributeCount == Attributes.size())
+      {
+        Attributes.push_back(pair<string, string>());
+      }
+
+      string& attrName = Attributes[AttributeCount].first;
+      string& attrValue = Attributes[AttributeCount].second;
+      attrName.assign(1, (char)c);
+      attrValue.clear();
+
+      while ((c = peek()) != EOF && !isSpace(c) && c != '=')
+      {
+        attrName += (char)get();
+      }
+
+      skipSpace();
+
+      if (get() != '=')
+      {
+        failed = true;
+        return false;
+      }
+
+      skipSpace();
+      int quote = get();
+
+      if (quote != '"' && quote != '\'')
+      {
+        failed = true;
+        return false;
+      }
+
+      while ((c = get()) != EOF && c != quote)
+      {
+        if (c == '&')
+        {
+          appendEntity(attrValue);
+        }
+        else if (c == '\r')  // newline normalization, \r\n and \r both become \n
+        {
+          if (peek() == '\n')
+          {
+            get();
+          }
+
+          attrValue += '\n';
+        }
+        else
+        {
+          attrValue += (char)c;
+        }
+      }
+
+      if (c == EOF)
+      {
+        failed = true;
+        return false;
+      }
+
+      AttributeCount++;
+    }
+
+    return true;
+  }
+};
+
+
+
+
+//
+// osmBuilding / osmChunk
+//
+// What one parse of (part of) the file produces, in file order: every node, every footway, and every
+// named university building way. Building centroids are computed later, once all nodes are known.
+//
+struct osmBuilding
+{
+  long long ID;
+  string Name;
+  vector<long long> Nodes;
+};
+
+struct osmChunk
+{
+  vector<Coordinates> Nodes;
+  vector<FootwayInfo> Footways;
+  vector<osmBuilding> Buildings;
+  int Depth; // Element depth where parsing stopped, 1 means directly inside <osm>
+  bool Failed;
+};
+
+
+//
+// readElements
+//
+// Reads tags from xml starting at the given depth until the stream ends or <osm> is closed, collecting
+// the nodes, footways and university buildings into chunk
+//
+static void readElements(osmStream& xml, int depth, osmChunk& chunk)
+{
+  //
+  // state of the <way> being read, if any:
+  //
+  bool inWay = false;
+  long long wayId = 0;
+  vector<long long> wayNodes;
+  bool isFootway = false;
+  bool isBuilding = false;
+  string buildingName;
+  bool hasName = false;
+
+  while (depth > 0 && xml.next())
+  {
+    if (xml.IsEnd)
+    {
+      depth--;
+
+      if (depth == 1 && inWay && xml.Name == "way")
+      {
+        //
+        // end of a way, store it as a footway and/or building:
+        //
+        if (isFootway)
+        {
+          FootwayInfo footway(wayId);
+          footway.Nodes = wayNodes;
+          chunk.Footways.push_back(footway);
+        }
+
+        if (isBuilding && hasName)
+        {
+          chunk.Buildings.push_back(osmBuilding{wayId, buildingName, wayNodes});
+        }
+
+        inWay = false;
+      }
+
+      continue;
+    }
+
+    if (depth == 1 && xml.Name == "node")
+    {
+      const char* attrId = xml.attribute("id");
+      const char* attrLat = xml.attribute("lat");
+      const char* attrLon = xml.attribute("lon");
+
+      assert(attrId != nullptr);
+      assert(attrLat != nullptr);
+      assert(attrLon != nullptr);
+
+      chunk.Nodes.push_back(Coordinates(strtoll(attrId, nullptr, 10), strtod(attrLat, nullptr), strtod(attrLon, nullptr)));
+    }
+    else if (depth == 1 && xml.Name == "way")
+    {
+      const char* attrId = xml.attribute("id");
+      assert(attrId != nullptr);
+
+      wayId = strtoll(attrId, nullptr, 10);
+      wayNodes.clear();
+      isFootway = isBuilding = hasName = false;
+      inWay = !xml.IsEmpty;  // a way with no children has no nodes, so it is neither a footway nor a building
+    }
+    else if (depth == 2 && inWay && xml.Name == "nd")
+    {
+      const char* ndref = xml.attribute("ref");
+      assert(ndref != nullptr);
+
+      wayNodes.push_back(strtoll(ndref, nullptr, 10));
+    }
+    else if (depth == 2 && inWay && xml.Name == "tag")
+    {
+      const char* k_value = xml.attribute("k");
+      const char* v_value = xml.attribute("v");
+
+      if (k_value != nullptr && v_value != nullptr)
+      {
+        if ((strcmp(k_value, "highway") == 0) && (strcmp(v_value, "footway") == 0))
+        {
+          isFootway = true;
+        }
+
+        if ((strcmp(k_value, "building") == 0) && (strcmp(v_value, "university") == 0))
+        {
+          isBuilding = true;
+        }
+
+        if (strcmp(k_value, "name") == 0)  // the last name tag wins, like ReadUniversityBuildings
+        {
+          buildingName = v_value;
+          hasName = true;
+        }
+      }
+    }
+
+    if (!xml.IsEmpty)
+    {
+      depth++;
+    }
+  }
+
+  chunk.Depth = depth;
+  chunk.Failed = xml.error();
+}
+
+
+//
+// parallelFor
+//
+// Calls fn(begin, end) over threadCount contiguous slices of [0, count), one thread per slice
+//
+template<typename Fn>
+static void parallelFor(size_t count, int threadCount, Fn fn)
+{
+  if (threadCount <= 1 || count < 2)
+  {
+    fn(size_t(0), count);
+    return;
+  }
+
+  vector<thread> threads;
+
+  for (int t = 0; t < threadCount; t++)
+  {
+    size_t begin = count * t / threadCount;
+    size_t end = count * (t + 1) / threadCount;
+
+    threads.push_back(thread(fn, begin, end));
+  }
+
+  for (thread& t : threads)
+  {
+    t.join();
+  }
+}
+
+
+//
+// mergeChunks
+//
+// Merges the chunks in file order, so a later node with the same ID replaces an earlier one exactly like
+// ReadMapNodes, then averages every building's nodes into its position on threadCount threads
+//
+static void mergeChunks(vector<osmChunk>& chunks, int threadCount,
+  NodeTable& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings)
+{
+  vector<osmBuilding> pending;
+
+  for (osmChunk& chunk : chunks)
+  {
+    for (const Coordinates& node : chunk.Nodes)
+    {
+      Nodes.add(node.ID, node.Lat, node.Lon);
+    }
+
+    chunk.Nodes = vector<Coordinates>();
+
+    Footways.insert(Footways.end(), make_move_iterator(chunk.Footways.begin()), make_move_iterator(chunk.Footways.end()));
+    pending.insert(pending.end(), make_move_iterator(chunk.Buildings.begin()), make_move_iterator(chunk.Buildings.end()));
+  }
+
+  Nodes.finalize();
+
+  size_t first = Buildings.size();
+  Buildings.resize(first + pending.size());
+
+  parallelFor(pending.size(), threadCount, [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; b++)
+    {
+      double totalLat = 0.0;
+      double totalLon = 0.0;
+      int    numNodes = 0;
+
+      for (long long id : pending[b].Nodes)
+      {
+        int node = Nodes.find(id);
+        assert(node != -1);
+
+        totalLat += Nodes.Lats[node];
+        totalLon += Nodes.Lons[node];
+        numNodes++;
+      }
+
+      double lat = totalLat / numNodes;
+      double lon = totalLon / numNodes;
+
+      const string& name = pending[b].Name;
+      string abbrev = "?";
+
+      size_t left = name.find('(');
+      size_t right = name.find(')');
+
+      if (left != string::npos && right != string::npos && left < right)
+      {
+        abbrev = name.substr(left + 1, right - left - 1);
+      }
+
+      Buildings[first + b] = BuildingInfo(name, abbrev, pending[b].ID, lat, lon);
+    }
+  });
+}
+
+
+//
+// findElementStart
+//
+// Returns the offset of the first top-level element (<node, <way or <relation) at or after from,
+// or size if there is none. Used to pick chunk boundaries, which parseChunks then double checks.
+//
+static size_t findElementStart(span<const char> contents, size_t from, size_t size)
+{
+  static const char* names[] = {"node", "way", "relation"};
+
+  for (size_t i = from; i < size; i++)
+  {
+    if (contents[i] != '<')
+    {
+      continue;
+    }
+
+    for (const char* name : names)
+    {
+      size_t n = strlen(name);
+
+      if (i + 1 + n < size && memcmp(&contents[i + 1], name, n) == 0
+        && (contents[i + 1 + n] == ' ' || contents[i + 1 + n] == '>' || contents[i + 1 + n] == '/'
+          || contents[i + 1 + n] == '\t' || contents[i + 1 + n] == '\n' || contents[i + 1 + n] == '\r'))
+      {
+        return i;
+      }
+    }
+  }
+
+  return size;
+}
+
+
+//
+// parseChunks
+//
+// Splits contents after the root tag into threadCount ranges at element boundaries and parses them in
+// parallel. Returns false if any boundary turned out not to be one (e.g. it fell inside a comment), in
+// which case the caller parses the whole file in one piece instead.
+//
+static bool parseChunks(span<const char> contents, size_t bodyStart, int threadCount, vector<osmChunk>& chunks)
+{
+  size_t size = contents.size();
+  vector<size_t> bounds;
+
+  bounds.push_back(bodyStart);
+
+  for (int t = 1; t < threadCount; t++)
+  {
+    size_t bound = findElementStart(contents, max(bounds.back() + 1, bodyStart + (size - bodyStart) * t / threadCount), size);
+
+    if (bound < size)
+    {
+      bounds.push_back(bound);
+    }
+  }
+
+  bounds.push_back(size);
+
+  chunks.assign(bounds.size() - 1, osmChunk());
+
+  parallelFor(chunks.size(), static_cast<int>(chunks.size()), [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++)
+    {
+      osmStream xml;
+      xml.openRange(contents.data() + bounds[c], contents.data() + bounds[c + 1]);
+
+      readElements(xml, 1, chunks[c]);
+    }
+  });
+
+  //
+  // every chunk but the last has to end right between two top-level elements:
+  //
+  for (size_t c = 0; c + 1 < chunks.size(); c++)
+  {
+    if (chunks[c].Failed || chunks[c].Depth != 1)
+    {
+      return false;
+    }
+  }
+
+  return !chunks.back().Failed;
+}
+
+
+//
+// StreamOpenStreetMap
+//
+// Single-pass alternative to LoadOpenStreetMap + ReadMapNodes + ReadFootways + ReadUniversityBuildings.
+// The file is parsed as a stream and Nodes, Footways and Buildings are filled with the same contents,
+// in the same order, as the DOM-based readers, without ever building the DOM.
+//
+// With threadCount > 1 the file is mapped into memory and split at element boundaries, the pieces are
+// parsed on separate threads, and the results are merged in file order, so the output does not depend
+// on the thread count. Building centroids are averaged in parallel as well.
+//
+// Returns false (after printing an error) if the file cannot be read or is not an OSM document.
+//
+bool StreamOpenStreetMap(string filename,
+  NodeTable& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings,
+  int threadCount)
+{
+  osmStream xml;
+
+  if (!xml.open(filename))
+  {
+    cout << "**ERROR: unable to open map file '" << filename << "'." << endl;
+    return false;
+  }
+
+  //
+  // map the whole file so it can be handed out in ranges:
+  //
+  if (threadCount > 1 && !xml.mapFile())
+  {
+    cout << "**ERROR: unable to map map file '" << filename << "'." << endl;
+    return false;
+  }
+
+  //
+  // top-level element should be "osm" if the file is a valid open 
+  // street map:
+  //
+  if (!xml.next() || xml.IsEnd || xml.Name != "osm")
+  {
+    cout << "**ERROR: unable to find top-level 'osm' XML element." << endl;
+    return false;
+  }
+
+  int depth = xml.IsEmpty ? 0 : 1;  // 1 means we're directly inside <osm>
+  vector<osmChunk> chunks;
+
+  if (threadCount <= 1 || depth == 0 || !parseChunks(xml.contents(), xml.offset(), threadCount, chunks))
+  {
+    chunks.assign(1, osmChunk());
+    readElements(xml, depth, chunks[0]);
+  }
+
+  if (chunks.back().Failed)
+  {
+    cout << "**ERROR: unable to parse map file '" << filename << "'." << endl;
+    return false;
+  }
+
+  mergeChunks(chunks, threadCount, Nodes, Footways, Buildings);
+  return true;
+}
+
+bool StreamOpenStreetMap(string filename,
+  map<long long, Coordinates>& Nodes,
+  vector<FootwayInfo>& Footways,
+  vector<BuildingInfo>& Buildings,
+  int threadCount)
+{
+  NodeTable table;
+
+  for (const auto& node : Nodes)  // keep whatever the map already holds, like ReadMapNodes does
+  {
+    table.add(node.first, node.second.Lat, node.second.Lon);
+  }
+
+  if (!StreamOpenStreetMap(filename, table, Footways, Buildings, threadCount))
+  {
+    return false;
+  }
+
+  for (int i = 0; i < table.size(); i++)
+  {
+    Nodes[table.IDs[i]] = table.coordsAt(i);
+  }
+
+  return true;
+}
+
+
+//
+// NodeTable::add
+//
+// Appends a node, the table is not searchable again until finalize()
+//
+void NodeTable::add(long long id, double lat, double lon)
+{
+  IDs.push_back(id);
+  Lats.push_back(lat);
+  Lons.push_back(lon);
+}
+
+
+//
+// NodeTable::finalize
+//
+// Sorts the nodes by ID, keeping the last one added when an ID repeats
+//
+void NodeTable::finalize()
+{
+  if (is_sorted(IDs.begin(), IDs.end()) && adjacent_find(IDs.begin(), IDs.end()) == IDs.end())
+  {
+    return;  // already sorted with no repeats, nothing to do
+  }
+
+  vector<int> order(IDs.size());
+
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    order[i] = static_cast<int>(i);
+  }
+
+  stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return IDs[a] < IDs[b];
+  });
+
+  vector<long long> sortedIDs;
+  vector<double> sortedLats, sortedLons;
+
+  sortedIDs.reserve(order.size());
+  sortedLats.reserve(order.size());
+  sortedLons.reserve(order.size());
+
+  for (size_t k = 0; k < order.size(); k++)
+  {
+    if (k + 1 < order.size() && IDs[order[k + 1]] == IDs[order[k]])
+    {
+      continue;  // a later node with the same ID follows, it wins
+    }
+
+    sortedIDs.push_back(IDs[order[k]]);
+    sortedLats.push_back(Lats[order[k]]);
+    sortedLons.push_back(Lons[order[k]]);
+  }
+
+  IDs.swap(sortedIDs);
+  Lats.swap(sortedLats);
+  Lons.swap(sortedLons);
+}
+
+
+//
+// NodeTable::size / find / contains
+//
+// # of nodes, and the index of the node with the given ID (-1 if there is none)
+//
+int NodeTable::size() const
+{
+  return static_cast<int>(IDs.size());
+}
+
+int NodeTable::find(long long id) const
+{
+  auto it = lower_bound(IDs.begin(), IDs.end(), id);
+
+  if (it == IDs.end() || *it != id)
+  {
+    return -1;
+  }
+
+  return static_cast<int>(it - IDs.begin());
+}
+
+bool NodeTable::contains(long long id) const
+{
+  return find(id) != -1;
+}
+
+
+//
+// NodeTable::at / coordsAt
+//
+// The node with the given ID (throws out_of_range if there is none, like map::at), and the node at an index
+//
+Coordinates NodeTable::at(long long id) const
+{
+  int index = find(id);
+
+  if (index == -1)
+  {
+    throw out_of_range("NodeTable::at: no node with id " + to_string(id));
+  }
+
+  return coordsAt(index);
+}
+
+Coordinates NodeTable::coordsAt(int index) const
+{
+  return Coordinates(IDs[index], Lats[index], Lons[index]);
+}
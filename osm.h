@@ -43,6 +43,34 @@ struct Coordinates
 };
 
 
+//
+// NodeTable
+//
+// The map nodes as flat arrays: IDs sorted in one vector, with the latitude and
+// longitude of node i in Lats[i] and Lons[i].  Replaces one tree node per map
+// node with three contiguous arrays, and lookups binary search the IDs.
+//
+// Nodes are appended with add() in file order, then finalize() sorts them by ID
+// (a no-op when the file was already sorted, which is the common case).  When an
+// ID repeats, the last one added wins, like assigning into a map.
+//
+struct NodeTable
+{
+  vector<long long> IDs;
+  vector<double> Lats;
+  vector<double> Lons;
+
+  void add(long long id, double lat, double lon);
+  void finalize();
+
+  int size() const;
+  int find(long long id) const;
+  bool contains(long long id) const;
+  Coordinates at(long long id) const;
+  Coordinates coordsAt(int index) const;
+};
+
+
 //
 // FootwayInfo
 //
@@ -104,7 +132,21 @@ struct BuildingInfo
 //
 bool LoadOpenStreetMap(string filename, XMLDocument& xmldoc);
 int  ReadMapNodes(XMLDocument& xmldoc, map<long long, Coordinates>& Nodes);
+int  ReadMapNodes(XMLDocument& xmldoc, NodeTable& Nodes);
 int  ReadFootways(XMLDocument& xmldoc, vector<FootwayInfo>& Footways);
 int  ReadUniversityBuildings(XMLDocument& xmldoc,
        map<long long, Coordinates>& Nodes,
        vector<BuildingInfo>& Buildings);
+int  ReadUniversityBuildings(XMLDocument& xmldoc,
+       const NodeTable& Nodes,
+       vector<BuildingInfo>& Buildings);
+bool StreamOpenStreetMap(string filename,
+       map<long long, Coordinates>& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings,
+       int threadCount = 1);
+bool StreamOpenStreetMap(string filename,
+       NodeTable& Nodes,
+       vector<FootwayInfo>& Footways,
+       vector<BuildingInfo>& Buildings,
+       int threadCount = 1);
@@ -0,0 +1,526 @@
+// overlay.cpp
+//
+// Implements footway closures and the live map that swaps in the routing data for them
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "overlay.h"
+
+using namespace std;
+
+
+//
+// segment / empty
+//
+// The key of the segment between two nodes, the same whichever way it is walked, and whether the overlay
+// changes anything at all
+//
+pair<long long, long long> footwayOverlay::segment(long long a, long long b)
+{
+  return a < b ? make_pair(a, b) : make_pair(b, a);
+}
+
+bool footwayOverlay::empty() const
+{
+  return ClosedNodes.empty() && ClosedSegments.empty() && Penalties.empty();
+}
+
+
+//
+// isOverlayCommand
+//
+// True if command is the first field of an overlay edit, see overlayEdit
+//
+bool isOverlayCommand(const string& command)
+{
+  return command == "close" || command == "open" || command == "penalize" || command == "reopen";
+}
+
+
+//
+// parseNodeID / parseMiles
+//
+// A whole field as an OSM node ID or a non-negative length, false if it is anything else
+//
+static bool parseNodeID(const string& field, long long& id)
+{
+  char* end = nullptr;
+  id = strtoll(field.c_str(), &end, 10);
+  return !field.empty() && *end == '\0' && id >= 0;
+}
+
+static bool parseMiles(const string& field, double& miles)
+{
+  char* end = nullptr;
+  miles = strtod(field.c_str(), &end);
+  return !field.empty() && *end == '\0' && isfinite(miles) && miles >= 0;
+}
+
+
+//
+// parseOverlayEdit
+//
+// Parses the fields of one edit line, or returns false with the reason in error
+//
+bool parseOverlayEdit(const vector<string>& fields, overlayEdit& edit, string& error)
+{
+  const string& command = fields.empty() ? "" : fields[0];
+  edit = overlayEdit();
+
+  if (command == "reopen" && fields.size() == 1) {
+    edit.Type = overlayEdit::REOPEN;
+    return true;
+  }
+
+  if ((command == "close" || command == "open") && (fields.size() == 2 || fields.size() == 3)) {
+    edit.Type = (command == "close") ? overlayEdit::CLOSE : overlayEdit::OPEN;
+
+    if (parseNodeID(fields[1], edit.From) && (fields.size() == 2 || parseNodeID(fields[2], edit.To))) {
+      return true;
+    }
+
+    error = "expected node IDs: " + command + " <tab> node [<tab> node]";
+    return false;
+  }
+
+  if (command == "penalize" && fields.size() == 4) {
+    edit.Type = overlayEdit::PENALIZE;
+
+    if (parseNodeID(fields[1], edit.From) && parseNodeID(fields[2], edit.To) && parseMiles(fields[3], edit.Miles)) {
+      return true;
+    }
+
+    error = "expected: penalize <tab> node <tab> node <tab> miles (0 or more)";
+    return false;
+  }
+
+  error = "expected: close|open <tab> node [<tab> node], penalize <tab> node <tab> node <tab> miles, or reopen";
+  return false;
+}
+
+
+//
+// applyEdit
+//
+// Makes one edit to overlay, or returns false with the reason in error when it opens something that is not closed
+//
+static bool applyEdit(footwayOverlay& overlay, const overlayEdit& edit, string& error)
+{
+  pair<long long, long long> segment = footwayOverlay::segment(edit.From, edit.To);
+
+  switch (edit.Type) {
+    case overlayEdit::CLOSE:
+      if (edit.To == -1) {
+        overlay.ClosedNodes.insert(edit.From);
+      }
+      else {
+        overlay.ClosedSegments.insert(segment);
+      }
+
+      return true;
+
+    case overlayEdit::OPEN:
+      if (edit.To == -1 ? overlay.ClosedNodes.erase(edit.From) == 0 : overlay.ClosedSegments.erase(segment) == 0) {
+        error = "not closed: " + to_string(edit.From) + (edit.To == -1 ? "" : " " + to_string(edit.To));
+        return false;
+      }
+
+      return true;
+
+    case overlayEdit::PENALIZE:
+      if (edit.Miles > 0) {
+        overlay.Penalties[segment] = edit.Miles;
+      }
+      else {
+        overlay.Penalties.erase(segment);
+      }
+
+      return true;
+
+    case overlayEdit::REOPEN:
+      overlay = footwayOverlay();
+      return true;
+  }
+
+  return false;
+}
+
+
+//
+// forEachSegment
+//
+// Calls fn(e, a, b) for every segment a --> b of every edge e of G, in order along the edge: just the edge's two
+// ends, or on a graph with collapsed chains every pair of consecutive nodes the edge passes through
+//
+template<typename Fn>
+static void forEachSegment(const compactGraph<long long, double>& G, Fn fn)
+{
+  span<const int> viaOffsets = G.getViaOffsets();
+  span<const long long> via = G.getVia();
+
+  for (int u = 0; u < G.NumVertices(); u++) {
+    for (int e = G.edgeBegin(u); e < G.edgeEnd(u); e++) {
+      long long from = G.vertexAt(u);
+
+      if (!viaOffsets.empty()) {
+        for (int k = viaOffsets[e]; k < viaOffsets[e + 1]; k++) {
+          fn(e, from, via[k]);
+          from = via[k];
+        }
+      }
+
+      fn(e, from, G.vertexAt(G.target(e)));
+    }
+  }
+}
+
+
+//
+// markEdges
+//
+// Sizes dropEdge and addWeight to G's edges and marks what overlay does to each: dropped when it passes through a
+// closed node or segment, plus the penalties of the segments it passes through
+//
+static void markEdges(const compactGraph<long long, double>& G, const footwayOverlay& overlay, vector<char>& dropEdge,
+  vector<double>& addWeight)
+{
+  dropEdge.assign(G.NumEdges(), 0);
+  addWeight.assign(G.NumEdges(), 0);
+
+  if (overlay.empty()) {
+    return;
+  }
+
+  forEachSegment(G, [&](int e, long long a, long long b) {
+    pair<long long, long long> segment = footwayOverlay::segment(a, b);
+
+    if (overlay.ClosedNodes.count(a) || overlay.ClosedNodes.count(b) || overlay.ClosedSegments.count(segment)) {
+      dropEdge[e] = 1;
+    }
+
+    auto penalty = overlay.Penalties.find(segment);
+
+    if (penalty != overlay.Penalties.end()) {
+      addWeight[e] += penalty->second;
+    }
+  });
+}
+
+
+//
+// loosens
+//
+// True if going from overlay before to after opens anything or lowers a penalty, so some route may have got shorter
+//
+static bool loosens(const footwayOverlay& before, const footwayOverlay& after)
+{
+  for (long long node : before.ClosedNodes) {
+    if (!after.ClosedNodes.count(node)) {
+      return true;
+    }
+  }
+
+  for (const pair<long long, long long>& segment : before.ClosedSegments) {
+    if (!after.ClosedSegments.count(segment)) {
+      return true;
+    }
+  }
+
+  for (const auto& [segment, miles] : before.Penalties) {
+    auto penalty = after.Penalties.find(segment);
+
+    if (penalty == after.Penalties.end() || penalty->second < miles) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+//
+// Constructor
+//
+// Publishes version 0, the map as loaded. Everything passed in must outlive the live map and every snapshot.
+//
+liveMap::liveMap(const vector<BuildingInfo>& Buildings, const spatialGrid& FootwayNodes, const spatialGrid& BuildingCenters,
+  const compactGraph<long long, double>& G, span<const Coordinates> vertexCoords, searchMode mode,
+  const contractionHierarchy<long long, double>* CH, const buildingMatrix* Matrix, meetingObjective objective,
+  size_t cacheCapacity, int threadCount)
+  : Buildings(Buildings), FootwayNodes(FootwayNodes), BuildingCenters(BuildingCenters), BaseG(G), vertexCoords(vertexCoords),
+    mode(mode), BaseCH(CH), BaseMatrix(Matrix), objective(objective), cacheCapacity(cacheCapacity), threadCount(threadCount)
+{
+  shared_ptr<mapSnapshot> initial = make_shared<mapSnapshot>();
+  initial->Map = make_unique<MeetingPointMap>(Buildings, FootwayNodes, BuildingCenters, BaseG, vertexCoords, mode, BaseCH,
+    BaseMatrix, objective, cacheCapacity);
+
+  Current.store(initial);
+}
+
+
+//
+// snapshot / map
+//
+// The current snapshot, or just its MeetingPointMap (which keeps the whole snapshot alive), safe to call from any thread
+//
+shared_ptr<const mapSnapshot> liveMap::snapshot() const
+{
+  return Current.load();
+}
+
+shared_ptr<const MeetingPointMap> liveMap::map() const
+{
+  shared_ptr<const mapSnapshot> current = Current.load();
+  return shared_ptr<const MeetingPointMap>(current, current->Map.get());
+}
+
+
+//
+// apply
+//
+// Makes every edit to the current overlay, in order, and publishes a snapshot for the result. All or nothing: if
+// an edit names a node or segment the footways don't have, opens something that is not closed, or would push a
+// weight out of range, nothing is published and error says why. Queries keep running on the current snapshot
+// throughout, and the ones that start after apply() returns see the new one.
+//
+bool liveMap::apply(const vector<overlayEdit>& edits, string& error)
+{
+  lock_guard<mutex> guard(updateLock);
+  auto start = chrono::steady_clock::now();
+
+  shared_ptr<const mapSnapshot> previous = snapshot();
+  shared_ptr<mapSnapshot> next = make_shared<mapSnapshot>();
+  next->Version = previous->Version + 1;
+  next->Overlay = previous->Overlay;
+
+  if (!checkTargets(edits, error)) {
+    return false;
+  }
+
+  for (const overlayEdit& edit : edits) {
+    if (!applyEdit(next->Overlay, edit, error)) {
+      return false;
+    }
+  }
+
+  try {
+    build(*next, *previous);
+  }
+  catch (const out_of_range& e) {
+    error = e.what();
+    return false;
+  }
+
+  keepResults(*next, *previous);
+  next->BuildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  Current.store(next);
+  return true;
+}
+
+
+//
+// checkTargets
+//
+// Makes sure every node and segment the edits close or penalize is on the footways, so a typo doesn't silently
+// close nothing. One pass over the base graph's segments for all the edits.
+//
+bool liveMap::checkTargets(const vector<overlayEdit>& edits, string& error) const
+{
+  set<long long> nodes;
+  set<pair<long long, long long>> segments;
+
+  for (const overlayEdit& edit : edits) {
+    if (edit.Type == overlayEdit::CLOSE && edit.To == -1) {
+      nodes.insert(edit.From);
+    }
+    else if (edit.Type == overlayEdit::CLOSE || edit.Type == overlayEdit::PENALIZE) {
+      segments.insert(footwayOverlay::segment(edit.From, edit.To));
+    }
+  }
+
+  if (nodes.empty() && segments.empty()) {
+    return true;
+  }
+
+  forEachSegment(BaseG, [&](int, long long a, long long b) {
+    nodes.erase(a);
+    nodes.erase(b);
+    segments.erase(footwayOverlay::segment(a, b));
+  });
+
+  if (!nodes.empty()) {
+    error = "no footway node " + to_string(*nodes.begin());
+    return false;
+  }
+
+  if (!segments.empty()) {
+    error = "no footway segment " + to_string(segments.begin()->first) + " " + to_string(segments.begin()->second);
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// build
+//
+// Fills in next's graph, hierarchy, matrix and map for its overlay. The base map is the starting point every time,
+// so reopening something restores exactly what was there. When the update only closes or penalizes, the matrix
+// rows whose trees avoid every edge it dropped or made heavier are still shortest (everything else only got
+// longer) and are copied from the previous version; the rest are rerun.
+//
+void liveMap::build(mapSnapshot& next, const mapSnapshot& previous) const
+{
+  const footwayOverlay& overlay = next.Overlay;
+
+  if (overlay.empty()) { // Back to the map as loaded, nothing to rebuild
+    next.Map = make_unique<MeetingPointMap>(Buildings, FootwayNodes, BuildingCenters, BaseG, vertexCoords, mode, BaseCH,
+      BaseMatrix, objective, cacheCapacity);
+    return;
+  }
+
+  vector<char> dropEdge;
+  vector<double> addWeight;
+  markEdges(BaseG, overlay, dropEdge, addWeight);
+
+  next.G = BaseG.adjusted(dropEdge, addWeight);
+
+  if (BaseCH != nullptr) {
+    next.CH = make_unique<contractionHierarchy<long long, double>>(next.G, *BaseCH);
+  }
+
+  if (BaseMatrix != nullptr && !BaseMatrix->empty()) {
+    vector<long long> buildingNodes; // Buildings snap to the same nodes whatever is closed
+
+    for (const Coordinates& node : previous.Map->BuildingNodes) {
+      buildingNodes.push_back(node.ID);
+    }
+
+    if (loosens(previous.Overlay, overlay)) {
+      next.Matrix = buildingMatrix::build(next.G, buildingNodes, threadCount);
+    }
+    else {
+      const buildingMatrix& before = previous.Overlay.empty() ? *BaseMatrix : previous.Matrix;
+      vector<char> droppedBefore;
+      vector<double> addedBefore;
+      markEdges(BaseG, previous.Overlay, droppedBefore, addedBefore);
+
+      set<pair<int, int>> changed; // (from, to) dense indices of the edges this update dropped or made heavier
+
+      for (int u = 0; u < BaseG.NumVertices(); u++) {
+        for (int e = BaseG.edgeBegin(u); e < BaseG.edgeEnd(u); e++) {
+          if (dropEdge[e] != droppedBefore[e] || addWeight[e] != addedBefore[e]) {
+            changed.emplace(u, BaseG.target(e));
+          }
+        }
+      }
+
+      span<const long long> treeOffsets = before.getTreeOffsets();
+      span<const int> treeVertices = before.getTreeVertices();
+      span<const int> treeParents = before.getTreeParents();
+      vector<char> staleRows(buildingNodes.size(), 0);
+
+      for (size_t row = 0; row < buildingNodes.size(); row++) {
+        for (long long k = treeOffsets[row]; k < treeOffsets[row + 1] && !staleRows[row]; k++) {
+          staleRows[row] = treeParents[k] != -1 && changed.count({ treeParents[k], treeVertices[k] });
+        }
+      }
+
+      next.Matrix = buildingMatrix::rebuild(next.G, buildingNodes, before, staleRows, threadCount);
+    }
+  }
+
+  next.Map = make_unique<MeetingPointMap>(Buildings, FootwayNodes, BuildingCenters, next.G, vertexCoords, mode, next.CH.get(),
+    &next.Matrix, objective, cacheCapacity);
+}
+
+
+//
+// keepResults
+//
+// Carries the previous version's cached results over to next when they can't have changed. If the update only
+// closed or penalized (nothing got shorter), a route that avoids everything it touched is still a shortest one,
+// every other route only got longer, and anything unreachable stays unreachable, so the only results to drop
+// are the ones whose paths cross a segment or node the update touched.
+//
+void liveMap::keepResults(mapSnapshot& next, const mapSnapshot& previous) const
+{
+  const footwayOverlay& before = previous.Overlay;
+  const footwayOverlay& after = next.Overlay;
+
+  set<long long> touchedNodes;
+  set<pair<long long, long long>> touchedSegments;
+
+  if (loosens(before, after)) {
+    return;
+  }
+
+  for (long long node : after.ClosedNodes) {
+    if (!before.ClosedNodes.count(node)) {
+      touchedNodes.insert(node);
+    }
+  }
+
+  for (const pair<long long, long long>& segment : after.ClosedSegments) {
+    if (!before.ClosedSegments.count(segment)) {
+      touchedSegments.insert(segment);
+    }
+  }
+
+  for (const auto& [segment, miles] : after.Penalties) {
+    auto penalty = before.Penalties.find(segment);
+
+    if (penalty == before.Penalties.end() || penalty->second < miles) {
+      touchedSegments.insert(segment);
+    }
+  }
+
+  auto crosses = [&](const vector<long long>& path) {
+    for (size_t i = 0; i < path.size(); i++) {
+      if (touchedNodes.count(path[i]) || (i > 0 && touchedSegments.count(footwayOverlay::segment(path[i - 1], path[i])))) {
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  for (auto& [key, result] : previous.Map->Results.entries()) {
+    if (result->Status != MeetingPointResult::FOUND || (!crosses(result->Path1) && !crosses(result->Path2))) {
+      next.Map->Results.insert(key, result);
+      next.ResultsKept++;
+    }
+  }
+}
+
+
+//
+// writeOverlayStatus
+//
+// One line describing a snapshot: its version, what its overlay holds, the results carried over and how long it took
+//
+void writeOverlayStatus(ostream& out, resultFormat format, const mapSnapshot& snapshot)
+{
+  const footwayOverlay& overlay = snapshot.Overlay;
+
+  if (format == resultFormat::TSV) {
+    out << "overlay\t" << snapshot.Version << '\t' << overlay.ClosedNodes.size() << '\t' << overlay.ClosedSegments.size()
+        << '\t' << overlay.Penalties.size() << '\t' << snapshot.ResultsKept << '\t' << snapshot.BuildSeconds << '\n';
+    return;
+  }
+
+  out << "{\"status\":\"ok\",\"overlay_version\":" << snapshot.Version << ",\"closed_nodes\":" << overlay.ClosedNodes.size()
+      << ",\"closed_segments\":" << overlay.ClosedSegments.size() << ",\"penalties\":" << overlay.Penalties.size()
+      << ",\"results_kept\":" << snapshot.ResultsKept << ",\"build_s\":" << snapshot.BuildSeconds << "}\n";
+}
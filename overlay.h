@@ -0,0 +1,156 @@
+// overlay.h
+//
+// Declares live footway closures: an overlay of closed nodes, closed segments and penalties on top of the frozen
+// graph, and the live map that rebuilds the routing data for each new overlay off to the side and swaps it in
+// atomically, while queries keep running on the data they started with
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <span>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <utility>
+
+#include "osm.h"
+#include "compactgraph.h"
+#include "ch.h"
+#include "spatial.h"
+#include "matrix.h"
+#include "meeting.h"
+
+using namespace std;
+
+
+//
+// footwayOverlay
+//
+// Changes to the footways by OSM node ID. A segment joins two consecutive nodes of a footway and is closed or
+// penalized in both directions, like the footways themselves; pairs are stored smaller ID first (segment()). A
+// closed node closes every segment touching it, whatever is open. Penalties are miles added to a segment's length
+// (a detour, stairs, a crowded plaza), so routes avoid it when they reasonably can.
+//
+struct footwayOverlay
+{
+  set<long long> ClosedNodes;
+  set<pair<long long, long long>> ClosedSegments;
+  map<pair<long long, long long>, double> Penalties; // Always above 0
+
+  static pair<long long, long long> segment(long long a, long long b);
+  bool empty() const;
+};
+
+
+//
+// overlayEdit
+//
+// One change to an overlay, from a line of tab separated fields:
+//
+//   close <node> [<node>]            close a node, or the segment between two nodes
+//   open <node> [<node>]             undo a close
+//   penalize <node> <node> <miles>   set the penalty of a segment, 0 removes it
+//   reopen                           drop every closure and penalty
+//
+struct overlayEdit
+{
+  enum editType { CLOSE, OPEN, PENALIZE, REOPEN };
+
+  editType Type = CLOSE;
+  long long From = -1;
+  long long To = -1; // -1 when the edit is about the node From alone
+  double Miles = 0;
+};
+
+bool isOverlayCommand(const string& command);
+bool parseOverlayEdit(const vector<string>& fields, overlayEdit& edit, string& error);
+
+
+//
+// mapSnapshot
+//
+// The routing data for one version of the overlay: the graph with the overlay applied, the hierarchy and
+// building matrix over it when the base map has them, and the MeetingPointMap that queries read. Published
+// once built and never modified after, so any number of queries can read it while the next one is built.
+// A snapshot with an empty overlay reads the base map's own graph, hierarchy and matrix instead of copies.
+//
+struct mapSnapshot
+{
+  long long Version = 0; // 0 for the map as loaded, one more for every update
+  footwayOverlay Overlay;
+
+  compactGraph<long long, double> G;
+  unique_ptr<contractionHierarchy<long long, double>> CH;
+  buildingMatrix Matrix;
+  unique_ptr<MeetingPointMap> Map;
+
+  size_t ResultsKept = 0; // Cached results carried over from the previous version
+  double BuildSeconds = 0;
+};
+
+
+//
+// liveMap
+//
+// The current snapshot of a map that can be updated while it is queried, in the read-copy-update style:
+// readers take a reference-counted pointer to the current snapshot (map()) and use it for as long as they
+// like, an update builds the next snapshot from the base map plus the new overlay without touching the
+// current one, and publishes it with one atomic pointer swap. The old snapshot is freed when its last reader
+// lets go of it. Updates are serialized, so each builds on the overlay the previous one published.
+//
+// Only what an update invalidates is rebuilt: the graph copy drops closed edges and adds penalties in one
+// pass over the edges, component labels are only recomputed when edges were dropped, the hierarchy is
+// recontracted in the base hierarchy's vertex order (no priorities to work out), and when the update only
+// closes or penalizes, the matrix rows and cached results whose trees and paths avoid everything it changed
+// are carried over and only the others are recomputed. Reopening anything rebuilds the matrix and empties
+// the cache, since a better route may have appeared anywhere.
+//
+// The hierarchy is not customized in place (reweighting the existing shortcuts, as customizable hierarchies
+// do) because contractionHierarchy leaves out every shortcut a witness search showed unnecessary, and a
+// closure can take out the witness path, so the reweighted hierarchy would miss routes. Recontracting in the
+// saved order reruns those witness searches against the new weights and stays exact.
+//
+class liveMap
+{
+private:
+  const vector<BuildingInfo>& Buildings;
+  const spatialGrid& FootwayNodes;
+  const spatialGrid& BuildingCenters;
+  const compactGraph<long long, double>& BaseG;
+  span<const Coordinates> vertexCoords;
+  searchMode mode;
+  const contractionHierarchy<long long, double>* BaseCH;
+  const buildingMatrix* BaseMatrix;
+  meetingObjective objective;
+  size_t cacheCapacity;
+  int threadCount; // For rebuilding the building matrix
+
+  mutex updateLock; // One update at a time
+  atomic<shared_ptr<const mapSnapshot>> Current;
+
+  bool checkTargets(const vector<overlayEdit>& edits, string& error) const;
+  void build(mapSnapshot& next, const mapSnapshot& previous) const;
+  void keepResults(mapSnapshot& next, const mapSnapshot& previous) const;
+
+public:
+  liveMap(const vector<BuildingInfo>& Buildings, const spatialGrid& FootwayNodes, const spatialGrid& BuildingCenters,
+    const compactGraph<long long, double>& G, span<const Coordinates> vertexCoords, searchMode mode,
+    const contractionHierarchy<long long, double>* CH, const buildingMatrix* Matrix, meetingObjective objective,
+    size_t cacheCapacity, int threadCount);
+
+  liveMap(const liveMap&) = delete;
+  liveMap& operator=(const liveMap&) = delete;
+
+  shared_ptr<const mapSnapshot> snapshot() const;
+  shared_ptr<const MeetingPointMap> map() const;
+
+  bool apply(const vector<overlayEdit>& edits, string& error);
+};
+
+
+void writeOverlayStatus(ostream& out, resultFormat format, const mapSnapshot& snapshot);
@@ -0,0 +1,193 @@
+// radixheap.h
+//
+// Indexed monotone radix heap over dense item ids 0..N-1 with unsigned integer keys and decrease-key
+// Items are bucketed by the highest bit in which their key differs from the last key popped, so pushes and
+// decrease-keys are O(1) and a pop moves each item down a bucket at most once per bit of the key: no
+// comparisons between heap entries, just bit tricks. Only valid while keys never go below the last key
+// popped, which is what Dijkstra's algorithm needs with non-negative integer weights.
+//
+
+#include <vector>
+#include <limits>
+#include <bit>
+
+#pragma once
+
+using namespace std;
+
+template<typename KeyT = unsigned long long>
+
+class radixHeap {
+  private:
+    static_assert(numeric_limits<KeyT>::is_integer && !numeric_limits<KeyT>::is_signed, "radix heap keys are unsigned integers");
+
+    static constexpr int BUCKETS = numeric_limits<KeyT>::digits + 1;
+
+    struct HeapEntry {
+      KeyT key;
+      int item;
+    };
+
+    vector<HeapEntry> buckets[BUCKETS]; // buckets[0] holds keys equal to last, buckets[b] keys differing from it first in bit b - 1
+    vector<HeapEntry> scratch; // The bucket being redistributed by pop(), kept to reuse its capacity
+    vector<int> bucketOf; // Item --> bucket holding it, -1 if the item is not in the heap
+    vector<int> position; // Item --> index in its bucket
+    KeyT last; // Key of the item popped last, every key in the heap is at least this
+    int count;
+
+    // bucketFor
+    //
+    // Returns the bucket a key belongs in, relative to last
+    int bucketFor(KeyT key) const {
+      return key == last ? 0 : bit_width(static_cast<KeyT>(key ^ last));
+    }
+
+    // place / remove
+    //
+    // Adds item with key to the bucket it belongs in, or takes it out of its bucket by moving the bucket's last entry into its slot
+    void place(int item, KeyT key) {
+      int b = bucketFor(key);
+
+      bucketOf[item] = b;
+      position[item] = static_cast<int>(buckets[b].size());
+      buckets[b].push_back(HeapEntry{key, item});
+    }
+
+    void remove(int item) {
+      vector<HeapEntry>& bucket = buckets[bucketOf[item]];
+      int i = position[item];
+
+      bucket[i] = bucket.back();
+      position[bucket[i].item] = i;
+      bucket.pop_back();
+      bucketOf[item] = -1;
+    }
+
+  public:
+
+    // Constructor
+    //
+    // Builds an empty heap for itemCount items
+    explicit radixHeap(int itemCount = 0) {
+      resize(itemCount);
+    }
+
+    // resize
+    //
+    // Empties the heap and makes room for items 0..itemCount-1
+    void resize(int itemCount) {
+      for (vector<HeapEntry>& bucket : buckets) {
+        bucket.clear();
+      }
+
+      bucketOf.assign(itemCount, -1);
+      position.assign(itemCount, 0);
+      last = 0;
+      count = 0;
+    }
+
+    // clear
+    //
+    // Removes every item, in time proportional to the items still in the heap, and starts over from key 0
+    void clear() {
+      for (vector<HeapEntry>& bucket : buckets) {
+        for (const HeapEntry& entry : bucket) {
+          bucketOf[entry.item] = -1;
+        }
+
+        bucket.clear();
+      }
+
+      last = 0;
+      count = 0;
+    }
+
+    // empty / size
+    //
+    // Whether the heap has no items, and how many it has
+    bool empty() const {
+      return count == 0;
+    }
+
+    int size() const {
+      return count;
+    }
+
+    // contains
+    //
+    // Returns true if item is currently in the heap
+    bool contains(int item) const {
+      return bucketOf[item] != -1;
+    }
+
+    // push
+    //
+    // Inserts item, which must not be in the heap, with the given key (at least lastKey())
+    void push(int item, KeyT key) {
+      place(item, key);
+      count++;
+    }
+
+    // pushOrDecrease
+    //
+    // Inserts item with key, or lowers its key if it is already in the heap with a larger one
+    void pushOrDecrease(int item, KeyT key) {
+      if (!contains(item)) {
+        push(item, key);
+        return;
+      }
+
+      vector<HeapEntry>& bucket = buckets[bucketOf[item]];
+
+      if (key < bucket[position[item]].key) {
+        remove(item);
+        place(item, key);
+      }
+    }
+
+    // pop
+    //
+    // Removes and returns an item with the smallest key. The heap must not be empty.
+    int pop() {
+      if (buckets[0].empty()) {
+        //
+        // the smallest key is in the first non-empty bucket; make it the new last, which spreads that bucket
+        // over lower buckets (every key in it now differs from last in a lower bit) and leaves the rest alone:
+        //
+        int b = 1;
+
+        while (buckets[b].empty()) {
+          b++;
+        }
+
+        KeyT smallest = buckets[b][0].key;
+
+        for (const HeapEntry& entry : buckets[b]) {
+          smallest = entry.key < smallest ? entry.key : smallest;
+        }
+
+        last = smallest;
+        scratch.swap(buckets[b]);
+
+        for (const HeapEntry& entry : scratch) {
+          place(entry.item, entry.key);
+        }
+
+        scratch.clear();
+      }
+
+      int item = buckets[0].back().item;
+      buckets[0].pop_back();
+      bucketOf[item] = -1;
+      count--;
+
+      return item;
+    }
+
+    // lastKey
+    //
+    // Returns the key of the item pop() returned last (0 before any pop)
+    KeyT lastKey() const {
+      return last;
+    }
+};
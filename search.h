@@ -0,0 +1,560 @@
+// search.h
+//
+// Shortest path engine over a frozen compactGraph
+// All per-vertex search state lives in flat arrays indexed by dense vertex index, and each entry is
+// stamped with the query generation that wrote it, so consecutive queries reuse the buffers without
+// clearing them. Per-query cost is proportional to the vertices the search actually touches.
+//
+// Four modes are available for point-to-point queries:
+//   DIJKSTRA             plain Dijkstra from the source
+//   ASTAR                A* guided by the great-circle distance to the target (distBetween2Points)
+//   BIDIRECTIONAL_ASTAR  A* from both ends at once using the averaged great-circle potential
+//   RADIX_DIJKSTRA       Dijkstra with a radix heap keyed by integer distance, for graphs with fixed point weights
+// The A* modes need a coordinate per dense vertex and assume every edge weight is at least the
+// great-circle distance between its endpoints, which is how main() builds the footway graph.
+//
+
+#include <vector>
+#include <span>
+#include <limits>
+#include <algorithm>
+
+#include "compactgraph.h"
+#include "dheap.h"
+#include "instrument.h"
+#include "radixheap.h"
+#include "arena.h"
+#include "dist.h"
+#include "osm.h"
+
+#pragma once
+
+using namespace std;
+
+enum class searchMode {
+  DIJKSTRA,
+  ASTAR,
+  BIDIRECTIONAL_ASTAR,
+  RADIX_DIJKSTRA
+};
+
+// searchBuffers
+//
+// Per-vertex state of one Dijkstra-style search direction. Entries are stamped with the generation
+// that wrote them, so begin() invalidates the previous search in O(1) instead of clearing N entries.
+template<typename WeightT>
+
+struct searchBuffers {
+  static constexpr WeightT INF = numeric_limits<WeightT>::max();
+
+  vector<WeightT> distances; // Dense index --> distance from the source, valid only if stamps matches generation
+  vector<int> predecessors; // Dense index --> predecessor towards the source, -1 for the source
+  vector<unsigned> stamps; // Dense index --> generation that last wrote distances/predecessors
+  unsigned generation = 0;
+
+  vector<int> touched; // Dense indices reached by the current search, in the order they were first reached
+  indexedHeap<WeightT> heap; // 4-ary heap with decrease-key over dense indices
+
+  // resize
+  //
+  // Sizes the buffers for vertexCount dense vertices
+  void resize(int vertexCount) {
+    distances.resize(vertexCount);
+    predecessors.resize(vertexCount);
+    stamps.assign(vertexCount, 0);
+    generation = 0;
+    heap.resize(vertexCount);
+  }
+
+  // begin
+  //
+  // Starts a new generation, which invalidates every distance from the previous search
+  void begin() {
+    generation++;
+
+    if (generation == 0) { // Stamps wrapped around, so old stamps could look current. Reset them once.
+      stamps.assign(stamps.size(), 0);
+      generation = 1;
+    }
+
+    touched.clear();
+    heap.clear();
+  }
+
+  // distanceTo
+  //
+  // Returns the distance found to dense vertex v in this search, or INF if it was not reached
+  WeightT distanceTo(int v) const {
+    return stamps[v] == generation ? distances[v] : INF;
+  }
+
+  // reach
+  //
+  // Records dist/pred for dense vertex v in the current generation
+  void reach(int v, WeightT dist, int pred) {
+    if (stamps[v] != generation) {
+      stamps[v] = generation;
+      touched.push_back(v);
+    }
+
+    distances[v] = dist;
+    predecessors[v] = pred;
+  }
+};
+
+template<typename VertexT, typename WeightT>
+
+class searchEngine {
+  public:
+    static constexpr WeightT INF = numeric_limits<WeightT>::max();
+
+  private:
+    typedef searchBuffers<WeightT> searchSide;
+
+    const compactGraph<VertexT, WeightT>* G; // The graph we search, not owned
+    vector<TrigCoordinates> trig; // Dense index --> position with precomputed trig, only filled for the A* modes
+
+    searchSide forward;
+    searchSide backward;
+    radixHeap<unsigned long long> radix; // Queue of the RADIX_DIJKSTRA mode, keyed by fixed point distance; only sized for such graphs
+
+    int settledCount; // # of vertices popped from the heaps by the last query
+
+    // beginQuery
+    //
+    // Starts a new search on both sides
+    void beginQuery() {
+      forward.begin();
+      backward.begin();
+      settledCount = 0;
+    }
+
+    // greatCircle
+    //
+    // Returns the great-circle distance between dense vertices u and v, which is a lower bound on any
+    // path between them. Computed from the chord between precomputed unit vectors, so no per-call trig
+    // beyond one asin.
+    WeightT greatCircle(int u, int v) const {
+      return static_cast<WeightT>(chordSquaredToMiles(chordSquared(trig[u], trig[v])));
+    }
+
+    // backTrace
+    //
+    // Appends the forward search tree path from dense vertex v back to the source onto path
+    void backTrace(int v, vector<VertexT>& path) const {
+      for (; v != -1; v = forward.predecessors[v]) {
+        path.push_back(G->vertexAt(v));
+      }
+    }
+
+    // unidirectional
+    //
+    // Dijkstra/A* from startIndex until endIndex is settled. With useHeuristic the heap is keyed by
+    // distance + great-circle distance to the target, otherwise by distance alone.
+    double unidirectional(int startIndex, int endIndex, bool useHeuristic, vector<VertexT>& path) {
+      beginQuery();
+      forward.reach(startIndex, 0, -1);
+      forward.heap.push(startIndex, useHeuristic ? greatCircle(startIndex, endIndex) : 0);
+
+      while (!forward.heap.empty()) {
+        int currentV = forward.heap.pop(); // Each vertex leaves the heap once, unless A* finds it a shorter path later
+        settledCount++;
+        profileCount(profileCounter::SETTLED);
+
+        if (currentV == endIndex) {
+          break;
+        }
+
+        WeightT currentDistance = forward.distances[currentV];
+        for (int e = G->edgeBegin(currentV); e < G->edgeEnd(currentV); e++) {
+          int adjV = G->target(e);
+          WeightT altPathDistance = currentDistance + G->weight(e);
+          profileCount(profileCounter::RELAXED);
+
+          // If a shorter path is found from startV to adjV, update adjV's distance and predecessor
+          if (altPathDistance < forward.distanceTo(adjV)) {
+            forward.reach(adjV, altPathDistance, currentV);
+            forward.heap.pushOrDecrease(adjV, useHeuristic ? altPathDistance + greatCircle(adjV, endIndex) : altPathDistance);
+            profileCount(profileCounter::HEAP_PUSHES);
+          }
+        }
+      }
+
+      if (forward.distanceTo(endIndex) == INF) { // The search ran dry without reaching endV
+        return -1;
+      }
+
+      backTrace(endIndex, path);
+      return forward.distances[endIndex];
+    }
+
+    // radixDijkstra
+    //
+    // Dijkstra from startIndex until endIndex is settled, with every distance kept as an integer count of fixed point
+    // units so the monotone radix heap can order them. The distances recorded are those integers converted back,
+    // which are exact, so this finds the same distances as unidirectional() on the same graph.
+    double radixDijkstra(int startIndex, int endIndex, vector<VertexT>& path) {
+      beginQuery();
+      radix.clear();
+      forward.reach(startIndex, 0, -1);
+      radix.push(startIndex, 0);
+
+      while (!radix.empty()) {
+        int currentV = radix.pop();
+        settledCount++;
+        profileCount(profileCounter::SETTLED);
+
+        if (currentV == endIndex) {
+          break;
+        }
+
+        unsigned long long currentUnits = radix.lastKey();
+        for (int e = G->edgeBegin(currentV); e < G->edgeEnd(currentV); e++) {
+          int adjV = G->target(e);
+          unsigned long long altUnits = currentUnits + G->fixedWeight(e);
+          WeightT altPathDistance = compactGraph<VertexT, WeightT>::fixedToWeight(altUnits);
+          profileCount(profileCounter::RELAXED);
+
+          if (altPathDistance < forward.distanceTo(adjV)) {
+            forward.reach(adjV, altPathDistance, currentV);
+            radix.pushOrDecrease(adjV, altUnits);
+            profileCount(profileCounter::HEAP_PUSHES);
+          }
+        }
+      }
+
+      if (forward.distanceTo(endIndex) == INF) {
+        return -1;
+      }
+
+      backTrace(endIndex, path);
+      return forward.distances[endIndex];
+    }
+
+    // bidirectional
+    //
+    // Bidirectional A* with the averaged potential p(v) = (h_end(v) - h_start(v)) / 2 on the forward side
+    // and -p(v) on the backward side, so both searches see the same reduced edge costs. The search stops
+    // once the two smallest keys add up to at least the best meeting distance found so far.
+    // The backward search walks the same adjacency, so G must be symmetric.
+    double bidirectional(int startIndex, int endIndex, vector<VertexT>& path) {
+      beginQuery();
+
+      auto potential = [&](int v) { // Forward potential, the backward potential is its negation
+        return (greatCircle(v, endIndex) - greatCircle(v, startIndex)) / 2;
+      };
+
+      forward.reach(startIndex, 0, -1);
+      forward.heap.push(startIndex, potential(startIndex));
+      backward.reach(endIndex, 0, -1);
+      backward.heap.push(endIndex, -potential(endIndex));
+
+      WeightT best = startIndex == endIndex ? 0 : INF; // Best start --> end distance through a vertex both sides reached
+      int meetV = startIndex == endIndex ? startIndex : -1;
+
+      while (!forward.heap.empty() && !backward.heap.empty()) {
+        if (best != INF && forward.heap.topKey() + backward.heap.topKey() >= best) {
+          break; // No unsettled vertex can lead to a shorter meeting
+        }
+
+        bool goForward = forward.heap.size() <= backward.heap.size(); // Grow the smaller frontier
+        searchSide& side = goForward ? forward : backward;
+        searchSide& other = goForward ? backward : forward;
+        double sign = goForward ? 1 : -1;
+
+        int currentV = side.heap.pop();
+        settledCount++;
+        profileCount(profileCounter::SETTLED);
+
+        WeightT currentDistance = side.distances[currentV];
+        for (int e = G->edgeBegin(currentV); e < G->edgeEnd(currentV); e++) {
+          int adjV = G->target(e);
+          WeightT altPathDistance = currentDistance + G->weight(e);
+          profileCount(profileCounter::RELAXED);
+
+          if (altPathDistance < side.distanceTo(adjV)) {
+            side.reach(adjV, altPathDistance, currentV);
+            side.heap.pushOrDecrease(adjV, altPathDistance + sign * potential(adjV));
+            profileCount(profileCounter::HEAP_PUSHES);
+          }
+
+          WeightT otherDistance = other.distanceTo(adjV);
+          if (otherDistance != INF && side.distanceTo(adjV) + otherDistance < best) { // The two searches meet at adjV
+            best = side.distanceTo(adjV) + otherDistance;
+            meetV = adjV;
+          }
+        }
+      }
+
+      if (meetV == -1) { // The searches never met
+        return -1;
+      }
+
+      queryArena::scope scratch; // endHalf lives in the thread's query arena, released when the query returns
+      pmr::vector<VertexT> endHalf(scratch.resource()); // meetV --> endV along the backward tree, reversed so it reads endV --> meetV
+      for (int v = backward.predecessors[meetV]; v != -1; v = backward.predecessors[v]) {
+        endHalf.push_back(G->vertexAt(v));
+      }
+
+      path.insert(path.end(), endHalf.rbegin(), endHalf.rend());
+      backTrace(meetV, path);
+
+      return best;
+    }
+
+  public:
+
+    // Constructor
+    //
+    // Sizes the search buffers for G. coords gives the position of each dense vertex and is only needed
+    // by the A* modes. Only G has to outlive the engine, the coordinates are copied into precomputed trig.
+    explicit searchEngine(const compactGraph<VertexT, WeightT>& G, span<const Coordinates> coords = {}) : G(&G) {
+      if (!coords.empty()) {
+        trig.reserve(coords.size());
+
+        for (const Coordinates& c : coords) {
+          trig.push_back(precomputeTrig(c.Lat, c.Lon));
+        }
+      }
+
+      forward.resize(G.NumVertices());
+      backward.resize(G.NumVertices());
+      settledCount = 0;
+
+      if (G.hasFixedWeights()) {
+        radix.resize(G.NumVertices());
+      }
+    }
+
+    // distanceTo
+    //
+    // Returns the distance the last forward search found to dense vertex v, or INF if it was not reached
+    WeightT distanceTo(int v) const {
+      return forward.distanceTo(v);
+    }
+
+    // settled
+    //
+    // Returns the # of vertices the last query settled, over both directions
+    int settled() const {
+      return settledCount;
+    }
+
+    // touchedVertices
+    //
+    // Returns the dense indices the last forward search reached
+    const vector<int>& touchedVertices() const {
+      return forward.touched;
+    }
+
+    // shortestPath
+    //
+    // Finds the shortest path from startV to endV with the given mode. The path is recorded in the path
+    // vector from endV back to startV, and the distance of the path is returned, or -1 if endV cannot be
+    // reached (path is left untouched in that case). A* modes fall back to Dijkstra without coordinates, and
+    // RADIX_DIJKSTRA without fixed point weights.
+    double shortestPath(searchMode mode, const VertexT& startV, const VertexT& endV, vector<VertexT>& path) {
+      int startIndex = G->indexOf(startV);
+      int endIndex = G->indexOf(endV);
+
+      if (startIndex == -1 || endIndex == -1) { // Endpoints not in the graph means there's nothing to find
+        return -1;
+      }
+
+      if (mode == searchMode::RADIX_DIJKSTRA && G->hasFixedWeights()) {
+        return radixDijkstra(startIndex, endIndex, path);
+      }
+
+      if (trig.empty() || mode == searchMode::DIJKSTRA || mode == searchMode::RADIX_DIJKSTRA) {
+        return unidirectional(startIndex, endIndex, false, path);
+      }
+      else if (mode == searchMode::ASTAR) {
+        return unidirectional(startIndex, endIndex, true, path);
+      }
+
+      return bidirectional(startIndex, endIndex, path);
+    }
+
+    // dijkstra / astar / bidirectionalAstar
+    //
+    // Shorthands for shortestPath with each mode
+    double dijkstra(const VertexT& startV, const VertexT& endV, vector<VertexT>& path) {
+      return shortestPath(searchMode::DIJKSTRA, startV, endV, path);
+    }
+
+    double astar(const VertexT& startV, const VertexT& endV, vector<VertexT>& path) {
+      return shortestPath(searchMode::ASTAR, startV, endV, path);
+    }
+
+    double bidirectionalAstar(const VertexT& startV, const VertexT& endV, vector<VertexT>& path) {
+      return shortestPath(searchMode::BIDIRECTIONAL_ASTAR, startV, endV, path);
+    }
+};
+
+// shortestPathTree
+//
+// Resumable single-source Dijkstra. reset() picks the source, and pathTo() grows the search tree only
+// until the requested target is settled, keeping everything settled so far. Asking for many targets from
+// the same source therefore costs one expansion in total, and a target outside the source's component is
+// answered instantly once the tree has exhausted the component.
+template<typename VertexT, typename WeightT>
+
+class shortestPathTree {
+  public:
+    static constexpr WeightT INF = numeric_limits<WeightT>::max();
+
+  private:
+    const compactGraph<VertexT, WeightT>* G; // The graph we search, not owned
+
+    searchBuffers<WeightT> tree;
+    vector<bool> settledFlags; // Dense index --> settled by this tree, valid only if tree.stamps matches
+    int sourceIndex; // -1 if the source is not in the graph
+    VertexT sourceV;
+    int settledCount;
+    long long settledTotalCount; // Over every tree this object has grown
+
+    // isSettled
+    //
+    // Returns true if the tree has settled dense vertex v
+    bool isSettled(int v) const {
+      return tree.stamps[v] == tree.generation && settledFlags[v];
+    }
+
+    // settleUntil
+    //
+    // Expands the tree until targetIndex is settled or the source's component is exhausted
+    void settleUntil(int targetIndex) {
+      while (!isSettled(targetIndex) && settleNext() != -1) {
+      }
+    }
+
+  public:
+
+    // Constructor
+    //
+    // Sizes the tree for G. G must outlive the tree.
+    explicit shortestPathTree(const compactGraph<VertexT, WeightT>& G) : G(&G) {
+      tree.resize(G.NumVertices());
+      settledFlags.assign(G.NumVertices(), false);
+      sourceIndex = -1;
+      sourceV = VertexT();
+      settledCount = 0;
+      settledTotalCount = 0;
+    }
+
+    // reset
+    //
+    // Discards the current tree in O(1) and starts a new one from startV. Nothing is expanded until pathTo().
+    void reset(const VertexT& startV) {
+      tree.begin();
+      sourceV = startV;
+      sourceIndex = G->indexOf(startV);
+      settledCount = 0;
+
+      if (sourceIndex != -1) {
+        tree.reach(sourceIndex, 0, -1);
+        settledFlags[sourceIndex] = false;
+        tree.heap.push(sourceIndex, 0);
+      }
+    }
+
+    // source
+    //
+    // Returns the vertex passed to the last reset()
+    const VertexT& source() const {
+      return sourceV;
+    }
+
+    // settled
+    //
+    // Returns the # of vertices settled since the last reset()
+    int settled() const {
+      return settledCount;
+    }
+
+    // settledTotal
+    //
+    // Returns the # of vertices settled since construction, over every reset()
+    long long settledTotal() const {
+      return settledTotalCount;
+    }
+
+    // settleNext
+    //
+    // Grows the tree by one vertex: settles the closest vertex not settled yet and returns its dense index,
+    // or -1 once the source's component is exhausted. Lets callers run several trees in lockstep.
+    int settleNext() {
+      if (tree.heap.empty()) {
+        return -1;
+      }
+
+      int currentV = tree.heap.pop();
+      settledFlags[currentV] = true;
+      settledCount++;
+      profileCount(profileCounter::SETTLED);
+      settledTotalCount++;
+
+      WeightT currentDistance = tree.distances[currentV];
+      for (int e = G->edgeBegin(currentV); e < G->edgeEnd(currentV); e++) {
+        int adjV = G->target(e);
+        WeightT altPathDistance = currentDistance + G->weight(e);
+        profileCount(profileCounter::RELAXED);
+
+        if (altPathDistance < tree.distanceTo(adjV)) {
+          if (tree.stamps[adjV] != tree.generation) {
+            settledFlags[adjV] = false; // First time this generation, so the flag may be left over from an older tree
+          }
+
+          tree.reach(adjV, altPathDistance, currentV);
+          tree.heap.pushOrDecrease(adjV, altPathDistance);
+          profileCount(profileCounter::HEAP_PUSHES);
+        }
+      }
+
+      return currentV;
+    }
+
+    // frontier
+    //
+    // Returns the distance of the vertex settleNext() would settle next, a lower bound on the distance of every
+    // vertex not settled yet, or INF once the component is exhausted
+    WeightT frontier() const {
+      return tree.heap.empty() ? INF : tree.heap.topKey();
+    }
+
+    // hasSettled / distanceAt
+    //
+    // Whether dense vertex v is settled, and its final distance from the source if it is
+    bool hasSettled(int v) const {
+      return isSettled(v);
+    }
+
+    WeightT distanceAt(int v) const {
+      return tree.distances[v];
+    }
+
+    // pathTo
+    //
+    // Returns the shortest distance from the source to endV, expanding the tree only as far as needed, and
+    // records the path in the path vector from endV back to the source. Returns -1 if endV cannot be
+    // reached (path is left untouched in that case).
+    double pathTo(const VertexT& endV, vector<VertexT>& path) {
+      int endIndex = G->indexOf(endV);
+
+      if (sourceIndex == -1 || endIndex == -1) {
+        return -1;
+      }
+
+      settleUntil(endIndex);
+
+      if (!isSettled(endIndex)) {
+        return -1;
+      }
+
+      for (int v = endIndex; v != -1; v = tree.predecessors[v]) {
+        path.push_back(G->vertexAt(v));
+      }
+
+      return tree.distances[endIndex];
+    }
+};
@@ -0,0 +1,684 @@
+// server.cpp
+//
+// Implements the routing server with non-blocking sockets and epoll (Linux)
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include "server.h"
+
+using namespace std;
+
+
+//
+// Limits per connection, and the epoll IDs of the two descriptors that are not connections
+//
+static const long long MAX_IN_FLIGHT = 256;   // Requests dispatched but not yet written back
+static const size_t MAX_LINE = 64 * 1024;     // Longest request line accepted
+static const long long LISTEN_ID = 0;
+static const long long WAKE_ID = 1;
+
+
+//
+// connection
+//
+// One client: bytes read but not yet split into requests, responses not yet written, and the responses
+// that came back from the pool ahead of an earlier one (workers finish out of order)
+//
+struct routingServer::connection
+{
+  int fd;
+  long long id;
+  uint32_t events; // What epoll is currently watching for
+
+  string input;
+  string output;
+  size_t outputSent;
+
+  long long nextSequence; // Given to the next request read
+  long long nextToSend;   // Oldest request whose response has not been queued for output
+  map<long long, string> ready;
+
+  long long editSequence; // This client's closure update that is not published yet, -1 if none; later requests wait for it
+  bool heldBack; // A complete line waits for a closure update (its own or an earlier one), so stop reading more
+  bool closing; // The client finished sending (or broke the protocol), close once everything is written
+};
+
+
+//
+// Constructor / Destructor
+//
+routingServer::routingServer(MeetingPointPool& pool, liveMap& live, resultFormat format)
+  : pool(&pool), Live(&live), format(format), listenFd(-1), epollFd(-1), wakeFd(-1), nextConnectionID(WAKE_ID + 1), outstandingJobs(0),
+    stopping(false)
+{
+  updater = thread(&routingServer::update, this);
+}
+
+routingServer::~routingServer()
+{
+  {
+    unique_lock<mutex> guard(completedLock); // Jobs still running hold a pointer to this server
+    jobsDrained.wait(guard, [&]() { return outstandingJobs == 0; });
+  }
+
+  {
+    lock_guard<mutex> guard(editLock);
+    stopping = true;
+  }
+
+  editReady.notify_all();
+  updater.join();
+
+  while (!connections.empty()) {
+    closeConnection(connections.begin()->first);
+  }
+
+  for (int fd : {listenFd, epollFd, wakeFd}) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+  }
+}
+
+
+//
+// listen
+//
+// Binds every interface on port and sets up the event loop, returns false (with the reason on cerr) if that fails
+//
+bool routingServer::listen(int port)
+{
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (listenFd == -1) {
+    cerr << "**Error: unable to create socket: " << strerror(errno) << endl;
+    return false;
+  }
+
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); // Restarting the server must not wait out TIME_WAIT
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+
+  if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || ::listen(listenFd, SOMAXCONN) == -1) {
+    cerr << "**Error: unable to listen on port " << port << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (epollFd == -1 || wakeFd == -1) {
+    cerr << "**Error: unable to set up the event loop: " << strerror(errno) << endl;
+    return false;
+  }
+
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = LISTEN_ID;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+  event.data.u64 = WAKE_ID;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+  return true;
+}
+
+
+//
+// serve
+//
+// The event loop, runs until epoll itself fails
+//
+void routingServer::serve()
+{
+  epoll_event events[64];
+
+  while (true) {
+    int count = epoll_wait(epollFd, events, 64, -1);
+
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      cerr << "**Error: event loop failed: " << strerror(errno) << endl;
+      return;
+    }
+
+    for (int i = 0; i < count; i++) {
+      long long id = static_cast<long long>(events[i].data.u64);
+
+      if (id == LISTEN_ID) {
+        acceptConnections();
+        continue;
+      }
+
+      if (id == WAKE_ID) {
+        collectCompletions();
+        continue;
+      }
+
+      auto found = connections.find(id);
+
+      if (found == connections.end()) { // Closed while handling an earlier event of this round
+        continue;
+      }
+
+      connection& client = *found->second;
+
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        closeConnection(id);
+        continue;
+      }
+
+      if (events[i].events & EPOLLIN) {
+        readFrom(client);
+      }
+
+      if (connections.count(id) && (events[i].events & EPOLLOUT)) {
+        writeTo(client);
+      }
+
+      if (connections.count(id)) {
+        if (finished(client)) {
+          closeConnection(id);
+        }
+        else {
+          updateEvents(client);
+        }
+      }
+    }
+  }
+}
+
+
+//
+// acceptConnections
+//
+// Takes every pending connection off the listening socket
+//
+void routingServer::acceptConnections()
+{
+  while (true) {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd == -1) { // EAGAIN once the backlog is empty, anything else is the client's problem
+      return;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // Responses are small, don't hold them back
+
+    unique_ptr<connection> client = make_unique<connection>();
+    client->fd = fd;
+    client->id = nextConnectionID++;
+    client->events = EPOLLIN;
+    client->outputSent = 0;
+    client->nextSequence = 0;
+    client->nextToSend = 0;
+    client->editSequence = -1;
+    client->heldBack = false;
+    client->closing = false;
+
+    epoll_event event;
+    event.events = client->events;
+    event.data.u64 = static_cast<uint64_t>(client->id);
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+    connections[client->id] = move(client);
+  }
+}
+
+
+//
+// readFrom
+//
+// Reads everything the client has sent so far and dispatches the complete lines
+//
+void routingServer::readFrom(connection& client)
+{
+  char buffer[16 * 1024];
+
+  while (!client.closing) {
+    ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+
+    if (received > 0) {
+      client.input.append(buffer, static_cast<size_t>(received));
+
+      if (client.input.size() > MAX_LINE) { // Dispatch before reading more, level-triggered epoll comes back for the rest
+        break;
+      }
+    }
+    else if (received == 0) { // Client is done sending, answer what it sent and close
+      client.closing = true;
+    }
+    else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    }
+    else if (errno != EINTR) {
+      closeConnection(client.id);
+      return;
+    }
+  }
+
+  dispatchLines(client);
+}
+
+
+//
+// dispatchLines
+//
+// Turns buffered complete lines into requests, as long as the client is under its in-flight limit. Closure updates
+// are barriers both ways: one is only dispatched once every earlier request of the client has been answered, and
+// nothing after it until it is published, so each request sees exactly the updates sent before it.
+//
+void routingServer::dispatchLines(connection& client)
+{
+  size_t start = 0;
+
+  auto mayDispatch = [&](const string& line) {
+    if (client.editSequence != -1) {
+      return false;
+    }
+
+    return !isOverlayCommand(line.substr(0, line.find_first_of("\t\r"))) || client.nextToSend == client.nextSequence;
+  };
+
+  client.heldBack = false;
+
+  while (client.nextSequence - client.nextToSend < MAX_IN_FLIGHT) {
+    size_t end = client.input.find('\n', start);
+
+    if (end == string::npos) {
+      break;
+    }
+
+    string line = client.input.substr(start, end - start);
+
+    if (!mayDispatch(line)) {
+      client.heldBack = true;
+      break;
+    }
+
+    dispatch(client, line);
+    start = end + 1;
+  }
+
+  client.input.erase(0, start);
+
+  bool lastLine = client.closing && client.input.find('\n') == string::npos; // Final request without a newline
+
+  if (lastLine && !client.input.empty() && client.nextSequence - client.nextToSend < MAX_IN_FLIGHT) {
+    if (mayDispatch(client.input)) {
+      dispatch(client, client.input);
+      client.input.clear();
+    }
+    else {
+      client.heldBack = true;
+    }
+  }
+
+  if (client.input.size() > MAX_LINE && client.input.find('\n') == string::npos) { // Would never end, give up on this client
+    ostringstream out;
+    writeError(out, format, "request line too long");
+    respond(client, client.nextSequence++, out.str());
+
+    client.input.clear();
+    client.closing = true;
+  }
+}
+
+
+//
+// dispatch
+//
+// Parses one request line and either answers it at once (malformed requests) or submits it to the pool
+//
+void routingServer::dispatch(connection& client, const string& line)
+{
+  long long sequence = client.nextSequence++;
+  vector<string> fields;
+  size_t start = 0;
+
+  string request = line;
+
+  if (!request.empty() && request.back() == '\r') {
+    request.pop_back();
+  }
+
+  while (true) {
+    size_t tab = request.find('\t', start);
+    fields.push_back(request.substr(start, tab == string::npos ? string::npos : tab - start));
+
+    if (tab == string::npos) {
+      break;
+    }
+
+    start = tab + 1;
+  }
+
+  if (fields.size() == 1 && fields[0] == "stats") { // Counters only, no need to bother a worker
+    ostringstream out;
+    writeCacheStats(out, format, *Live->map());
+    respond(client, sequence, out.str());
+    return;
+  }
+
+  if (fields.size() == 1 && fields[0] == "profile") {
+    ostringstream out;
+
+    if (PROFILING) {
+      writeProfile(out, format, *Live->map());
+    }
+    else {
+      writeError(out, format, "built without profiling, rebuild with make build PROFILE=1");
+    }
+
+    respond(client, sequence, out.str());
+    return;
+  }
+
+  if (fields.size() == 1 && fields[0] == "overlay") {
+    ostringstream out;
+    writeOverlayStatus(out, format, *Live->snapshot());
+    respond(client, sequence, out.str());
+    return;
+  }
+
+  if (isOverlayCommand(fields[0])) {
+    overlayEdit edit;
+    string error;
+
+    if (!parseOverlayEdit(fields, edit, error)) {
+      ostringstream out;
+      writeError(out, format, error);
+      respond(client, sequence, out.str());
+      return;
+    }
+
+    {
+      lock_guard<mutex> guard(completedLock);
+      outstandingJobs++;
+    }
+
+    {
+      lock_guard<mutex> guard(editLock);
+      edits.push_back({client.id, sequence, edit});
+    }
+
+    client.editSequence = sequence; // Cleared by collectCompletions once the update is published
+    editReady.notify_one();
+    return;
+  }
+
+  if (fields.size() != 3 || (fields[0] != "meet" && fields[0] != "route")) {
+    ostringstream out;
+    writeError(out, format, "expected: meet|route <tab> building <tab> building, stats, profile, overlay, or a closure update");
+    respond(client, sequence, out.str());
+    return;
+  }
+
+  {
+    lock_guard<mutex> guard(completedLock);
+    outstandingJobs++;
+  }
+
+  bool meet = fields[0] == "meet";
+  MeetingPointRequest buildings{fields[1], fields[2]};
+  long long id = client.id;
+
+  pool->submit([this, meet, buildings, id, sequence](MeetingPointQuery& query) {
+    ostringstream out;
+    out << setprecision(8); // Same precision as the interactive output
+
+    if (meet) {
+      writeResult(out, format, buildings, query.find(buildings.Person1, buildings.Person2));
+    }
+    else {
+      writeRoute(out, format, buildings, query.route(buildings.Person1, buildings.Person2));
+    }
+
+    complete(id, sequence, out.str());
+  });
+}
+
+
+//
+// complete
+//
+// Called by a worker or the updater when it finished a job: hands the response to the I/O thread and wakes it up
+//
+void routingServer::complete(long long connectionID, long long sequence, string response)
+{
+  {
+    lock_guard<mutex> guard(completedLock);
+    completed.push_back({connectionID, sequence, move(response)});
+
+    if (--outstandingJobs == 0) {
+      jobsDrained.notify_all();
+    }
+  }
+
+  uint64_t one = 1;
+  ssize_t written = write(wakeFd, &one, sizeof(one)); // Never blocks, the counter just saturates
+  (void)written;
+}
+
+
+//
+// update
+//
+// Updater loop: applies the queued closure updates one at a time in arrival order, off the I/O thread and the pool since
+// rebuilding can take a while, until the server stops and the queue is empty
+//
+void routingServer::update()
+{
+  while (true) {
+    pendingEdit next;
+
+    {
+      unique_lock<mutex> guard(editLock);
+      editReady.wait(guard, [&]() { return stopping || !edits.empty(); });
+
+      if (edits.empty()) { // Only when stopping
+        return;
+      }
+
+      next = move(edits.front());
+      edits.pop_front();
+    }
+
+    ostringstream out;
+    string error;
+
+    if (Live->apply({next.edit}, error)) {
+      writeOverlayStatus(out, format, *Live->snapshot());
+    }
+    else {
+      writeError(out, format, error);
+    }
+
+    complete(next.connectionID, next.sequence, out.str());
+  }
+}
+
+
+//
+// respond
+//
+// Records the response for request sequence, and queues every response that is now next in line for output
+//
+void routingServer::respond(connection& client, long long sequence, string response)
+{
+  client.ready[sequence] = move(response);
+
+  for (auto next = client.ready.find(client.nextToSend); next != client.ready.end(); next = client.ready.find(client.nextToSend)) {
+    client.output += next->second;
+    client.ready.erase(next);
+    client.nextToSend++;
+  }
+}
+
+
+//
+// collectCompletions
+//
+// Picks up the responses the workers finished and sends them on their connections
+//
+void routingServer::collectCompletions()
+{
+  uint64_t counter;
+  ssize_t drained = read(wakeFd, &counter, sizeof(counter)); // Reset the eventfd, every completion is in the vector anyway
+  (void)drained;
+
+  vector<completion> finishedJobs;
+
+  {
+    lock_guard<mutex> guard(completedLock);
+    finishedJobs.swap(completed);
+  }
+
+  vector<long long> touched;
+
+  for (completion& done : finishedJobs) {
+    auto found = connections.find(done.connectionID);
+
+    if (found == connections.end()) { // Client went away before its response was ready
+      continue;
+    }
+
+    connection& client = *found->second;
+
+    if (done.sequence == client.editSequence) {
+      client.editSequence = -1;
+    }
+
+    respond(client, done.sequence, move(done.response));
+    touched.push_back(done.connectionID);
+  }
+
+  for (long long id : touched) {
+    auto found = connections.find(id);
+
+    if (found == connections.end()) {
+      continue;
+    }
+
+    connection& client = *found->second;
+    dispatchLines(client); // Room in the in-flight window again
+    writeTo(client);
+
+    if (connections.count(id)) {
+      if (finished(client)) {
+        closeConnection(id);
+      }
+      else {
+        updateEvents(client);
+      }
+    }
+  }
+}
+
+
+//
+// writeTo
+//
+// Writes as much queued output as the socket takes without blocking
+//
+void routingServer::writeTo(connection& client)
+{
+  while (client.outputSent < client.output.size()) {
+    ssize_t sent = send(client.fd, client.output.data() + client.outputSent, client.output.size() - client.outputSent, MSG_NOSIGNAL);
+
+    if (sent > 0) {
+      client.outputSent += static_cast<size_t>(sent);
+    }
+    else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    else if (sent == -1 && errno == EINTR) {
+      continue;
+    }
+    else {
+      closeConnection(client.id);
+      return;
+    }
+  }
+
+  client.output.clear();
+  client.outputSent = 0;
+}
+
+
+//
+// updateEvents
+//
+// Watches for input only while the client is under its in-flight limit, and for output only while some is queued
+//
+void routingServer::updateEvents(connection& client)
+{
+  uint32_t events = 0;
+
+  if (!client.closing && client.nextSequence - client.nextToSend < MAX_IN_FLIGHT && !client.heldBack) {
+    events |= EPOLLIN;
+  }
+
+  if (client.outputSent < client.output.size()) {
+    events |= EPOLLOUT;
+  }
+
+  if (events != client.events) {
+    epoll_event event;
+    event.events = events;
+    event.data.u64 = static_cast<uint64_t>(client.id);
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &event);
+    client.events = events;
+  }
+}
+
+
+//
+// finished
+//
+// True once a closing client has every response written
+//
+bool routingServer::finished(const connection& client) const
+{
+  return client.closing && client.nextToSend == client.nextSequence && client.output.empty();
+}
+
+
+//
+// closeConnection
+//
+void routingServer::closeConnection(long long id)
+{
+  auto found = connections.find(id);
+
+  if (found == connections.end()) {
+    return;
+  }
+
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, found->second->fd, nullptr);
+  ::close(found->second->fd);
+  connections.erase(found);
+}
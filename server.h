@@ -0,0 +1,112 @@
+// server.h
+//
+// Declares the routing server: the loaded map stays resident and answers requests over TCP
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+
+#include "meeting.h"
+#include "overlay.h"
+
+using namespace std;
+
+
+//
+// routingServer
+//
+// Line protocol over TCP, one request per line with tab separated fields:
+//
+//   meet <building 1> <building 2>    meeting point of two people, answered like a --queries line
+//   route <building 1> <building 2>   shortest footway path from one building to the other
+//   stats                             result cache hits, misses and entries (since the last closure update)
+//   profile                           query counter and stage time histograms (builds with PROFILE=1)
+//   close|open|penalize|reopen ...    closure update, see overlayEdit, answered with the new overlay status
+//   overlay                           status of the current closures overlay
+//
+// and one response line per request, in the --format of the batch mode. Clients may pipeline any number of
+// requests; each connection gets its responses back in request order.
+//
+// Closure updates never run on the pool: one updater thread applies them one at a time in the order they
+// arrived, while the workers keep answering queries on the previous snapshot (liveMap). On one connection an
+// update waits for the requests before it to be answered, and the requests after it wait for it to be
+// published, so each request sees exactly the updates sent before it on that connection.
+//
+// One thread (the one calling serve()) does all the socket I/O with non-blocking sockets and epoll, and never
+// searches: requests are submitted to the MeetingPointPool, whose workers format the response and hand it
+// back through a wake-up eventfd. A connection with too many requests in flight simply stops being read
+// until its responses drain, so one client can not pile up unbounded work.
+//
+class routingServer
+{
+private:
+  struct connection; // Defined in server.cpp
+
+  struct completion // A response finished by a worker, waiting for the I/O thread
+  {
+    long long connectionID;
+    long long sequence;
+    string response;
+  };
+
+  struct pendingEdit // A closure update waiting for the updater thread
+  {
+    long long connectionID;
+    long long sequence;
+    overlayEdit edit;
+  };
+
+  MeetingPointPool* pool;
+  liveMap* Live; // For the stats, profile and overlay requests, and closure updates
+  resultFormat format;
+
+  int listenFd; // -1 until listen()
+  int epollFd;
+  int wakeFd;   // eventfd, written by workers when completions are added
+
+  map<long long, unique_ptr<connection>> connections; // By connection ID, never reused, so late completions can't hit a new client
+  long long nextConnectionID;
+
+  mutex completedLock; // Guards completed and outstandingJobs, shared with the workers
+  condition_variable jobsDrained;
+  vector<completion> completed;
+  int outstandingJobs;
+
+  thread updater; // Applies the closure updates in edits, in order
+  mutex editLock;
+  condition_variable editReady;
+  deque<pendingEdit> edits;
+  bool stopping; // Set by the destructor, the updater finishes the queued edits and exits
+
+  void acceptConnections();
+  void readFrom(connection& client);
+  void writeTo(connection& client);
+  void dispatchLines(connection& client);
+  void dispatch(connection& client, const string& line);
+  void respond(connection& client, long long sequence, string response);
+  void complete(long long connectionID, long long sequence, string response);
+  void update();
+  void collectCompletions();
+  void updateEvents(connection& client);
+  void closeConnection(long long id);
+  bool finished(const connection& client) const;
+
+public:
+  routingServer(MeetingPointPool& pool, liveMap& live, resultFormat format);
+  ~routingServer();
+
+  routingServer(const routingServer&) = delete;
+  routingServer& operator=(const routingServer&) = delete;
+
+  bool listen(int port);
+  void serve();
+};
@@ -0,0 +1,446 @@
+// spatial.cpp
+//
+// Implements the uniform grid spatial index
+//
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "spatial.h"
+
+using namespace std;
+
+
+//
+// Points per cell the grid is sized for, and the same earth radius/PI as distBetween2Points
+//
+static const double POINTS_PER_CELL = 2.0;
+static const double PI = 3.14159265;
+static const double MILES_PER_DEGREE = 3963.1 * PI / 180.0;
+
+
+//
+// Constructor
+//
+// Empty grid, every query returns nothing
+//
+spatialGrid::spatialGrid()
+{
+  minLat = minLon = 0.0;
+  cellLat = cellLon = 1.0;
+  rows = cols = 0;
+  cellMiles = 0.0;
+  cellOffsets.push_back(0);
+}
+
+
+//
+// Constructor
+//
+// Builds the grid over points (copied). Cells are square in miles at the grid's middle latitude.
+//
+spatialGrid::spatialGrid(span<const Coordinates> points)
+  : Points(points.begin(), points.end())
+{
+  rows = cols = 0;
+  minLat = minLon = 0.0;
+  cellLat = cellLon = 1.0;
+  cellMiles = 0.0;
+
+  if (Points.empty())
+  {
+    cellOffsets.push_back(0);
+    return;
+  }
+
+  double maxLat = Points[0].Lat, maxLon = Points[0].Lon;
+  minLat = Points[0].Lat;
+  minLon = Points[0].Lon;
+
+  for (const Coordinates& p : Points)
+  {
+    minLat = min(minLat, p.Lat);
+    maxLat = max(maxLat, p.Lat);
+    minLon = min(minLon, p.Lon);
+    maxLon = max(maxLon, p.Lon);
+  }
+
+  //
+  // size square cells so the bounding box holds about POINTS_PER_CELL points per cell:
+  //
+  double cosMid = cos((minLat + maxLat) / 2.0 * PI / 180.0);
+  double heightMiles = max((maxLat - minLat) * MILES_PER_DEGREE, 1e-6);
+  double widthMiles = max((maxLon - minLon) * MILES_PER_DEGREE * cosMid, 1e-6);
+
+  double cellCount = max(1.0, Points.size() / POINTS_PER_CELL);
+  double sideMiles = sqrt(heightMiles * widthMiles / cellCount);
+
+  cellLat = sideMiles / MILES_PER_DEGREE;
+  cellLon = sideMiles / (MILES_PER_DEGREE * cosMid);
+
+  rows = min(4096, static_cast<int>(heightMiles / sideMiles) + 1);
+  cols = min(4096, static_cast<int>(widthMiles / sideMiles) + 1);
+  cellLat = max(cellLat, (maxLat - minLat) / rows * 1.000001); // Capped grids grow their cells instead
+  cellLon = max(cellLon, (maxLon - minLon) / cols * 1.000001);
+
+  //
+  // a cell's width shrinks towards the pole, so bound it at the latitude furthest from the equator:
+  //
+  double cosMin = cos(max(fabs(minLat), fabs(maxLat)) * PI / 180.0);
+  cellMiles = min(cellLat * MILES_PER_DEGREE, cellLon * MILES_PER_DEGREE * cosMin) * 0.999;
+
+  //
+  // counting sort of the points into cells:
+  //
+  vector<int> pointCell(Points.size());
+  cellOffsets.assign(rows * cols + 1, 0);
+
+  for (size_t i = 0; i < Points.size(); i++)
+  {
+    int row, col;
+    cellOf(Points[i].Lat, Points[i].Lon, row, col);
+
+    pointCell[i] = row * cols + col;
+    cellOffsets[pointCell[i] + 1]++;
+  }
+
+  for (int c = 0; c < rows * cols; c++)
+  {
+    cellOffsets[c + 1] += cellOffsets[c];
+  }
+
+  cellPoints.resize(Points.size());
+  cellTrig.resize(Points.size());
+  vector<int> fill(cellOffsets.begin(), cellOffsets.end() - 1);
+
+  for (size_t i = 0; i < Points.size(); i++)
+  {
+    int slot = fill[pointCell[i]]++;
+
+    cellPoints[slot] = static_cast<int>(i);
+    cellTrig[slot] = precomputeTrig(Points[i].Lat, Points[i].Lon);
+  }
+}
+
+
+//
+// cellOf
+//
+// Returns the cell holding (lat, lon), clamped to the grid for points outside of it
+//
+void spatialGrid::cellOf(double lat, double lon, int& row, int& col) const
+{
+  row = static_cast<int>(floor((lat - minLat) / cellLat));
+  col = static_cast<int>(floor((lon - minLon) / cellLon));
+
+  row = max(0, min(rows - 1, row));
+  col = max(0, min(cols - 1, col));
+}
+
+
+//
+// size / point
+//
+// # of indexed points, and the point at index i
+//
+int spatialGrid::size() const
+{
+  return static_cast<int>(Points.size());
+}
+
+const Coordinates& spatialGrid::point(int i) const
+{
+  return Points[i];
+}
+
+
+//
+// nearest
+//
+// Returns the index of the point closest to (lat, lon), or -1 if the grid is empty
+//
+int spatialGrid::nearest(double lat, double lon) const
+{
+  vector<int> closest = nearestWithin(lat, lon, numeric_limits<double>::max(), 1);
+
+  return closest.empty() ? -1 : closest[0];
+}
+
+
+//
+// ringChordBound
+//
+// Squared chord lower bound for every point at least (ring - 1) cells away from the query cell
+//
+static double ringChordBound(int ring, double cellMiles)
+{
+  return ring <= 1 ? 0.0 : milesToChordSquared((ring - 1) * cellMiles);
+}
+
+
+//
+// scanRing
+//
+// Appends (chord squared, index) for every point in the square ring of cells at Chebyshev distance
+// ring from (centerRow, centerCol). Each cell is scored in one batch call.
+//
+void spatialGrid::scanRing(const TrigCoordinates& from, int centerRow, int centerCol, int ring,
+  vector<pair<double, int>>& found) const
+{
+  double chords[64];
+
+  for (int row = centerRow - ring; row <= centerRow + ring; row++)
+  {
+    if (row < 0 || row >= rows)
+    {
+      continue;
+    }
+
+    bool edgeRow = (row == centerRow - ring || row == centerRow + ring);
+    int step = edgeRow ? 1 : 2 * ring; // Inner rows of the ring only have their two end cells
+
+    for (int col = centerCol - ring; col <= centerCol + ring; col += max(step, 1))
+    {
+      if (col < 0 || col >= cols)
+      {
+        continue;
+      }
+
+      int cell = row * cols + col;
+
+      for (int first = cellOffsets[cell]; first < cellOffsets[cell + 1]; first += 64)
+      {
+        int count = min(64, cellOffsets[cell + 1] - first);
+        chordSquaredBatch(from, &cellTrig[first], count, chords);
+
+        for (int c = 0; c < count; c++)
+        {
+          found.push_back(make_pair(chords[c], cellPoints[first + c]));
+        }
+      }
+    }
+  }
+}
+
+
+//
+// nearestWithin
+//
+// Returns the indices of up to k points within radius miles of (lat, lon), closest first
+//
+vector<int> spatialGrid::nearestWithin(double lat, double lon, double radius, int k) const
+{
+  vector<pair<double, int>> found; // (distance, point index), kept sorted and at most k long
+  vector<pair<double, int>> ringPoints;
+
+  if (Points.empty() || k <= 0)
+  {
+    return vector<int>();
+  }
+
+  int centerRow, centerCol;
+  cellOf(lat, lon, centerRow, centerCol);
+
+  TrigCoordinates from = precomputeTrig(lat, lon);
+  double radiusChord = milesToChordSquared(radius);
+  int maxRing = max(rows, cols);
+
+  for (int ring = 0; ring <= maxRing; ring++)
+  {
+    //
+    // every point in this ring is at least (ring - 1) cells away, so stop once that beats what we need:
+    //
+    double ringBound = ringChordBound(ring, cellMiles);
+
+    if (ringBound > radiusChord)
+    {
+      break;
+    }
+
+    if ((int)found.size() == k && ringBound > found.back().first)
+    {
+      break;
+    }
+
+    ringPoints.clear();
+    scanRing(from, centerRow, centerCol, ring, ringPoints);
+
+    for (const pair<double, int>& candidate : ringPoints)
+    {
+      if (candidate.first > radiusChord)
+      {
+        continue;
+      }
+
+      if ((int)found.size() == k && !(candidate < found.back()))
+      {
+        continue;
+      }
+
+      found.insert(upper_bound(found.begin(), found.end(), candidate), candidate);
+
+      if ((int)found.size() > k)
+      {
+        found.pop_back();
+      }
+    }
+  }
+
+  vector<int> indices;
+  indices.reserve(found.size());
+
+  for (const auto& f : found)
+  {
+    indices.push_back(f.second);
+  }
+
+  return indices;
+}
+
+
+//
+// byDistance
+//
+// Returns a cursor over every point in increasing distance from (lat, lon), ties going to the lower index
+//
+spatialGrid::cursor spatialGrid::byDistance(double lat, double lon) const
+{
+  return cursor(*this, lat, lon);
+}
+
+
+//
+// cursor::cursor
+//
+spatialGrid::cursor::cursor(const spatialGrid& grid, double lat, double lon)
+  : Grid(&grid), From(precomputeTrig(lat, lon)), nextRing(0)
+{
+  centerRow = centerCol = 0;
+
+  if (Grid->size() > 0)
+  {
+    Grid->cellOf(lat, lon, centerRow, centerCol);
+  }
+}
+
+
+//
+// cursor::next
+//
+// Returns the index of the next closest point, or -1 once every point has been returned
+//
+int spatialGrid::cursor::next()
+{
+  if (Grid->size() == 0)
+  {
+    return -1;
+  }
+
+  int maxRing = max(Grid->rows, Grid->cols);
+  vector<pair<double, int>> ringPoints;
+
+  while (true)
+  {
+    //
+    // a pending point is safe to return once no unscanned ring can hold anything closer:
+    //
+    if (!pending.empty() && (nextRing > maxRing || pending.top().first < ringChordBound(nextRing, Grid->cellMiles)))
+    {
+      int i = pending.top().second;
+      pending.pop();
+      return i;
+    }
+
+    if (nextRing > maxRing)
+    {
+      return -1;
+    }
+
+    ringPoints.clear();
+    Grid->scanRing(From, centerRow, centerCol, nextRing, ringPoints);
+    nextRing++;
+
+    for (const pair<double, int>& candidate : ringPoints)
+    {
+      pending.push(candidate);
+    }
+  }
+}
+
+
+//
+// hilbertOrder
+//
+// Returns the indices of points in the order a Hilbert curve over their bounding box visits them, ties in index
+// order. The curve never jumps, so points close on the map end up close in the order.
+//
+vector<int> hilbertOrder(span<const Coordinates> points)
+{
+  const int BITS = 16; // Curve resolution, 2^16 cells per side
+  const unsigned CELLS = 1u << BITS;
+  const double SIDE = CELLS - 1;
+
+  vector<int> ordered(points.size());
+
+  for (size_t i = 0; i < ordered.size(); i++)
+  {
+    ordered[i] = static_cast<int>(i);
+  }
+
+  if (points.empty())
+  {
+    return ordered;
+  }
+
+  double minLat = points[0].Lat, maxLat = points[0].Lat;
+  double minLon = points[0].Lon, maxLon = points[0].Lon;
+
+  for (const Coordinates& p : points)
+  {
+    minLat = min(minLat, p.Lat);
+    maxLat = max(maxLat, p.Lat);
+    minLon = min(minLon, p.Lon);
+    maxLon = max(maxLon, p.Lon);
+  }
+
+  double spanLat = max(maxLat - minLat, 1e-12);
+  double spanLon = max(maxLon - minLon, 1e-12);
+  vector<unsigned long long> distance(points.size()); // Position of each point along the curve
+
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    unsigned x = static_cast<unsigned>((points[i].Lon - minLon) / spanLon * SIDE);
+    unsigned y = static_cast<unsigned>((points[i].Lat - minLat) / spanLat * SIDE);
+    unsigned long long d = 0;
+
+    for (unsigned s = 1u << (BITS - 1); s > 0; s /= 2) // The classic xy --> d walk: quadrant by quadrant, rotating as it goes
+    {
+      unsigned rx = (x & s) > 0;
+      unsigned ry = (y & s) > 0;
+
+      d += static_cast<unsigned long long>(s) * s * ((3 * rx) ^ ry);
+
+      if (ry == 0)
+      {
+        if (rx == 1)
+        {
+          x = CELLS - 1 - x;
+          y = CELLS - 1 - y;
+        }
+
+        swap(x, y);
+      }
+    }
+
+    distance[i] = d;
+  }
+
+  stable_sort(ordered.begin(), ordered.end(), [&](int a, int b) {
+    return distance[a] < distance[b];
+  });
+
+  return ordered;
+}
@@ -0,0 +1,84 @@
+// spatial.h
+//
+// Declares a uniform grid spatial index over (lat, lon) points for nearest-neighbor queries
+//
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <span>
+#include <queue>
+#include <utility>
+
+#include "osm.h"
+#include "dist.h"
+
+using namespace std;
+
+
+//
+// spatialGrid
+//
+// Buckets points into a uniform lat/lon grid built once, stored CSR-style (cell offsets plus one
+// contiguous array of point indices). Queries scan rings of cells outward from the query point and stop
+// as soon as the next ring cannot hold anything closer, so only a handful of cells are ever looked at.
+// Points are ranked by squared chord distance on precomputed unit vectors (dist.cpp), which orders them
+// like distBetween2Points without any trig per point, except that distances acos rounds to the same
+// value are told apart by the chord. Only exact chord ties go to the point added first.
+//
+class spatialGrid
+{
+private:
+  vector<Coordinates> Points; // Indexed points, the index into this vector is what queries return
+
+  double minLat, minLon; // Grid origin and cell size in degrees
+  double cellLat, cellLon;
+  int rows, cols;
+  double cellMiles; // Lower bound on the width and height of a cell in miles, used to stop ring scans
+
+  vector<int> cellOffsets; // Size rows * cols + 1, points of cell c are cellPoints[cellOffsets[c] .. cellOffsets[c + 1])
+  vector<int> cellPoints;
+  vector<TrigCoordinates> cellTrig; // Precomputed trig of cellPoints[c], stored cell by cell so a cell scans contiguously
+
+  void cellOf(double lat, double lon, int& row, int& col) const;
+  void scanRing(const TrigCoordinates& from, int centerRow, int centerCol, int ring,
+         vector<pair<double, int>>& found) const;
+
+public:
+  //
+  // cursor
+  //
+  // Walks the points of a grid in increasing distance from a query point, one at a time. Rings of
+  // cells are only scanned when the next point could come from them, so taking the first few
+  // points costs about as much as a nearest() query.
+  //
+  class cursor
+  {
+  private:
+    const spatialGrid* Grid;
+    TrigCoordinates From;
+    int centerRow, centerCol;
+    int nextRing; // First ring of cells not scanned yet
+
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> pending; // (chord squared, index) scanned, not yet returned
+
+  public:
+    cursor(const spatialGrid& grid, double lat, double lon);
+
+    int next();
+  };
+
+  spatialGrid();
+  spatialGrid(span<const Coordinates> points);
+
+  int size() const;
+  const Coordinates& point(int i) const;
+
+  int nearest(double lat, double lon) const;
+  vector<int> nearestWithin(double lat, double lon, double radius, int k) const;
+  cursor byDistance(double lat, double lon) const;
+};
+
+
+vector<int> hilbertOrder(span<const Coordinates> points);
@@ -1,6 +1,9 @@
 // testing.cpp
 //
-// This file is used for testing graph.h, use graph.txt for input
+// This file is used for testing graph.h, use graph.txt for input, and the
+// search engines against plain Dijkstra on it and on an OSM map (depaul.osm),
+// which is also read with both the streaming parser and the DOM readers and
+// searched by building name and updated with footway closures
 //
 
 #include <iostream>
@@ -10,8 +13,21 @@
 #include <map>
 #include <string>
 #include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <memory>
 
 #include "graph.h"
+#include "compactgraph.h"
+#include "search.h"
+#include "ch.h"
+#include "matrix.h"
+#include "osm.h"
+#include "nameindex.h"
+#include "spatial.h"
+#include "meeting.h"
+#include "overlay.h"
+#include "dist.h"
 
 using namespace std;
 
@@ -76,6 +92,83 @@ void buildGraph(string filename, graph<string,int>& G)
   }
 }
 
+//
+// buildGraphBulk:
+//
+// Same as buildGraph, but collects the edges and adds them with one
+// addEdgesBulk call, which should produce the exact same graph.
+//
+void buildGraphBulk(string filename, graph<string,int>& G)
+{
+  ifstream file(filename);
+  string   v;
+
+  if (!file.good())
+  {
+    return;
+  }
+
+  file >> v;
+
+  while (v != "#")
+  {
+    G.addVertex(v);
+    file >> v;
+  }
+
+  vector<graph<string,int>::BulkEdge> edges;
+  string src, dest;
+  int  weight;
+
+  file >> src;
+
+  while (src != "#")
+  {
+    file >> dest;
+    file >> weight;
+
+    edges.push_back({src, dest, weight});
+
+    file >> src;
+  }
+
+  G.addEdgesBulk(edges);
+}
+
+//
+// sameGraph:
+//
+// True if both graphs have the same vertices, and the same edges in the same order.
+//
+bool sameGraph(graph<string,int>& G1, graph<string,int>& G2)
+{
+  if (G1.getVertices() != G2.getVertices() || G1.NumEdges() != G2.NumEdges())
+  {
+    return false;
+  }
+
+  for (string v : G1.getVertices())
+  {
+    auto edges1 = G1.edges(v);
+    auto edges2 = G2.edges(v);
+
+    if (edges1.size() != edges2.size())
+    {
+      return false;
+    }
+
+    for (size_t i = 0; i < edges1.size(); i++)
+    {
+      if (edges1.begin()[i].toVert != edges2.begin()[i].toVert || edges1.begin()[i].toWeight != edges2.begin()[i].toWeight)
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 //
 // outputGraph:
 //
@@ -116,6 +209,475 @@ void outputGraph(graph<string,int>& G)
   }
 
   cout << endl;
+
+  //
+  // Same edges again through the zero-copy edges() range, in insertion order:
+  //
+  cout << "**Edge ranges: ";
+
+  for (string v : vertices)
+  {
+    for (const auto& edge : G.edges(v))
+    {
+      cout << "(" << v << "," << edge.toVert << "," << edge.toWeight << ") ";
+    }
+  }
+
+  cout << endl;
+}
+
+
+//
+// samePath:
+//
+// True if an engine's distance and path are the reference ones. Distances
+// may differ in the last bits, since engines add up the same edge weights
+// in different orders (a hierarchy adds up shortcuts).
+//
+bool samePath(double refDistance, const vector<long long>& refPath, double distance, const vector<long long>& path)
+{
+  if (refDistance == -1 || distance == -1)
+  {
+    return refDistance == distance && path.empty();
+  }
+
+  return fabs(distance - refDistance) <= 1e-9 * max(1.0, refDistance) && path == refPath;
+}
+
+
+//
+// enginesMatch:
+//
+// Finds the shortest path between every pair of the given vertices with
+// each engine and checks it against plain Dijkstra on the same weights:
+// A*, bidirectional A*, the contraction hierarchy and the building matrix
+// on G, Dijkstra and bidirectional A* on a BFS reordered copy, and radix
+// Dijkstra and the hierarchy on a fixed point copy. coords is the position
+// of each vertex of G (all zero is fine, A* is then just Dijkstra), and
+// bidirectional A* is only checked if G is symmetric, since its backward
+// search walks the same edges. The hierarchy and matrix are built here
+// unless given (the matrix then has to be over the given vertices, in that
+// order). Returns the # of mismatches, after printing the first few.
+//
+int enginesMatch(const compactGraph<long long,double>& G, const vector<Coordinates>& coords, const vector<long long>& vertices,
+  bool symmetric, const contractionHierarchy<long long,double>* hierarchy = nullptr, const buildingMatrix* precomputed = nullptr)
+{
+  compactGraph<long long,double> reordered = G.permuted(G.bfsOrder());
+  compactGraph<long long,double> fixed = G.toFixedWeights();
+  vector<Coordinates> reorderedCoords;
+
+  for (long long v : reordered.getVertices())
+  {
+    reorderedCoords.push_back(coords[G.indexOf(v)]);
+  }
+
+  searchEngine<long long,double> search(G, coords);
+  searchEngine<long long,double> reorderedSearch(reordered, reorderedCoords);
+  searchEngine<long long,double> fixedSearch(fixed);
+  contractionHierarchy<long long,double> fixedCH(fixed);
+  unique_ptr<contractionHierarchy<long long,double>> ownCH;
+  buildingMatrix ownMatrix;
+
+  if (hierarchy == nullptr)
+  {
+    ownCH = make_unique<contractionHierarchy<long long,double>>(G);
+    hierarchy = ownCH.get();
+  }
+
+  if (precomputed == nullptr)
+  {
+    ownMatrix = buildingMatrix::build(G, vertices, 2);
+    precomputed = &ownMatrix;
+  }
+
+  contractionHierarchy<long long,double>::queryContext context(*hierarchy);
+
+  int mismatches = 0;
+
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    for (size_t j = 0; j < vertices.size(); j++)
+    {
+      long long s = vertices[i], t = vertices[j];
+      vector<long long> refPath, fixedRefPath;
+
+      double refDistance = search.dijkstra(s, t, refPath);
+      double fixedRefDistance = fixedSearch.dijkstra(s, t, fixedRefPath);
+
+      //
+      // find runs one engine, onFixed says which reference it is held to:
+      //
+      auto check = [&](const string& engine, bool onFixed, auto find)
+      {
+        vector<long long> path;
+        double distance = find(path);
+
+        if (onFixed ? samePath(fixedRefDistance, fixedRefPath, distance, path) : samePath(refDistance, refPath, distance, path))
+        {
+          return;
+        }
+
+        if (mismatches++ < 5)
+        {
+          cout << "**Mismatch: " << engine << " from " << s << " to " << t << " gives " << distance
+               << ", Dijkstra " << (onFixed ? fixedRefDistance : refDistance) << endl;
+        }
+      };
+
+      check("astar", false, [&](vector<long long>& path) { return search.astar(s, t, path); });
+      check("ch", false, [&](vector<long long>& path) { return hierarchy->shortestPath(context, s, t, path); });
+      check("matrix", false, [&](vector<long long>& path) { return precomputed->path(G, (int) i, (int) j, path); });
+      check("reordered dijkstra", false, [&](vector<long long>& path) { return reorderedSearch.dijkstra(s, t, path); });
+      check("radix", true, [&](vector<long long>& path) { return fixedSearch.shortestPath(searchMode::RADIX_DIJKSTRA, s, t, path); });
+      check("fixed ch", true, [&](vector<long long>& path) { return fixedCH.shortestPath(s, t, path); });
+
+      if (symmetric)
+      {
+        check("bidir", false, [&](vector<long long>& path) { return search.shortestPath(searchMode::BIDIRECTIONAL_ASTAR, s, t, path); });
+        check("reordered bidir", false, [&](vector<long long>& path) { return reorderedSearch.shortestPath(searchMode::BIDIRECTIONAL_ASTAR, s, t, path); });
+      }
+    }
+  }
+
+  return mismatches;
+}
+
+
+//
+// osmContents:
+//
+// What the map readers fill in.
+//
+struct osmContents
+{
+  NodeTable            Nodes;
+  vector<FootwayInfo>  Footways;
+  vector<BuildingInfo> Buildings;
+};
+
+
+//
+// loadWithDOM:
+//
+// Reads an OSM file with the TinyXML2 based readers, like the
+// application did before the streaming parser.
+//
+bool loadWithDOM(string filename, osmContents& contents)
+{
+  XMLDocument xmldoc;
+
+  if (!LoadOpenStreetMap(filename, xmldoc))
+  {
+    return false;
+  }
+
+  ReadMapNodes(xmldoc, contents.Nodes);
+  ReadFootways(xmldoc, contents.Footways);
+  ReadUniversityBuildings(xmldoc, contents.Nodes, contents.Buildings);
+
+  return true;
+}
+
+
+//
+// sameMap:
+//
+// True if both loads have the same nodes, footways and buildings, in the
+// same order, down to the last bit of every coordinate.
+//
+bool sameMap(const osmContents& M1, const osmContents& M2)
+{
+  if (M1.Nodes.IDs != M2.Nodes.IDs || M1.Nodes.Lats != M2.Nodes.Lats || M1.Nodes.Lons != M2.Nodes.Lons)
+  {
+    return false;
+  }
+
+  if (M1.Footways.size() != M2.Footways.size() || M1.Buildings.size() != M2.Buildings.size())
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < M1.Footways.size(); i++)
+  {
+    if (M1.Footways[i].ID != M2.Footways[i].ID || M1.Footways[i].Nodes != M2.Footways[i].Nodes)
+    {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < M1.Buildings.size(); i++)
+  {
+    const BuildingInfo& b1 = M1.Buildings[i];
+    const BuildingInfo& b2 = M2.Buildings[i];
+
+    if (b1.Fullname != b2.Fullname || b1.Abbrev != b2.Abbrev || b1.Coords.ID != b2.Coords.ID
+      || b1.Coords.Lat != b2.Coords.Lat || b1.Coords.Lon != b2.Coords.Lon)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+//
+// linearSearch:
+//
+// The two-pass scan the application used before the name index: the first
+// building whose abbreviation contains term, else the first whose full name
+// does, else -1.
+//
+int linearSearch(const vector<BuildingInfo>& Buildings, const string& term)
+{
+  for (size_t i = 0; i < Buildings.size(); i++)
+  {
+    if (Buildings[i].Abbrev.find(term) != string::npos)
+    {
+      return (int) i;
+    }
+  }
+
+  for (size_t i = 0; i < Buildings.size(); i++)
+  {
+    if (Buildings[i].Fullname.find(term) != string::npos)
+    {
+      return (int) i;
+    }
+  }
+
+  return -1;
+}
+
+
+//
+// nameIndexMatches:
+//
+// Looks up every abbreviation and full name, every piece of them 1 to 5
+// characters long, the empty string and a term no building has, and checks
+// the name index finds the same building as the scan. Returns the # of
+// mismatches, after printing the first few.
+//
+int nameIndexMatches(const vector<BuildingInfo>& Buildings)
+{
+  nameIndex index(Buildings);
+  set<string> terms = {"", "#no such building#"};
+
+  for (const BuildingInfo& building : Buildings)
+  {
+    for (const string& field : {building.Abbrev, building.Fullname})
+    {
+      terms.insert(field);
+
+      for (size_t length = 1; length <= 5; length++)
+      {
+        for (size_t start = 0; start + length <= field.size(); start++)
+        {
+          terms.insert(field.substr(start, length));
+        }
+      }
+    }
+  }
+
+  int mismatches = 0;
+
+  for (const string& term : terms)
+  {
+    int expected = linearSearch(Buildings, term);
+    int found = index.search(term);
+
+    if (found != expected && mismatches++ < 5)
+    {
+      cout << "**Mismatch: name index finds " << found << " for '" << term << "', the scan " << expected << endl;
+    }
+  }
+
+  return mismatches;
+}
+
+
+//
+// overlayMatches:
+//
+// Closes, penalizes and opens footways on a liveMap over G (coords and
+// Buildings being its vertex positions and buildings), and checks every
+// version it publishes: Dijkstra on the adjusted graph against the
+// recontracted hierarchy and the partially rebuilt building matrix (and
+// the other engines) between every pair of buildings with enginesMatch,
+// and every meeting point the version answers, some of them carried over
+// in its result cache, against a fresh map over the same graph with no
+// cache. Returns the # of mismatches, after printing the first few.
+//
+int overlayMatches(const compactGraph<long long,double>& G, const vector<Coordinates>& coords, const vector<BuildingInfo>& Buildings)
+{
+  vector<Coordinates> centers;
+
+  for (const BuildingInfo& building : Buildings)
+  {
+    centers.push_back(building.Coords);
+  }
+
+  spatialGrid FootwayNodes(coords);
+  spatialGrid BuildingCenters(centers);
+  vector<long long> buildingNodes;
+
+  for (const BuildingInfo& building : Buildings)
+  {
+    buildingNodes.push_back(getClosestNode(FootwayNodes, building).ID);
+  }
+
+  contractionHierarchy<long long,double> CH(G);
+  buildingMatrix matrix = buildingMatrix::build(G, buildingNodes, 2);
+  liveMap Live(Buildings, FootwayNodes, BuildingCenters, G, coords, searchMode::DIJKSTRA, &CH, &matrix,
+    meetingObjective::MIDPOINT, Buildings.size() * Buildings.size(), 2);
+
+  int B = (int) Buildings.size();
+  int mismatches = 0;
+
+  //
+  // checks the current version:
+  //
+  auto check = [&]()
+  {
+    shared_ptr<const mapSnapshot> snapshot = Live.snapshot();
+    const MeetingPointMap& map = *snapshot->Map;
+
+    mismatches += enginesMatch(map.G, coords, buildingNodes, true, map.CH, map.Matrix);
+
+    MeetingPointMap fresh(Buildings, FootwayNodes, BuildingCenters, map.G, coords, searchMode::DIJKSTRA, nullptr);
+    MeetingPointQuery query(map), freshQuery(fresh);
+
+    for (int i = 0; i < B; i++)
+    {
+      for (int j = 0; j < B; j++)
+      {
+        MeetingPointResult result = query.find(Buildings[i].Fullname, Buildings[j].Fullname);
+        MeetingPointResult expected = freshQuery.find(Buildings[i].Fullname, Buildings[j].Fullname);
+
+        bool same = result.Status == expected.Status && result.Destinations.size() == expected.Destinations.size()
+          && samePath(expected.Distance1, expected.Path1, result.Distance1, result.Path1)
+          && samePath(expected.Distance2, expected.Path2, result.Distance2, result.Path2);
+
+        if (!same && mismatches++ < 5)
+        {
+          cout << "**Mismatch: version " << snapshot->Version << " meets " << Buildings[i].Fullname << " and "
+               << Buildings[j].Fullname << " at " << result.Distance1 << " + " << result.Distance2 << ", expected "
+               << expected.Distance1 << " + " << expected.Distance2 << endl;
+        }
+      }
+    }
+  };
+
+  //
+  // applies one edit and checks the version it publishes:
+  //
+  auto apply = [&](overlayEdit edit)
+  {
+    string error;
+
+    if (!Live.apply({edit}, error))
+    {
+      cout << "**Error: " << error << endl;
+      mismatches++;
+      return;
+    }
+
+    check();
+  };
+
+  //
+  // a route between two buildings the current version takes, for the
+  // next edit to land on (the k-th with at least 4 nodes):
+  //
+  auto busyRoute = [&](int k)
+  {
+    shared_ptr<const MeetingPointMap> map = Live.map();
+    searchEngine<long long,double> search(map->G);
+    vector<long long> path;
+
+    for (int i = 0; i < B; i++)
+    {
+      path.clear();
+
+      if (search.dijkstra(buildingNodes[i], buildingNodes[B - 1 - i], path) != -1 && path.size() >= 4 && k-- == 0)
+      {
+        return path;
+      }
+    }
+
+    return vector<long long>{ buildingNodes[0], buildingNodes[0], buildingNodes[0] };  // the edits then fail and are counted
+  };
+
+  check();
+
+  vector<long long> route = busyRoute(0);
+  long long closedNode = route[route.size() / 2];
+  apply({ overlayEdit::CLOSE, closedNode, -1, 0 });
+
+  route = busyRoute(1);
+  pair<long long, long long> penalized(route[1], route[2]);
+  apply({ overlayEdit::PENALIZE, penalized.first, penalized.second, 0.5 });
+
+  route = busyRoute(2);
+  apply({ overlayEdit::CLOSE, route[route.size() - 3], route[route.size() - 2], 0 });
+
+  apply({ overlayEdit::PENALIZE, penalized.first, penalized.second, 2 });  // only tightens, so rows and results carry over
+  apply({ overlayEdit::OPEN, closedNode, -1, 0 });
+  apply({ overlayEdit::REOPEN, -1, -1, 0 });
+
+  return mismatches;
+}
+
+
+//
+// buildFootwayGraph:
+//
+// Loads the footway graph of an OSM file like application.cpp does: every
+// footway node is a vertex, and each segment an edge both ways weighted by
+// its length in miles. coords is filled with the position of each vertex.
+//
+bool buildFootwayGraph(string filename, compactGraph<long long,double>& CG, vector<Coordinates>& coords)
+{
+  NodeTable           nodes;
+  vector<FootwayInfo>  footways;
+  vector<BuildingInfo> buildings;
+
+  if (!StreamOpenStreetMap(filename, nodes, footways, buildings, 1))
+  {
+    return false;
+  }
+
+  graph<long long,double> G;
+
+  for (const FootwayInfo& footway : footways)
+  {
+    for (size_t j = 0; j + 1 < footway.Nodes.size(); j++)
+    {
+      long long from = footway.Nodes[j], to = footway.Nodes[j + 1];
+
+      if (nodes.find(from) == -1 || nodes.find(to) == -1)
+      {
+        continue;
+      }
+
+      Coordinates a = nodes.at(from), b = nodes.at(to);
+      double miles = distBetween2Points(a.Lat, a.Lon, b.Lat, b.Lon);
+
+      G.addVertex(from);
+      G.addVertex(to);
+      G.addEdge(from, to, miles);
+      G.addEdge(to, from, miles);
+    }
+  }
+
+  CG = freeze(G);
+
+  for (long long v : CG.getVertices())
+  {
+    coords.push_back(nodes.at(v));
+  }
+
+  return true;
 }
 
 
@@ -138,6 +700,89 @@ int main()
   
   G.dump(cout);
 
+  //
+  // The bulk loader should build the very same graph:
+  //
+  graph<string,int> bulkG;
+  buildGraphBulk(filename, bulkG);
+
+  cout << "**Bulk loaded graph matches: " << (sameGraph(G, bulkG) ? "yes" : "no") << endl;
+
+  //
+  // Every engine should find the very same paths as plain Dijkstra, first
+  // on this graph (vertices numbered by their letter, and one-way edges):
+  //
+  graph<long long,double> numbered;
+
+  for (string v : G.getVertices())
+  {
+    numbered.addVertex(v[0]);
+  }
+
+  for (string v : G.getVertices())
+  {
+    for (const auto& edge : G.edges(v))
+    {
+      numbered.addEdge(v[0], edge.toVert[0], edge.toWeight);
+    }
+  }
+
+  compactGraph<long long,double> CG = freeze(numbered);
+  vector<long long> vertices(CG.getVertices().begin(), CG.getVertices().end());
+
+  cout << "**Engines match Dijkstra: " << (enginesMatch(CG, vector<Coordinates>(CG.NumVertices()), vertices, false) == 0 ? "yes" : "no") << endl;
+
+  //
+  // The rest runs on a real map:
+  //
+  string mapname;
+  vector<Coordinates> coords;
+
+  cout << "Enter OSM map to check the parser and engines on (e.g. depaul.osm)> ";
+
+  if (cin >> mapname)
+  {
+    cout << endl;
+
+    //
+    // The streaming parser should read exactly what the DOM readers do,
+    // on one thread or several:
+    //
+    osmContents dom, streamed, parallel;
+
+    bool streamMatches = loadWithDOM(mapname, dom)
+      && StreamOpenStreetMap(mapname, streamed.Nodes, streamed.Footways, streamed.Buildings, 1)
+      && StreamOpenStreetMap(mapname, parallel.Nodes, parallel.Footways, parallel.Buildings, 4)
+      && sameMap(dom, streamed) && sameMap(dom, parallel);
+
+    cout << "**Streamed map matches DOM: " << (streamMatches ? "yes" : "no") << endl;
+
+    //
+    // Building lookups should find what a scan of the buildings does:
+    //
+    cout << "**Name index matches scan: " << (nameIndexMatches(streamed.Buildings) == 0 ? "yes" : "no") << endl;
+
+    //
+    // and the engines on a few pairs of it:
+    //
+    if (buildFootwayGraph(mapname, CG, coords))
+    {
+      vertices.clear();
+
+      for (int k = 0; k < 12; k++)  // spread over the map, some in other components
+      {
+        vertices.push_back(CG.vertexAt((int) ((long long) k * CG.NumVertices() / 12)));
+      }
+
+      cout << "**Engines match Dijkstra on the map: " << (enginesMatch(CG, coords, vertices, true) == 0 ? "yes" : "no") << endl;
+
+      //
+      // and again after every closure update, on what each one rebuilt:
+      //
+      cout << "**Closures match Dijkstra: " << (overlayMatches(CG, coords, streamed.Buildings) == 0 ? "yes" : "no") << endl;
+    }
+  }
+
   //
   // done:
   //